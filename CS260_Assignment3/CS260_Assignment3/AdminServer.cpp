@@ -0,0 +1,158 @@
+﻿/*****************************************************************
+ * @file   AdminServer.cpp
+ * @brief  Loopback-only HTTP listener for metrics and other
+ * operational pages, kept off the proxy's client port.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "AdminServer.h"
+#include "AsyncLogger.h"
+#include "Handover.h"
+#include "NetworkUtils.h"
+#include <chrono>
+#include <map>
+#include <thread>
+#include <vector>
+
+namespace
+{
+const size_t maxAdminRequest = 8192;
+
+struct AdminPage
+{
+    AdminHandler handler;
+    std::string contentType;
+};
+
+// Filled in before the admin thread starts and read-only afterwards
+std::map<std::string, AdminPage> adminPages;
+
+// Reads until the end of the request headers; admin clients keep their side open
+std::string ReceiveAdminRequest(SOCKET socket)
+{
+    std::string request;
+    std::vector<char> buffer(1024);
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < maxAdminRequest)
+    {
+        int bytesReceived = recv(socket, buffer.data(), static_cast<int>(buffer.size()), 0);
+        if (bytesReceived <= 0)
+        {
+            break;
+        }
+        request.append(buffer.data(), bytesReceived);
+    }
+    return request;
+}
+
+void ServeAdminRequest(SOCKET socket)
+{
+    std::string request = ReceiveAdminRequest(socket);
+    size_t pathStart = request.find(' ');
+    if (request.compare(0, 4, "GET ") != 0 || pathStart == std::string::npos)
+    {
+        SendErrorResponse(socket, 405, "Method Not Allowed");
+        return;
+    }
+    ++pathStart;
+    size_t pathEnd = request.find_first_of(" ?\r\n", pathStart);
+    std::string path = request.substr(pathStart, pathEnd - pathStart);
+
+    auto page = adminPages.find(path);
+    if (page == adminPages.end())
+    {
+        SendErrorResponse(socket, 404, "Not Found");
+        return;
+    }
+
+    std::string body = page->second.handler();
+    std::string response = "HTTP/1.1 200 OK\r\nContent-Type: " + page->second.contentType +
+                           "\r\nContent-Length: " + std::to_string(body.size()) +
+                           "\r\nConnection: close\r\n\r\n" + body;
+    send(socket, response.c_str(), static_cast<int>(response.size()), 0);
+}
+
+// Admin traffic is a scrape every few seconds, so one thread serving requests in turn is enough
+void AdminLoop(SOCKET listenSocket)
+{
+    while (true)
+    {
+        SOCKET socket = accept(listenSocket, nullptr, nullptr);
+        if (socket == INVALID_SOCKET)
+        {
+            // A successor process took the port, and closed this process's copy of it
+            if (HandedOver())
+            {
+                return;
+            }
+            HandleError("Admin accept failed");
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+
+        // A stalled client must not wedge the admin port for everyone else
+        DWORD timeoutMs = 2000;
+        setsockopt(
+            socket,
+            SOL_SOCKET,
+            SO_RCVTIMEO,
+            reinterpret_cast<const char*>(&timeoutMs),
+            sizeof(timeoutMs));
+
+        ServeAdminRequest(socket);
+        shutdown(socket, SD_SEND);
+        closesocket(socket);
+    }
+}
+
+SOCKET ListenOnAdminPort(int port)
+{
+    SOCKET listenSocket = CreateSocket(IPPROTO_TCP);
+    if (listenSocket == INVALID_SOCKET)
+    {
+        HandleError("Admin socket creation failed");
+        return INVALID_SOCKET;
+    }
+
+    sockaddr_in adminAddr;
+    if (SetAddress("127.0.0.1", port, adminAddr) == SOCKET_ERROR ||
+        bind(listenSocket, reinterpret_cast<sockaddr*>(&adminAddr), sizeof(adminAddr)) ==
+            SOCKET_ERROR ||
+        listen(listenSocket, SOMAXCONN) == SOCKET_ERROR)
+    {
+        HandleError("Admin listen failed");
+        closesocket(listenSocket);
+        return INVALID_SOCKET;
+    }
+    return listenSocket;
+}
+} // namespace
+
+void RegisterAdminHandler(
+    const std::string& path,
+    AdminHandler handler,
+    const std::string& contentType)
+{
+    adminPages[path] = AdminPage{std::move(handler), contentType};
+}
+
+bool StartAdminServer(int port)
+{
+    // A socket taken over from a predecessor is already listening
+    SOCKET listenSocket = InheritedSocket(HandoverRole::Admin);
+    if (listenSocket == INVALID_SOCKET)
+    {
+        listenSocket = ListenOnAdminPort(port);
+        if (listenSocket == INVALID_SOCKET)
+        {
+            return false;
+        }
+    }
+
+    OfferForHandover(HandoverRole::Admin, listenSocket);
+    std::thread adminThread(AdminLoop, listenSocket);
+    adminThread.detach();
+    return true;
+}
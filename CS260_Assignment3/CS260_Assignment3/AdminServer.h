@@ -0,0 +1,26 @@
+﻿/*****************************************************************
+ * @file   AdminServer.h
+ * @brief  Loopback-only HTTP listener for metrics and other
+ * operational pages, kept off the proxy's client port.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+// Builds the body of an admin page each time it is requested
+using AdminHandler = std::function<std::string()>;
+
+// Serves handler's output for GET requests to path; register before StartAdminServer
+void RegisterAdminHandler(
+    const std::string& path,
+    AdminHandler handler,
+    const std::string& contentType = "text/plain; version=0.0.4");
+
+// Listens on 127.0.0.1:port and answers admin requests from a background thread
+bool StartAdminServer(int port);
@@ -0,0 +1,376 @@
+﻿/*****************************************************************
+ * @file   AsyncLogger.cpp
+ * @brief  Non-blocking logging for client threads: records go into
+ * per-thread rings that a background thread formats and writes.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "AsyncLogger.h"
+#include "PerThreadPool.h"
+#include <WS2tcpip.h>
+#include <WinSock2.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+const uint32_t ringCapacity = 64; // Records per thread; must be a power of two
+const size_t maxRings = 1024;     // Threads beyond this many log nothing and count drops
+const size_t textCapacity = 120;
+const std::chrono::milliseconds drainInterval(20);
+
+enum class RecordKind : uint8_t
+{
+    Error,
+    Info,
+    Access,
+};
+
+// Plain binary record; formatting is left to the writer thread
+struct LogRecord
+{
+    int64_t timestampUs;
+    uint64_t connectionId;
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+    int64_t latencyUs;
+    uint64_t clientRetransmitted;
+    uint64_t upstreamRetransmitted;
+    uint32_t clientRttUs;
+    uint32_t clientCwnd;
+    uint32_t upstreamRttUs;
+    const char* clientSendLimit; // A string literal; nullptr when neither socket was sampled
+    uint32_t threadId;
+    uint32_t clientIp;
+    int32_t code; // Winsock error for errors, HTTP status for access records
+    RecordKind kind;
+    uint8_t textLength;
+    char text[textCapacity];
+};
+
+// Single-producer (the owning thread) single-consumer (the writer thread) ring
+struct LogRing
+{
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+    std::atomic<uint64_t> dropped{0};
+    uint64_t reportedDrops = 0; // Writer thread only
+    std::unique_ptr<LogRecord[]> records;
+};
+
+PerThreadPool<LogRing> rings(maxRings);
+std::atomic<uint64_t> ringlessDrops{0};
+uint64_t reportedRinglessDrops = 0;
+
+std::atomic<bool> running{false};
+std::thread writerThread;
+FILE* logOutput = stderr;
+FILE* accessOutput = nullptr;
+
+int64_t NowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+// What held sending to the client back for longest: "rwin" (a slow reader), "cwnd" (the
+// network) or "app" (nothing to send: the proxy or its upstream was the bottleneck)
+const char* DominantSendLimit(const TcpSample& sample)
+{
+    if (!sample.valid || !sample.hasSendLimits)
+    {
+        return "-";
+    }
+    if (sample.congestionLimitedMs >= sample.receiverLimitedMs &&
+        sample.congestionLimitedMs >= sample.senderLimitedMs && sample.congestionLimitedMs > 0)
+    {
+        return "cwnd";
+    }
+    if (sample.receiverLimitedMs >= sample.senderLimitedMs && sample.receiverLimitedMs > 0)
+    {
+        return "rwin";
+    }
+    return sample.senderLimitedMs > 0 ? "app" : "-";
+}
+
+LogRing* ThreadRing()
+{
+    thread_local PerThreadEntry<LogRing> entry(rings);
+    LogRing* ring = entry.get();
+    if (ring != nullptr && ring->records == nullptr)
+    {
+        // Allocated by the first owner and kept for every later one
+        ring->records = std::make_unique<LogRecord[]>(ringCapacity);
+    }
+    return ring;
+}
+
+void Push(RecordKind kind, int32_t code, const char* text, size_t textLength, LogRecord* filled)
+{
+    LogRing* ring = ThreadRing();
+    if (ring == nullptr)
+    {
+        ringlessDrops.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    uint32_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= ringCapacity)
+    {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    LogRecord& record = ring->records[head & (ringCapacity - 1)];
+    if (filled != nullptr)
+    {
+        record = *filled;
+    }
+    record.timestampUs = NowMicros();
+    record.threadId = static_cast<uint32_t>(GetCurrentThreadId());
+    record.kind = kind;
+    record.code = code;
+    record.textLength = static_cast<uint8_t>(std::min(textLength, textCapacity));
+    memcpy(record.text, text, record.textLength);
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+void AppendTimestamp(std::string& out, int64_t timestampUs)
+{
+    time_t seconds = static_cast<time_t>(timestampUs / 1000000);
+    tm utc = {};
+    gmtime_s(&utc, &seconds);
+    char buffer[48];
+    snprintf(
+        buffer,
+        sizeof(buffer),
+        "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ ",
+        utc.tm_year + 1900,
+        utc.tm_mon + 1,
+        utc.tm_mday,
+        utc.tm_hour,
+        utc.tm_min,
+        utc.tm_sec,
+        static_cast<int>((timestampUs / 1000) % 1000));
+    out += buffer;
+}
+
+void FormatRecord(const LogRecord& record, std::string& logText, std::string& accessText)
+{
+    std::string text(record.text, record.textLength);
+    char buffer[384];
+
+    if (record.kind == RecordKind::Access)
+    {
+        if (accessOutput == nullptr)
+        {
+            return;
+        }
+        in_addr address;
+        address.s_addr = htonl(record.clientIp);
+        char clientIp[INET_ADDRSTRLEN] = "-";
+        inet_ntop(AF_INET, &address, clientIp, sizeof(clientIp));
+
+        AppendTimestamp(accessText, record.timestampUs);
+        snprintf(
+            buffer,
+            sizeof(buffer),
+            "%s #%llu \"%s\" %d in=%llu out=%llu latency_us=%lld",
+            clientIp,
+            static_cast<unsigned long long>(record.connectionId),
+            text.c_str(),
+            record.code,
+            static_cast<unsigned long long>(record.bytesIn),
+            static_cast<unsigned long long>(record.bytesOut),
+            static_cast<long long>(record.latencyUs));
+        accessText += buffer;
+        if (record.clientSendLimit != nullptr)
+        {
+            snprintf(
+                buffer,
+                sizeof(buffer),
+                " client_rtt_us=%u client_cwnd=%u client_retx=%llu client_limit=%s "
+                "upstream_rtt_us=%u upstream_retx=%llu",
+                record.clientRttUs,
+                record.clientCwnd,
+                static_cast<unsigned long long>(record.clientRetransmitted),
+                record.clientSendLimit,
+                record.upstreamRttUs,
+                static_cast<unsigned long long>(record.upstreamRetransmitted));
+            accessText += buffer;
+        }
+        accessText += '\n';
+        return;
+    }
+
+    AppendTimestamp(logText, record.timestampUs);
+    if (record.kind == RecordKind::Error)
+    {
+        snprintf(
+            buffer,
+            sizeof(buffer),
+            "[%u] %s: %d\n",
+            record.threadId,
+            text.c_str(),
+            static_cast<int>(record.code));
+    }
+    else
+    {
+        snprintf(buffer, sizeof(buffer), "[%u] %s\n", record.threadId, text.c_str());
+    }
+    logText += buffer;
+}
+
+// Formats everything queued so far; returns false if there was nothing to write
+bool Drain()
+{
+    std::string logText;
+    std::string accessText;
+
+    rings.ForEach([&](LogRing& ring) {
+        uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+        uint32_t head = ring.head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail)
+        {
+            FormatRecord(ring.records[tail & (ringCapacity - 1)], logText, accessText);
+        }
+        ring.tail.store(tail, std::memory_order_release);
+
+        uint64_t dropped = ring.dropped.load(std::memory_order_relaxed);
+        if (dropped != ring.reportedDrops)
+        {
+            AppendTimestamp(logText, NowMicros());
+            logText += "Log ring full, dropped " + std::to_string(dropped - ring.reportedDrops) +
+                       " records\n";
+            ring.reportedDrops = dropped;
+        }
+    });
+
+    uint64_t ringless = ringlessDrops.load(std::memory_order_relaxed);
+    if (ringless != reportedRinglessDrops)
+    {
+        AppendTimestamp(logText, NowMicros());
+        logText += "No free log ring, dropped " + std::to_string(ringless - reportedRinglessDrops) +
+                   " records\n";
+        reportedRinglessDrops = ringless;
+    }
+
+    if (!logText.empty())
+    {
+        fwrite(logText.data(), 1, logText.size(), logOutput);
+        fflush(logOutput);
+    }
+    if (!accessText.empty())
+    {
+        fwrite(accessText.data(), 1, accessText.size(), accessOutput);
+        fflush(accessOutput);
+    }
+    return !logText.empty() || !accessText.empty();
+}
+
+void WriterLoop()
+{
+    while (running.load(std::memory_order_acquire))
+    {
+        if (!Drain())
+        {
+            std::this_thread::sleep_for(drainInterval);
+        }
+    }
+    Drain();
+}
+} // namespace
+
+void StartLogging(const std::string& logFile, const std::string& accessLogFile)
+{
+    if (!logFile.empty())
+    {
+        FILE* file = nullptr;
+        if (fopen_s(&file, logFile.c_str(), "a") == 0 && file != nullptr)
+        {
+            logOutput = file;
+        }
+        else
+        {
+            std::cerr << "Unable to open log file " << logFile << ", logging to stderr"
+                      << std::endl;
+        }
+    }
+    if (!accessLogFile.empty() && fopen_s(&accessOutput, accessLogFile.c_str(), "a") != 0)
+    {
+        std::cerr << "Unable to open access log " << accessLogFile << std::endl;
+        accessOutput = nullptr;
+    }
+
+    running.store(true, std::memory_order_release);
+    writerThread = std::thread(WriterLoop);
+}
+
+void StopLogging()
+{
+    if (!running.exchange(false))
+    {
+        return;
+    }
+    writerThread.join();
+    if (logOutput != stderr)
+    {
+        fclose(logOutput);
+    }
+    if (accessOutput != nullptr)
+    {
+        fclose(accessOutput);
+    }
+}
+
+void LogError(const char* message, int errorCode)
+{
+    if (!running.load(std::memory_order_acquire))
+    {
+        std::cerr << message << ": " << errorCode << std::endl;
+        return;
+    }
+    Push(RecordKind::Error, errorCode, message, strlen(message), nullptr);
+}
+
+void LogInfo(const std::string& message)
+{
+    if (!running.load(std::memory_order_acquire))
+    {
+        std::cout << message << std::endl;
+        return;
+    }
+    Push(RecordKind::Info, 0, message.data(), message.size(), nullptr);
+}
+
+void LogAccess(const AccessLogEntry& entry)
+{
+    if (!running.load(std::memory_order_acquire) || accessOutput == nullptr)
+    {
+        return;
+    }
+
+    LogRecord record;
+    record.connectionId = entry.connectionId;
+    record.clientIp = entry.clientIp;
+    record.bytesIn = entry.bytesIn;
+    record.bytesOut = entry.bytesOut;
+    record.latencyUs = entry.latency.count();
+    record.clientRetransmitted = entry.clientTcp.bytesRetransmitted;
+    record.upstreamRetransmitted = entry.upstreamTcp.bytesRetransmitted;
+    record.clientRttUs = entry.clientTcp.rttUs;
+    record.clientCwnd = entry.clientTcp.cwndBytes;
+    record.upstreamRttUs = entry.upstreamTcp.rttUs;
+    record.clientSendLimit = entry.clientTcp.valid || entry.upstreamTcp.valid
+                                 ? DominantSendLimit(entry.clientTcp)
+                                 : nullptr;
+    Push(RecordKind::Access, entry.status, entry.target.data(), entry.target.size(), &record);
+}
@@ -0,0 +1,46 @@
+﻿/*****************************************************************
+ * @file   AsyncLogger.h
+ * @brief  Non-blocking logging for client threads: records go into
+ * per-thread rings that a background thread formats and writes.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include "TcpInfo.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// One line of the access log, filled in while a request is handled
+struct AccessLogEntry
+{
+    uint64_t connectionId = 0;
+    uint32_t clientIp = 0; // Host byte order
+    int status = 0;        // 0 when no response was relayed at all
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    std::chrono::microseconds latency{0};
+    std::string target; // "METHOD host/path", truncated to fit a record
+
+    // Both sockets' TCP state as the request ended, when sampling is on
+    TcpSample clientTcp;
+    TcpSample upstreamTcp;
+};
+
+// Starts the writer thread. Empty file names write errors to stderr and disable the access log.
+void StartLogging(const std::string& logFile, const std::string& accessLogFile);
+
+// Writes everything still queued; called before the process exits
+void StopLogging();
+
+// Queues an error line with its Winsock error code. Never blocks; if this thread's ring is
+// full the record is dropped and counted. Before StartLogging it writes to stderr directly.
+void LogError(const char* message, int errorCode);
+
+void LogInfo(const std::string& message);
+
+void LogAccess(const AccessLogEntry& entry);
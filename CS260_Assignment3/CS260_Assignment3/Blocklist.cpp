@@ -0,0 +1,301 @@
+﻿/*****************************************************************
+ * @file   Blocklist.cpp
+ * @brief  Host, domain and URL blocklist compiled into hash sets and
+ * an Aho-Corasick automaton, swapped whole when its file changes.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "Blocklist.h"
+#include "AsyncLogger.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+namespace
+{
+const uint32_t root = 0;
+
+BlocklistSettings blocklistSettings;
+std::filesystem::file_time_type loadedWriteTime;
+std::shared_ptr<const Blocklist> currentBlocklist; // Only read and written atomically
+
+std::string ToLower(std::string value)
+{
+    std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) {
+        return static_cast<char>(tolower(c));
+    });
+    return value;
+}
+
+std::filesystem::file_time_type LastWriteTime(const std::string& fileName)
+{
+    std::error_code error;
+    return std::filesystem::last_write_time(fileName, error);
+}
+
+void ReloadLoop()
+{
+    while (true)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(blocklistSettings.reloadSeconds));
+        std::filesystem::file_time_type writtenAt = LastWriteTime(blocklistSettings.fileName);
+        if (writtenAt == loadedWriteTime)
+        {
+            continue;
+        }
+
+        // A list that fails to load leaves the previous one in force until the file is fixed
+        loadedWriteTime = writtenAt;
+        auto blocklist = std::make_shared<Blocklist>();
+        std::string error;
+        if (!blocklist->Load(blocklistSettings.fileName, error))
+        {
+            LogInfo("Blocklist reload failed, keeping the previous list: " + error);
+            continue;
+        }
+        LogInfo(
+            "Reloaded blocklist " + blocklistSettings.fileName + " with " +
+            std::to_string(blocklist->Size()) + " entries");
+        std::atomic_store(
+            &currentBlocklist, std::shared_ptr<const Blocklist>(std::move(blocklist)));
+    }
+}
+} // namespace
+
+bool Blocklist::Load(const std::string& fileName, std::string& error)
+{
+    std::ifstream file(fileName);
+    if (!file)
+    {
+        error = "Unable to open blocklist " + fileName;
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        ++lineNumber;
+        line = line.substr(0, line.find('#'));
+        std::istringstream iss(line);
+        std::string directive, pattern;
+        if (!(iss >> directive))
+        {
+            continue;
+        }
+
+        bool valid = static_cast<bool>(iss >> pattern);
+        if (valid && directive == "host")
+        {
+            AddHost(pattern);
+        }
+        else if (valid && directive == "domain")
+        {
+            AddDomain(pattern);
+        }
+        else if (valid && directive == "url")
+        {
+            AddUrl(pattern);
+        }
+        else
+        {
+            error = fileName + ":" + std::to_string(lineNumber) + ": invalid directive: " + line;
+            return false;
+        }
+    }
+
+    Compile();
+    return true;
+}
+
+void Blocklist::AddHost(const std::string& host)
+{
+    _hosts.insert(ToLower(host));
+}
+
+void Blocklist::AddDomain(const std::string& domain)
+{
+    _domains.insert(ToLower(domain));
+}
+
+void Blocklist::AddUrl(const std::string& pattern)
+{
+    _urls.push_back(ToLower(pattern));
+}
+
+void Blocklist::Compile()
+{
+    // Build the trie with each state's edges in a list of its own, then flatten the lists
+    std::vector<std::vector<std::pair<unsigned char, uint32_t>>> children(1);
+    _output.assign(1, -1);
+    for (size_t pattern = 0; pattern < _urls.size(); ++pattern)
+    {
+        uint32_t state = root;
+        for (char c : _urls[pattern])
+        {
+            auto& edges = children[state];
+            auto edge = std::find_if(edges.begin(), edges.end(), [c](const auto& entry) {
+                return entry.first == static_cast<unsigned char>(c);
+            });
+            if (edge != edges.end())
+            {
+                state = edge->second;
+                continue;
+            }
+            uint32_t child = static_cast<uint32_t>(children.size());
+            edges.emplace_back(static_cast<unsigned char>(c), child);
+            children.emplace_back();
+            _output.push_back(-1);
+            state = child;
+        }
+        if (_output[state] < 0)
+        {
+            _output[state] = static_cast<int32_t>(pattern);
+        }
+    }
+
+    size_t stateCount = children.size();
+    _firstEdge.assign(stateCount + 1, 0);
+    _edgeBytes.clear();
+    _edgeTargets.clear();
+    for (size_t state = 0; state < stateCount; ++state)
+    {
+        auto& edges = children[state];
+        std::sort(edges.begin(), edges.end());
+        _firstEdge[state] = static_cast<uint32_t>(_edgeBytes.size());
+        for (const auto& edge : edges)
+        {
+            _edgeBytes.push_back(edge.first);
+            _edgeTargets.push_back(edge.second);
+        }
+        std::vector<std::pair<unsigned char, uint32_t>>().swap(edges);
+    }
+    _firstEdge[stateCount] = static_cast<uint32_t>(_edgeBytes.size());
+
+    _rootNext.assign(256, root);
+    for (uint32_t edge = _firstEdge[root]; edge < _firstEdge[root + 1]; ++edge)
+    {
+        _rootNext[_edgeBytes[edge]] = _edgeTargets[edge];
+    }
+
+    // Failure links in breadth-first order, so each state's parent and the states its failure
+    // chain passes through are done before it. A state also reports any pattern that ends in
+    // the middle of it, found at the end of its failure chain.
+    _fail.assign(stateCount, root);
+    std::vector<uint32_t> queue;
+    queue.reserve(stateCount);
+    for (uint32_t edge = _firstEdge[root]; edge < _firstEdge[root + 1]; ++edge)
+    {
+        queue.push_back(_edgeTargets[edge]);
+    }
+    for (size_t next = 0; next < queue.size(); ++next)
+    {
+        uint32_t state = queue[next];
+        for (uint32_t edge = _firstEdge[state]; edge < _firstEdge[state + 1]; ++edge)
+        {
+            uint32_t child = _edgeTargets[edge];
+            _fail[child] = Next(_fail[state], _edgeBytes[edge]);
+            if (_output[child] < 0)
+            {
+                _output[child] = _output[_fail[child]];
+            }
+            queue.push_back(child);
+        }
+    }
+}
+
+uint32_t Blocklist::Next(uint32_t state, unsigned char c) const
+{
+    while (state != root)
+    {
+        auto first = _edgeBytes.begin() + _firstEdge[state];
+        auto last = _edgeBytes.begin() + _firstEdge[state + 1];
+        auto edge = std::lower_bound(first, last, c);
+        if (edge != last && *edge == c)
+        {
+            return _edgeTargets[edge - _edgeBytes.begin()];
+        }
+        state = _fail[state];
+    }
+    return _rootNext[c];
+}
+
+const std::string* Blocklist::Match(const std::string& host, const std::string& path) const
+{
+    std::string lowerHost = ToLower(host);
+    auto found = _hosts.find(lowerHost);
+    if (found != _hosts.end())
+    {
+        return &*found;
+    }
+
+    // The host itself, then each parent domain after a dot
+    for (size_t start = 0; start != std::string::npos;)
+    {
+        found = _domains.find(lowerHost.substr(start));
+        if (found != _domains.end())
+        {
+            return &*found;
+        }
+        start = lowerHost.find('.', start);
+        start = start == std::string::npos ? start : start + 1;
+    }
+
+    if (_urls.empty())
+    {
+        return nullptr;
+    }
+    uint32_t state = root;
+    const std::string* parts[] = {&lowerHost, &path};
+    for (const std::string* part : parts)
+    {
+        for (char c : *part)
+        {
+            state = Next(state, static_cast<unsigned char>(tolower(static_cast<unsigned char>(c))));
+            if (_output[state] >= 0)
+            {
+                return &_urls[_output[state]];
+            }
+        }
+    }
+    return nullptr;
+}
+
+bool LoadBlocklist(const BlocklistSettings& settings)
+{
+    blocklistSettings = settings;
+    loadedWriteTime = LastWriteTime(settings.fileName);
+    // Runs before logging starts, so a bad list is reported on the console
+    auto blocklist = std::make_shared<Blocklist>();
+    std::string error;
+    if (!blocklist->Load(settings.fileName, error))
+    {
+        std::cerr << error << std::endl;
+        return false;
+    }
+    std::atomic_store(&currentBlocklist, std::shared_ptr<const Blocklist>(std::move(blocklist)));
+    return true;
+}
+
+void StartBlocklistReloads()
+{
+    if (blocklistSettings.fileName.empty() || blocklistSettings.reloadSeconds <= 0)
+    {
+        return;
+    }
+    std::thread(ReloadLoop).detach();
+}
+
+std::shared_ptr<const Blocklist> GetBlocklist()
+{
+    return std::atomic_load(&currentBlocklist);
+}
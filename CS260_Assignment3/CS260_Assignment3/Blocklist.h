@@ -0,0 +1,77 @@
+﻿/*****************************************************************
+ * @file   Blocklist.h
+ * @brief  Host, domain and URL blocklist compiled into hash sets and
+ * an Aho-Corasick automaton, swapped whole when its file changes.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+struct BlocklistSettings
+{
+    std::string fileName; // Disabled when empty
+    int reloadSeconds = 5; // How often the file is checked for changes; 0 loads it only once
+};
+
+// One directive per line, '#' starting a comment:
+//   host <name>      the host exactly
+//   domain <name>    the host and every subdomain of it
+//   url <text>       any request whose host and path (e.g. "example.com/ads/") contain text
+// Matching ignores case throughout.
+class Blocklist
+{
+public:
+    // False, with the reason in error, if the file can't be read or has an invalid directive
+    bool Load(const std::string& fileName, std::string& error);
+
+    void AddHost(const std::string& host);
+    void AddDomain(const std::string& domain);
+    void AddUrl(const std::string& pattern);
+
+    // Builds the automaton; call once after the last Add and before matching
+    void Compile();
+
+    // The pattern blocking the request in one pass over host and path, or nullptr
+    const std::string* Match(const std::string& host, const std::string& path) const;
+
+    size_t Size() const
+    {
+        return _hosts.size() + _domains.size() + _urls.size();
+    }
+
+private:
+    uint32_t Next(uint32_t state, unsigned char c) const;
+
+    std::unordered_set<std::string> _hosts;
+    std::unordered_set<std::string> _domains;
+    std::vector<std::string> _urls;
+
+    // The automaton's transitions are stored sorted by byte per state, with a state's edges
+    // running from _firstEdge[state] to _firstEdge[state + 1]; the root's are also kept as a
+    // full table, since every mismatch falls back to it
+    std::vector<uint32_t> _firstEdge;
+    std::vector<unsigned char> _edgeBytes;
+    std::vector<uint32_t> _edgeTargets;
+    std::vector<uint32_t> _rootNext;
+    std::vector<uint32_t> _fail;
+    std::vector<int32_t> _output; // URL pattern ending at the state or a suffix of it; -1 if none
+};
+
+// Loads the list named in the settings; false if it can't be read
+bool LoadBlocklist(const BlocklistSettings& settings);
+
+// Watches the file and swaps in a new list after each change that loads cleanly
+void StartBlocklistReloads();
+
+// The current list, or null when blocking is disabled; requests keep the one they started with
+std::shared_ptr<const Blocklist> GetBlocklist();
@@ -0,0 +1,267 @@
+﻿/*****************************************************************
+ * @file   Capture.cpp
+ * @brief  Records each connection's request, arrival time and the
+ * origin's response into an append-only file for later replay.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "Capture.h"
+#include "AsyncLogger.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace
+{
+const char captureMagic[8] = {'P', 'X', 'C', 'A', 'P', '0', '0', '1'};
+const size_t maxPendingBytes = 64 * 1024 * 1024; // Beyond this records are dropped, not queued
+const std::chrono::milliseconds flushInterval(20);
+
+enum class CaptureKind : uint8_t
+{
+    Request = 1,
+    ResponseChunk = 2,
+    Close = 3,
+};
+
+// Client threads append encoded records here; the writer thread swaps the buffer out and
+// writes it, so the lock is only held for a memcpy
+std::mutex pendingLock;
+std::vector<char> pending;
+uint64_t droppedRecords = 0; // Guarded by pendingLock
+
+std::atomic<bool> capturing{false};
+std::thread writerThread;
+FILE* captureFile = nullptr;
+std::chrono::steady_clock::time_point captureStart;
+
+void AppendVarint(std::vector<char>& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+bool ReadVarint(const std::string& in, size_t& at, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && at < in.size(); shift += 7)
+    {
+        uint8_t byte = static_cast<uint8_t>(in[at++]);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void AppendRecord(
+    CaptureKind kind,
+    uint64_t connectionId,
+    std::chrono::steady_clock::time_point time,
+    const char* data,
+    size_t length)
+{
+    if (!capturing.load(std::memory_order_acquire))
+    {
+        return;
+    }
+
+    uint64_t offsetUs = static_cast<uint64_t>(std::max<long long>(
+        std::chrono::duration_cast<std::chrono::microseconds>(time - captureStart).count(), 0));
+
+    std::lock_guard<std::mutex> lock(pendingLock);
+    if (pending.size() + length > maxPendingBytes)
+    {
+        ++droppedRecords;
+        return;
+    }
+    pending.push_back(static_cast<char>(kind));
+    AppendVarint(pending, connectionId);
+    AppendVarint(pending, offsetUs);
+    AppendVarint(pending, length);
+    pending.insert(pending.end(), data, data + length);
+}
+
+void FlushPending()
+{
+    std::vector<char> batch;
+    uint64_t dropped = 0;
+    {
+        std::lock_guard<std::mutex> lock(pendingLock);
+        batch.swap(pending);
+        std::swap(dropped, droppedRecords);
+    }
+
+    if (!batch.empty())
+    {
+        fwrite(batch.data(), 1, batch.size(), captureFile);
+        fflush(captureFile);
+    }
+    if (dropped != 0)
+    {
+        LogInfo("Capture backlog full, dropped " + std::to_string(dropped) + " records");
+    }
+}
+
+void WriterLoop()
+{
+    while (capturing.load(std::memory_order_acquire))
+    {
+        std::this_thread::sleep_for(flushInterval);
+        FlushPending();
+    }
+    FlushPending();
+}
+} // namespace
+
+bool StartCapture(const std::string& path)
+{
+    if (fopen_s(&captureFile, path.c_str(), "wb") != 0 || captureFile == nullptr)
+    {
+        std::cerr << "Unable to open capture file " << path << std::endl;
+        return false;
+    }
+
+    captureStart = std::chrono::steady_clock::now();
+    uint64_t startUs = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count());
+    unsigned char header[16];
+    memcpy(header, captureMagic, sizeof(captureMagic));
+    for (int i = 0; i < 8; ++i)
+    {
+        header[8 + i] = static_cast<unsigned char>(startUs >> (8 * i));
+    }
+    fwrite(header, 1, sizeof(header), captureFile);
+
+    capturing.store(true, std::memory_order_release);
+    writerThread = std::thread(WriterLoop);
+    return true;
+}
+
+void StopCapture()
+{
+    if (!capturing.exchange(false))
+    {
+        return;
+    }
+    writerThread.join();
+    fclose(captureFile);
+    captureFile = nullptr;
+}
+
+bool IsCapturing()
+{
+    return capturing.load(std::memory_order_relaxed);
+}
+
+void CaptureRequest(
+    uint64_t connectionId,
+    std::chrono::steady_clock::time_point acceptedAt,
+    const std::string& request)
+{
+    AppendRecord(CaptureKind::Request, connectionId, acceptedAt, request.data(), request.size());
+}
+
+void CaptureResponse(uint64_t connectionId, const char* data, size_t length)
+{
+    AppendRecord(
+        CaptureKind::ResponseChunk,
+        connectionId,
+        std::chrono::steady_clock::now(),
+        data,
+        length);
+}
+
+void CaptureClose(uint64_t connectionId)
+{
+    AppendRecord(CaptureKind::Close, connectionId, std::chrono::steady_clock::now(), nullptr, 0);
+}
+
+bool ReadCapture(const std::string& path, std::vector<CapturedConnection>& connections)
+{
+    FILE* file = nullptr;
+    if (fopen_s(&file, path.c_str(), "rb") != 0 || file == nullptr)
+    {
+        std::cerr << "Unable to open capture file " << path << std::endl;
+        return false;
+    }
+    std::string contents;
+    char buffer[65536];
+    size_t bytesRead = 0;
+    while ((bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        contents.append(buffer, bytesRead);
+    }
+    fclose(file);
+
+    if (contents.size() < 16 || memcmp(contents.data(), captureMagic, sizeof(captureMagic)) != 0)
+    {
+        std::cerr << path << " is not a capture file" << std::endl;
+        return false;
+    }
+
+    std::map<uint64_t, CapturedConnection> byId;
+    size_t at = 16;
+    while (at < contents.size())
+    {
+        CaptureKind kind = static_cast<CaptureKind>(contents[at++]);
+        uint64_t connectionId = 0;
+        uint64_t offsetUs = 0;
+        uint64_t length = 0;
+        if (!ReadVarint(contents, at, connectionId) || !ReadVarint(contents, at, offsetUs) ||
+            !ReadVarint(contents, at, length) || length > contents.size() - at)
+        {
+            break; // The proxy stopped mid-record
+        }
+
+        CapturedConnection& connection = byId[connectionId];
+        connection.id = connectionId;
+        if (kind == CaptureKind::Request)
+        {
+            connection.arrivalUs = offsetUs;
+            connection.request.assign(contents, at, length);
+        }
+        else if (kind == CaptureKind::ResponseChunk)
+        {
+            connection.response.append(contents, at, length);
+        }
+        else if (kind == CaptureKind::Close)
+        {
+            connection.closeUs = offsetUs;
+        }
+        at += length;
+    }
+
+    connections.clear();
+    for (auto& entry : byId)
+    {
+        if (!entry.second.request.empty())
+        {
+            connections.push_back(std::move(entry.second));
+        }
+    }
+    std::stable_sort(
+        connections.begin(),
+        connections.end(),
+        [](const CapturedConnection& a, const CapturedConnection& b) {
+            return a.arrivalUs < b.arrivalUs;
+        });
+    return true;
+}
@@ -0,0 +1,52 @@
+﻿/*****************************************************************
+ * @file   Capture.h
+ * @brief  Records each connection's request, arrival time and the
+ * origin's response into an append-only file for later replay.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *
+ * File format: the 8-byte magic "PXCAP001", the capture's start as
+ * 8 little-endian bytes of Unix microseconds, then records of
+ *   kind (1 byte) | connection ID | microseconds since start | length
+ * with the last three as unsigned LEB128 varints, followed by length
+ * bytes of data. Kinds: 1 request, 2 response chunk, 3 close.
+ *****************************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Everything a capture holds about one connection, as read back for replay
+struct CapturedConnection
+{
+    uint64_t id = 0;
+    uint64_t arrivalUs = 0; // Accept time, relative to the start of the capture
+    uint64_t closeUs = 0;   // Zero if the capture ended first
+    std::string request;
+    std::string response;
+};
+
+// Creates the capture file and starts its writer thread
+bool StartCapture(const std::string& path);
+
+// Flushes what is queued and closes the file
+void StopCapture();
+
+bool IsCapturing();
+
+void CaptureRequest(
+    uint64_t connectionId,
+    std::chrono::steady_clock::time_point acceptedAt,
+    const std::string& request);
+
+void CaptureResponse(uint64_t connectionId, const char* data, size_t length);
+
+void CaptureClose(uint64_t connectionId);
+
+// Reads every connection in a capture, ordered by arrival; stops quietly at a truncated tail
+bool ReadCapture(const std::string& path, std::vector<CapturedConnection>& connections);
@@ -0,0 +1,216 @@
+﻿/*****************************************************************
+ * @file   Compression.cpp
+ * @brief  LZ4-format block compression for holding cached bodies
+ * compressed in memory.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "Compression.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+const size_t minMatch = 4;
+const size_t lastLiterals = 5; // A block ends with at least this many literals
+const size_t matchLimit = 12;  // No match starts closer than this to the end of the block
+const size_t maxBlockBytes = 65536; // Offsets are 16 bits
+const int hashBits = 12;
+
+uint32_t Read32(const char* at)
+{
+    uint32_t value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+size_t HashSequence(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - hashBits);
+}
+
+// A length past the 15 the token holds goes in bytes of 255, ended by one below 255
+void AppendLength(std::string& packed, size_t length)
+{
+    while (length >= 255)
+    {
+        packed += static_cast<char>(255);
+        length -= 255;
+    }
+    packed += static_cast<char>(length);
+}
+
+bool ReadLength(const unsigned char*& in, const unsigned char* end, size_t& length)
+{
+    unsigned char byte = 0;
+    do
+    {
+        if (in == end)
+        {
+            return false;
+        }
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// Literals followed by a back-reference of matchLength bytes at offset behind; the last
+// sequence has a matchLength of 0 and ends at its literals
+void AppendSequence(
+    std::string& packed,
+    const char* literals,
+    size_t literalCount,
+    size_t offset,
+    size_t matchLength)
+{
+    size_t matchCode = matchLength > 0 ? matchLength - minMatch : 0;
+    packed += static_cast<char>(
+        (std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15));
+    if (literalCount >= 15)
+    {
+        AppendLength(packed, literalCount - 15);
+    }
+    packed.append(literals, literalCount);
+    if (matchLength == 0)
+    {
+        return;
+    }
+    packed += static_cast<char>(offset & 0xff);
+    packed += static_cast<char>(offset >> 8);
+    if (matchCode >= 15)
+    {
+        AppendLength(packed, matchCode - 15);
+    }
+}
+} // namespace
+
+bool CompressBlock(const char* data, size_t size, std::string& packed)
+{
+    packed.clear();
+    if (size <= matchLimit || size > maxBlockBytes)
+    {
+        return false;
+    }
+    size_t budget = size - size / 8;
+    packed.reserve(budget);
+
+    // Last position each hashed 4-byte sequence was seen at; a stale or colliding slot is
+    // caught by comparing the bytes
+    uint16_t positions[1 << hashBits] = {};
+    size_t anchor = 0; // First byte not yet emitted
+    size_t at = 1;
+    size_t misses = 0;
+    while (at + matchLimit <= size)
+    {
+        uint32_t sequence = Read32(data + at);
+        size_t slot = HashSequence(sequence);
+        size_t candidate = positions[slot];
+        positions[slot] = static_cast<uint16_t>(at);
+        if (Read32(data + candidate) != sequence)
+        {
+            // Step further the longer nothing matches, so incompressible data is given up on
+            // quickly
+            at += 1 + (misses++ >> 6);
+            continue;
+        }
+        misses = 0;
+
+        // Extend the match forward, short of the final literals, and back over pending literals
+        size_t length = minMatch;
+        while (at + length < size - lastLiterals && data[candidate + length] == data[at + length])
+        {
+            ++length;
+        }
+        while (at > anchor && candidate > 0 && data[at - 1] == data[candidate - 1])
+        {
+            --at;
+            --candidate;
+            ++length;
+        }
+
+        AppendSequence(packed, data + anchor, at - anchor, at - candidate, length);
+        at += length;
+        anchor = at;
+        if (packed.size() >= budget)
+        {
+            packed.clear();
+            return false;
+        }
+    }
+
+    AppendSequence(packed, data + anchor, size - anchor, 0, 0);
+    if (packed.size() >= budget)
+    {
+        packed.clear();
+        return false;
+    }
+    packed.shrink_to_fit();
+    return true;
+}
+
+bool DecompressBlock(const std::string& packed, char* out, size_t size)
+{
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(packed.data());
+    const unsigned char* end = in + packed.size();
+    size_t written = 0;
+    while (in < end)
+    {
+        unsigned char token = *in++;
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 && !ReadLength(in, end, literalCount))
+        {
+            return false;
+        }
+        if (literalCount > static_cast<size_t>(end - in) || literalCount > size - written)
+        {
+            return false;
+        }
+        memcpy(out + written, in, literalCount);
+        in += literalCount;
+        written += literalCount;
+        if (in == end)
+        {
+            break;
+        }
+
+        if (end - in < 2)
+        {
+            return false;
+        }
+        size_t offset = in[0] | (static_cast<size_t>(in[1]) << 8);
+        in += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(in, end, matchLength))
+        {
+            return false;
+        }
+        matchLength += minMatch;
+        if (offset == 0 || offset > written || matchLength > size - written)
+        {
+            return false;
+        }
+
+        // A match closer than its own length repeats the bytes it is producing, so those are
+        // copied one at a time
+        char* to = out + written;
+        const char* from = to - offset;
+        if (offset >= matchLength)
+        {
+            memcpy(to, from, matchLength);
+        }
+        else
+        {
+            for (size_t i = 0; i < matchLength; ++i)
+            {
+                to[i] = from[i];
+            }
+        }
+        written += matchLength;
+    }
+    return written == size;
+}
@@ -0,0 +1,23 @@
+﻿/*****************************************************************
+ * @file   Compression.h
+ * @brief  LZ4-format block compression for holding cached bodies
+ * compressed in memory.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Compresses a block of up to 64 KB into packed, as an LZ4 block (sequences of literals and
+// back-references, no frame). False, leaving packed empty, when the result wouldn't be at
+// least an eighth smaller, which is not worth the cost of expanding it on every use.
+bool CompressBlock(const char* data, size_t size, std::string& packed);
+
+// Expands a block from CompressBlock into exactly size bytes at out. False if the block is
+// malformed or doesn't expand to exactly that size.
+bool DecompressBlock(const std::string& packed, char* out, size_t size);
@@ -0,0 +1,297 @@
+﻿/*****************************************************************
+ * @file   ConcurrencyLimiter.cpp
+ * @brief  Adaptive limits on requests in flight, per upstream and
+ * overall, that shrink as upstream latency rises.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "ConcurrencyLimiter.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+ConcurrencyLimiter concurrencyLimiter;
+
+namespace
+{
+const size_t maxUpstreams = 4096; // Upstreams beyond this share only the global limit
+
+// Weights of each latency sample in the fast and slow averages
+const double recentWeight = 0.1;
+const double baselineWeight = 0.01;
+
+// Recent latency may reach this multiple of the baseline before the limit shrinks
+const double latencyTolerance = 1.5;
+
+// The most one sample can shrink the limit, and how much of each new estimate is taken
+const double minGradient = 0.5;
+const double smoothing = 0.2;
+
+const double dropBackoff = 0.9;
+} // namespace
+
+struct ConcurrencyPermit::Limit
+{
+    std::mutex lock;
+    std::condition_variable room;
+    int inFlight = 0;
+    double limit = 0;
+    double recentUs = 0;   // Fast average of latency; 0 until the first sample
+    double baselineUs = 0; // Slow average, standing in for the unloaded latency
+};
+
+ConcurrencyPermit::ConcurrencyPermit(ConcurrencyPermit&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+ConcurrencyPermit& ConcurrencyPermit::operator=(ConcurrencyPermit&& other) noexcept
+{
+    if (this != &other)
+    {
+        Release();
+        _limiter = other._limiter;
+        _upstream = other._upstream;
+        _global = other._global;
+        _granted = other._granted;
+        _sampled = other._sampled;
+        _dropped = other._dropped;
+        _latencyUs = other._latencyUs;
+        _started = other._started;
+        _paused = other._paused;
+        _pausedAt = other._pausedAt;
+        other._limiter = nullptr;
+        other._granted = false;
+    }
+    return *this;
+}
+
+ConcurrencyPermit::~ConcurrencyPermit()
+{
+    Release();
+}
+
+void ConcurrencyPermit::PauseTiming()
+{
+    _pausedAt = std::chrono::steady_clock::now();
+}
+
+void ConcurrencyPermit::ResumeTiming()
+{
+    _paused += std::chrono::steady_clock::now() - _pausedAt;
+}
+
+void ConcurrencyPermit::Complete()
+{
+    if (_sampled || _dropped)
+    {
+        return;
+    }
+    _sampled = true;
+    _latencyUs = std::chrono::duration<double, std::micro>(
+                     std::chrono::steady_clock::now() - _started - _paused)
+                     .count();
+}
+
+void ConcurrencyPermit::Drop()
+{
+    if (!_sampled)
+    {
+        _dropped = true;
+    }
+}
+
+void ConcurrencyPermit::Release()
+{
+    if (_limiter == nullptr)
+    {
+        return;
+    }
+    if (_upstream != nullptr)
+    {
+        _limiter->Leave(*_upstream, _latencyUs, _sampled, _dropped);
+    }
+    _limiter->Leave(*_global, _latencyUs, _sampled, _dropped);
+    _limiter = nullptr;
+}
+
+ConcurrencyLimiter::ConcurrencyLimiter() : _global(std::make_unique<Limit>())
+{
+}
+
+ConcurrencyLimiter::~ConcurrencyLimiter() = default;
+
+void ConcurrencyLimiter::Configure(const ConcurrencySettings& settings)
+{
+    _settings = settings;
+    _settings.maxLimit = std::max(_settings.maxLimit, 1);
+    _settings.initialLimit = std::clamp(_settings.initialLimit, 1, _settings.maxLimit);
+    _global->limit = _settings.initialLimit;
+}
+
+ConcurrencyPermit ConcurrencyLimiter::Acquire(const std::string& upstream)
+{
+    ConcurrencyPermit permit;
+    if (!IsEnabled())
+    {
+        permit._granted = true;
+        return permit;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(_settings.queueTimeoutMs);
+    Limit* limit = FindUpstream(upstream);
+    if (limit != nullptr && !Enter(*limit, deadline))
+    {
+        return permit;
+    }
+    if (!Enter(*_global, deadline))
+    {
+        if (limit != nullptr)
+        {
+            Leave(*limit, 0, false, false);
+        }
+        return permit;
+    }
+
+    permit._limiter = this;
+    permit._upstream = limit;
+    permit._global = _global.get();
+    permit._granted = true;
+    permit._started = std::chrono::steady_clock::now();
+    return permit;
+}
+
+ConcurrencyLimiter::Limit* ConcurrencyLimiter::FindUpstream(const std::string& upstream)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    auto found = _upstreams.find(upstream);
+    if (found != _upstreams.end())
+    {
+        return found->second.get();
+    }
+    if (_upstreams.size() >= maxUpstreams)
+    {
+        return nullptr;
+    }
+
+    // Limits are never erased, so permits can keep pointing at them without holding _lock
+    auto limit = std::make_unique<Limit>();
+    limit->limit = _settings.initialLimit;
+    return _upstreams.emplace(upstream, std::move(limit)).first->second.get();
+}
+
+bool ConcurrencyLimiter::Enter(Limit& limit, std::chrono::steady_clock::time_point deadline)
+{
+    std::unique_lock<std::mutex> guard(limit.lock);
+    if (!limit.room.wait_until(guard, deadline, [&] {
+            return limit.inFlight < static_cast<int>(limit.limit);
+        }))
+    {
+        return false;
+    }
+    ++limit.inFlight;
+    return true;
+}
+
+void ConcurrencyLimiter::Leave(Limit& limit, double latencyUs, bool sampled, bool dropped)
+{
+    {
+        std::lock_guard<std::mutex> guard(limit.lock);
+        int inFlight = limit.inFlight--;
+        if (dropped)
+        {
+            limit.limit = std::max(1.0, limit.limit * dropBackoff);
+        }
+        else if (sampled)
+        {
+            if (limit.recentUs == 0)
+            {
+                limit.recentUs = latencyUs;
+                limit.baselineUs = latencyUs;
+            }
+            else
+            {
+                limit.recentUs += recentWeight * (latencyUs - limit.recentUs);
+                limit.baselineUs += baselineWeight * (latencyUs - limit.baselineUs);
+            }
+
+            // Only grow while the limit is actually being used, so a quiet upstream doesn't
+            // build up a limit it has never been shown to handle
+            double gradient = std::clamp(
+                latencyTolerance * limit.baselineUs / std::max(limit.recentUs, 1.0),
+                minGradient,
+                1.0);
+            double estimate = limit.limit * gradient;
+            if (inFlight * 2 >= limit.limit)
+            {
+                estimate += std::sqrt(limit.limit);
+            }
+            limit.limit = std::clamp(
+                (1 - smoothing) * limit.limit + smoothing * estimate,
+                1.0,
+                static_cast<double>(_settings.maxLimit));
+        }
+    }
+    limit.room.notify_all();
+}
+
+std::string ConcurrencyLimiter::Render()
+{
+    struct Row
+    {
+        std::string upstream;
+        int inFlight;
+        double limit;
+        double recentUs;
+        double baselineUs;
+    };
+
+    std::vector<Row> rows;
+    auto read = [&](const std::string& upstream, Limit& limit) {
+        std::lock_guard<std::mutex> guard(limit.lock);
+        rows.push_back({upstream, limit.inFlight, limit.limit, limit.recentUs, limit.baselineUs});
+    };
+    read("", *_global);
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        for (auto& entry : _upstreams)
+        {
+            read(entry.first, *entry.second);
+        }
+    }
+
+    // The global limit is the row without an upstream label
+    const char* const names[] = {
+        "proxy_concurrency_limit",
+        "proxy_concurrency_in_flight",
+        "proxy_upstream_latency_recent_seconds",
+        "proxy_upstream_latency_baseline_seconds"};
+    std::string out;
+    for (size_t metric = 0; metric < 4; ++metric)
+    {
+        out += std::string("# TYPE ") + names[metric] + " gauge\n";
+        for (const Row& row : rows)
+        {
+            double values[] = {
+                std::floor(row.limit),
+                static_cast<double>(row.inFlight),
+                row.recentUs / 1e6,
+                row.baselineUs / 1e6};
+            char value[32];
+            snprintf(value, sizeof(value), " %g\n", values[metric]);
+            out += names[metric];
+            if (!row.upstream.empty())
+            {
+                out += "{upstream=\"" + EscapeLabel(row.upstream) + "\"}";
+            }
+            out += value;
+        }
+    }
+    return out;
+}
@@ -0,0 +1,116 @@
+﻿/*****************************************************************
+ * @file   ConcurrencyLimiter.h
+ * @brief  Adaptive limits on requests in flight, per upstream and
+ * overall, that shrink as upstream latency rises.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct ConcurrencySettings
+{
+    bool enabled = false;
+    int initialLimit = 20; // Starting limit for the proxy and for each upstream
+    int maxLimit = 1000;
+    int queueTimeoutMs = 100; // How long a request over the limit waits for room; 0 rejects
+};
+
+class ConcurrencyLimiter;
+
+// One request's place under its upstream's limit and the global one, held until it goes out of
+// scope, so a long response keeps counting. Latency is timed from acquisition, less any paused
+// stretch, until Complete, and feeds the limits when the place is given back.
+class ConcurrencyPermit
+{
+public:
+    ConcurrencyPermit() = default;
+    ConcurrencyPermit(ConcurrencyPermit&& other) noexcept;
+    ConcurrencyPermit& operator=(ConcurrencyPermit&& other) noexcept;
+    ~ConcurrencyPermit();
+
+    ConcurrencyPermit(const ConcurrencyPermit&) = delete;
+    ConcurrencyPermit& operator=(const ConcurrencyPermit&) = delete;
+
+    // False when the request was turned away
+    explicit operator bool() const
+    {
+        return _granted;
+    }
+
+    // Stops the clock while the proxy waits on the client rather than the upstream
+    void PauseTiming();
+    void ResumeTiming();
+
+    // The upstream answered; only the first call counts
+    void Complete();
+
+    // The upstream failed or said it is overloaded, and both limits back off instead
+    void Drop();
+
+private:
+    friend class ConcurrencyLimiter;
+    struct Limit;
+
+    void Release();
+
+    ConcurrencyLimiter* _limiter = nullptr; // Null when not holding a place
+    Limit* _upstream = nullptr;
+    Limit* _global = nullptr;
+    bool _granted = false;
+    bool _sampled = false;
+    bool _dropped = false;
+    double _latencyUs = 0;
+    std::chrono::steady_clock::time_point _started;
+    std::chrono::steady_clock::duration _paused{0};
+    std::chrono::steady_clock::time_point _pausedAt;
+};
+
+// Gradient limits: each tracks a fast and a slow average of upstream latency, and the limit
+// shrinks by their ratio once recent latency rises above the long-run level, then grows back
+// by about its square root per sample while latency holds. Failures cut it by a tenth.
+class ConcurrencyLimiter
+{
+public:
+    ConcurrencyLimiter();
+    ~ConcurrencyLimiter();
+
+    void Configure(const ConcurrencySettings& settings);
+
+    bool IsEnabled() const
+    {
+        return _settings.enabled;
+    }
+
+    // Waits up to the queue timeout for room under both limits. Always granted while limiting
+    // is disabled.
+    ConcurrencyPermit Acquire(const std::string& upstream);
+
+    // Every limit, in-flight count and latency average as Prometheus gauges
+    std::string Render();
+
+private:
+    friend class ConcurrencyPermit;
+    using Limit = ConcurrencyPermit::Limit;
+
+    Limit* FindUpstream(const std::string& upstream);
+    bool Enter(Limit& limit, std::chrono::steady_clock::time_point deadline);
+    void Leave(Limit& limit, double latencyUs, bool sampled, bool dropped);
+
+    ConcurrencySettings _settings;
+    std::mutex _lock; // Guards _upstreams; each limit has its own lock
+    std::unordered_map<std::string, std::unique_ptr<Limit>> _upstreams;
+    std::unique_ptr<Limit> _global;
+};
+
+// Configured by main before any client thread starts
+extern ConcurrencyLimiter concurrencyLimiter;
@@ -0,0 +1,485 @@
+﻿/*****************************************************************
+ * @file   Handover.cpp
+ * @brief  Restarts without dropping connections: a new process takes
+ * the running one's listening sockets and cache, and the old one
+ * drains its connections and exits.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "Handover.h"
+#include "AsyncLogger.h"
+#include "NetworkUtils.h"
+#include "ResponseCache.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+const size_t roleCount = static_cast<size_t>(HandoverRole::Count);
+const uint32_t maxEntryRecord = 256 * 1024 * 1024; // Guards against a corrupt length
+const char takenOver = 1;
+
+HandoverSettings handoverSettings;
+
+// Offered sockets are filled in before the handover listener starts, inherited ones before
+// any other thread does
+SOCKET offered[roleCount] = {INVALID_SOCKET, INVALID_SOCKET, INVALID_SOCKET};
+SOCKET inherited[roleCount] = {INVALID_SOCKET, INVALID_SOCKET, INVALID_SOCKET};
+
+std::atomic<bool> handedOver{false};
+std::atomic<bool> cacheSent{false};
+
+bool SendAll(SOCKET socket, const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        int sent = send(socket, data, static_cast<int>(std::min<size_t>(size, 65536)), 0);
+        if (sent == SOCKET_ERROR)
+        {
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+bool ReceiveAll(SOCKET socket, char* data, size_t size)
+{
+    while (size > 0)
+    {
+        int received = recv(socket, data, static_cast<int>(std::min<size_t>(size, 65536)), 0);
+        if (received <= 0)
+        {
+            return false;
+        }
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+bool SendLength(SOCKET socket, uint32_t value)
+{
+    uint32_t network = htonl(value);
+    return SendAll(socket, reinterpret_cast<const char*>(&network), sizeof(network));
+}
+
+bool ReceiveLength(SOCKET socket, uint32_t& value)
+{
+    uint32_t network = 0;
+    if (!ReceiveAll(socket, reinterpret_cast<char*>(&network), sizeof(network)))
+    {
+        return false;
+    }
+    value = ntohl(network);
+    return true;
+}
+
+void AppendVarint(std::string& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+bool ReadVarint(const std::string& in, size_t& at, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && at < in.size(); shift += 7)
+    {
+        uint8_t byte = static_cast<uint8_t>(in[at++]);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void AppendField(std::string& out, const std::string& field)
+{
+    AppendVarint(out, field.size());
+    out += field;
+}
+
+bool ReadField(const std::string& in, size_t& at, std::string& field)
+{
+    uint64_t size = 0;
+    if (!ReadVarint(in, at, size) || size > in.size() - at)
+    {
+        return false;
+    }
+    field.assign(in, at, static_cast<size_t>(size));
+    at += static_cast<size_t>(size);
+    return true;
+}
+
+// Key, head, body length, validators, age in ms, the origin's age and lifetimes in seconds,
+// then the chunks
+// (hash, size, whether packed, bytes as held) and the segments (first byte, bytes). Chunks
+// go as held, so compressed ones stay compressed on the way.
+std::string EncodeEntry(
+    const std::string& key,
+    const CachedResponse& entry,
+    std::chrono::steady_clock::time_point now)
+{
+    std::string out;
+    AppendField(out, key);
+    AppendField(out, entry.head);
+    AppendVarint(out, entry.length);
+    AppendField(out, entry.etag);
+    AppendField(out, entry.lastModified);
+    AppendVarint(
+        out,
+        static_cast<uint64_t>(std::max<long long>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(now - entry.storedAt).count(),
+            0)));
+    AppendVarint(out, static_cast<uint64_t>(entry.originAge.count()));
+    AppendVarint(out, static_cast<uint64_t>(entry.freshFor.count()));
+    AppendVarint(out, static_cast<uint64_t>(entry.staleWhileRevalidate.count()));
+    AppendVarint(out, static_cast<uint64_t>(entry.staleIfError.count()));
+    AppendVarint(out, entry.chunks.size());
+    for (const BodyChunk& chunk : entry.chunks)
+    {
+        AppendVarint(out, chunk.hash);
+        AppendVarint(out, chunk.size);
+        AppendVarint(out, chunk.packed ? 1 : 0);
+        AppendField(out, *chunk.bytes);
+    }
+    AppendVarint(out, entry.segments.size());
+    for (const auto& segment : entry.segments)
+    {
+        AppendVarint(out, segment.first);
+        AppendField(out, *segment.second);
+    }
+    return out;
+}
+
+// Rebuilds an entry from EncodeEntry, aged as it was in the predecessor; nullptr if malformed
+std::shared_ptr<CachedResponse> DecodeEntry(
+    const std::string& in,
+    std::string& key,
+    std::chrono::steady_clock::time_point now)
+{
+    auto entry = std::make_shared<CachedResponse>();
+    size_t at = 0;
+    uint64_t ageMs = 0;
+    uint64_t originAge = 0;
+    uint64_t freshFor = 0;
+    uint64_t staleWhileRevalidate = 0;
+    uint64_t staleIfError = 0;
+    uint64_t chunkCount = 0;
+    if (!ReadField(in, at, key) || !ReadField(in, at, entry->head) ||
+        !ReadVarint(in, at, entry->length) || !ReadField(in, at, entry->etag) ||
+        !ReadField(in, at, entry->lastModified) || !ReadVarint(in, at, ageMs) ||
+        !ReadVarint(in, at, originAge) || !ReadVarint(in, at, freshFor) ||
+        !ReadVarint(in, at, staleWhileRevalidate) || !ReadVarint(in, at, staleIfError) ||
+        !ReadVarint(in, at, chunkCount) || chunkCount > in.size())
+    {
+        return nullptr;
+    }
+    entry->storedAt = now - std::chrono::milliseconds(ageMs);
+    entry->originAge = std::chrono::seconds(originAge);
+    entry->freshFor = std::chrono::seconds(freshFor);
+    entry->staleWhileRevalidate = std::chrono::seconds(staleWhileRevalidate);
+    entry->staleIfError = std::chrono::seconds(staleIfError);
+
+    // Every chunk but the last is full, and together they hold the whole body
+    uint64_t bodyBytes = 0;
+    for (uint64_t i = 0; i < chunkCount; ++i)
+    {
+        BodyChunk chunk;
+        uint64_t size = 0;
+        uint64_t packed = 0;
+        std::string bytes;
+        if (!ReadVarint(in, at, chunk.hash) || !ReadVarint(in, at, size) ||
+            !ReadVarint(in, at, packed) || !ReadField(in, at, bytes) || size > bodyChunkBytes ||
+            (i + 1 < chunkCount && size != bodyChunkBytes) || (packed == 0 && bytes.size() != size))
+        {
+            return nullptr;
+        }
+        chunk.size = static_cast<size_t>(size);
+        chunk.packed = packed != 0;
+        chunk.bytes = std::make_shared<const std::string>(std::move(bytes));
+        entry->chunks.push_back(std::move(chunk));
+        bodyBytes += size;
+    }
+
+    uint64_t segmentCount = 0;
+    if (!ReadVarint(in, at, segmentCount) || segmentCount > in.size())
+    {
+        return nullptr;
+    }
+    for (uint64_t i = 0; i < segmentCount; ++i)
+    {
+        uint64_t first = 0;
+        std::string bytes;
+        if (!ReadVarint(in, at, first) || !ReadField(in, at, bytes) || first > entry->length ||
+            bytes.size() > entry->length - first)
+        {
+            return nullptr;
+        }
+        entry->segments[first] = std::make_shared<const std::string>(std::move(bytes));
+    }
+
+    // Complete entries hold chunks and partial ones segments, never both
+    if (entry->segments.empty() ? bodyBytes != entry->length : chunkCount != 0)
+    {
+        return nullptr;
+    }
+    return entry;
+}
+
+// Predecessor: duplicates every offered socket into the successor and waits for it to open
+// them. Windows has no SCM_RIGHTS for passing descriptors; WSADuplicateSocket does the same
+// through a protocol info the target process opens the socket from.
+bool HandSocketsTo(SOCKET successor)
+{
+    uint32_t processId = 0;
+    if (!ReceiveLength(successor, processId))
+    {
+        return false;
+    }
+
+    std::string sockets;
+    uint32_t count = 0;
+    for (size_t i = 0; i < roleCount; ++i)
+    {
+        if (offered[i] == INVALID_SOCKET)
+        {
+            continue;
+        }
+        WSAPROTOCOL_INFOW info = {};
+        if (WSADuplicateSocketW(offered[i], processId, &info) != 0)
+        {
+            HandleError("WSADuplicateSocket failed");
+            return false;
+        }
+        sockets += static_cast<char>(i);
+        sockets.append(reinterpret_cast<const char*>(&info), sizeof(info));
+        ++count;
+    }
+
+    char reply = 0;
+    return SendLength(successor, count) && SendAll(successor, sockets.data(), sockets.size()) &&
+           ReceiveAll(successor, &reply, 1) && reply == takenOver;
+}
+
+// Predecessor: sends the cache, most recently used entries first, so a successor with less
+// room keeps the ones that matter
+void SendCache(SOCKET successor)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    size_t sent = 0;
+    for (const auto& entry : responseCache.GetEntries())
+    {
+        std::string record = EncodeEntry(entry.first, *entry.second, now);
+        if (!SendLength(successor, static_cast<uint32_t>(record.size())) ||
+            !SendAll(successor, record.data(), record.size()))
+        {
+            HandleError("Cache handover failed");
+            return;
+        }
+        ++sent;
+    }
+    SendLength(successor, 0);
+
+    // The successor closes first, so the handover port is left without a TIME_WAIT here
+    char discard;
+    recv(successor, &discard, 1, 0);
+    LogInfo("Handed " + std::to_string(sent) + " cache entries to the successor");
+}
+
+void HandoverLoop(SOCKET listenSocket)
+{
+    while (true)
+    {
+        SOCKET successor = accept(listenSocket, nullptr, nullptr);
+        if (successor == INVALID_SOCKET)
+        {
+            HandleError("Handover accept failed");
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+        if (!HandSocketsTo(successor))
+        {
+            closesocket(successor);
+            continue;
+        }
+
+        // The successor serves every port from here on. Closing this process's copies of the
+        // admin and peer sockets ends their threads; the proxy port's accept loop stops on
+        // its own, and the handover port is freed for the successor's own successor.
+        handedOver.store(true, std::memory_order_release);
+        for (HandoverRole role : {HandoverRole::Admin, HandoverRole::Peer})
+        {
+            if (offered[static_cast<size_t>(role)] != INVALID_SOCKET)
+            {
+                closesocket(offered[static_cast<size_t>(role)]);
+            }
+        }
+        closesocket(listenSocket);
+
+        SendCache(successor);
+        closesocket(successor);
+        cacheSent.store(true, std::memory_order_release);
+        return;
+    }
+}
+
+// Successor: adopts entries as they arrive, while clients are already being served
+void ReceiveCache(SOCKET predecessor)
+{
+    size_t adopted = 0;
+    uint32_t length = 0;
+    while (ReceiveLength(predecessor, length) && length != 0 && length <= maxEntryRecord)
+    {
+        std::string record(length, '\0');
+        if (!ReceiveAll(predecessor, &record[0], length))
+        {
+            break;
+        }
+        std::string key;
+        std::shared_ptr<CachedResponse> entry =
+            DecodeEntry(record, key, std::chrono::steady_clock::now());
+        if (entry != nullptr && responseCache.Adopt(key, std::move(entry)))
+        {
+            ++adopted;
+        }
+    }
+    shutdown(predecessor, SD_SEND);
+    closesocket(predecessor);
+    LogInfo("Adopted " + std::to_string(adopted) + " cache entries from the predecessor");
+}
+} // namespace
+
+bool TakeOver(const HandoverSettings& settings)
+{
+    handoverSettings = settings;
+    SOCKET predecessor = CreateSocket(IPPROTO_TCP);
+    sockaddr_in address;
+    SetAddress("127.0.0.1", settings.port, address);
+    if (predecessor == INVALID_SOCKET ||
+        connect(predecessor, reinterpret_cast<sockaddr*>(&address), sizeof(address)) ==
+            SOCKET_ERROR)
+    {
+        HandleError("No proxy to take over on the handover port");
+        closesocket(predecessor);
+        return false;
+    }
+
+    // Any socket that fails to open leaves the predecessor with all of them
+    uint32_t count = 0;
+    bool opened = SendLength(predecessor, GetCurrentProcessId()) &&
+                  ReceiveLength(predecessor, count) && count <= roleCount;
+    for (uint32_t i = 0; opened && i < count; ++i)
+    {
+        char role = 0;
+        WSAPROTOCOL_INFOW info = {};
+        opened = ReceiveAll(predecessor, &role, 1) &&
+                 ReceiveAll(predecessor, reinterpret_cast<char*>(&info), sizeof(info)) &&
+                 static_cast<size_t>(role) < roleCount;
+        if (opened)
+        {
+            SOCKET socket = WSASocketW(
+                FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO, &info, 0, 0);
+            inherited[static_cast<size_t>(role)] = socket;
+            opened = socket != INVALID_SOCKET;
+        }
+    }
+    if (!opened || !SendAll(predecessor, &takenOver, 1))
+    {
+        HandleError("Handover failed");
+        for (SOCKET& socket : inherited)
+        {
+            if (socket != INVALID_SOCKET)
+            {
+                closesocket(socket);
+                socket = INVALID_SOCKET;
+            }
+        }
+        closesocket(predecessor);
+        return false;
+    }
+
+    std::thread(ReceiveCache, predecessor).detach();
+    return true;
+}
+
+SOCKET InheritedSocket(HandoverRole role)
+{
+    return inherited[static_cast<size_t>(role)];
+}
+
+void OfferForHandover(HandoverRole role, SOCKET socket)
+{
+    offered[static_cast<size_t>(role)] = socket;
+}
+
+bool StartHandoverListener(const HandoverSettings& settings)
+{
+    handoverSettings = settings;
+    SOCKET listenSocket = CreateSocket(IPPROTO_TCP);
+    if (listenSocket == INVALID_SOCKET)
+    {
+        HandleError("Handover socket creation failed");
+        return false;
+    }
+
+    // A predecessor frees the port once the sockets are handed over, which may be a moment
+    // after this process has them
+    sockaddr_in handoverAddr;
+    SetAddress("127.0.0.1", settings.port, handoverAddr);
+    bool listening = false;
+    for (int attempt = 0; attempt < 20 && !listening; ++attempt)
+    {
+        if (attempt > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        listening = bind(
+                        listenSocket,
+                        reinterpret_cast<sockaddr*>(&handoverAddr),
+                        sizeof(handoverAddr)) != SOCKET_ERROR;
+    }
+    if (!listening || listen(listenSocket, 1) == SOCKET_ERROR)
+    {
+        HandleError("Handover listen failed");
+        closesocket(listenSocket);
+        return false;
+    }
+
+    std::thread(HandoverLoop, listenSocket).detach();
+    return true;
+}
+
+bool HandedOver()
+{
+    return handedOver.load(std::memory_order_acquire);
+}
+
+void DrainAfterHandover(const std::atomic<int>& clientThreads)
+{
+    LogInfo(
+        "Handed over to a successor, draining " + std::to_string(clientThreads.load()) +
+        " connections");
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(handoverSettings.drainSeconds);
+    while ((clientThreads.load() > 0 || !cacheSent.load(std::memory_order_acquire)) &&
+           std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
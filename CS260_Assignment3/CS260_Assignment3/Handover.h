@@ -0,0 +1,62 @@
+﻿/*****************************************************************
+ * @file   Handover.h
+ * @brief  Restarts without dropping connections: a new process takes
+ * the running one's listening sockets and cache, and the old one
+ * drains its connections and exits.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *
+ * Handover over a loopback TCP connection, integers in network byte order:
+ *   successor    4 bytes   its process id, which the sockets are duplicated into
+ *   predecessor  4 bytes   number of sockets, then for each a role byte and the
+ *                          WSAPROTOCOL_INFOW the successor opens it from
+ *   successor    1 byte    1 once it holds every socket; the predecessor then stops
+ *   predecessor  cache entries, most recently used first, each a 4-byte length and
+ *                the entry; a zero length ends the stream
+ *****************************************************************/
+
+#pragma once
+
+#include <WinSock2.h>
+#include <atomic>
+#include <cstdint>
+
+enum class HandoverRole : uint8_t
+{
+    Client, // The proxy port
+    Admin,  // The admin pages' port
+    Peer,   // The sibling lookup port
+    Count,
+};
+
+struct HandoverSettings
+{
+    int port = 0;          // Loopback port a successor connects to; disabled when 0
+    bool takeOver = false; // Start by taking over from the process listening on port
+    int drainSeconds = 60; // How long a replaced process waits for its connections to finish
+};
+
+// Connects to the running proxy on the handover port and takes its listening sockets. Its
+// cache entries follow on a background thread while this process starts accepting. False if
+// there is no predecessor or the handover failed, which leaves it serving as before.
+bool TakeOver(const HandoverSettings& settings);
+
+// A socket taken over from the predecessor, already bound and listening; INVALID_SOCKET when
+// there is none for the role
+SOCKET InheritedSocket(HandoverRole role);
+
+// Offers a listening socket to a future successor; call before StartHandoverListener
+void OfferForHandover(HandoverRole role, SOCKET socket);
+
+// Waits for a successor on the handover port from a background thread; false if the port
+// can't be bound
+bool StartHandoverListener(const HandoverSettings& settings);
+
+// Whether a successor holds the sockets; this process then accepts nothing more
+bool HandedOver();
+
+// Once handed over: waits until the cache has gone to the successor and clientThreads has
+// dropped to zero, or the drain timeout passes
+void DrainAfterHandover(const std::atomic<int>& clientThreads);
@@ -0,0 +1,182 @@
+﻿/*****************************************************************
+ * @file   HappyEyeballs.cpp
+ * @brief  Name resolution and RFC 8305 style connection racing across
+ * every IPv6 and IPv4 address of an upstream server.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "HappyEyeballs.h"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace
+{
+// select() can only watch FD_SETSIZE sockets (64 on Windows); never race more than that
+const size_t maxAttempts = 32;
+
+// Reorders the resolver's list so the families alternate, keeping the resolver's (RFC 6724)
+// preference for which family goes first
+std::vector<const addrinfo*> InterleaveFamilies(const addrinfo* addresses)
+{
+    std::vector<const addrinfo*> first;
+    std::vector<const addrinfo*> second;
+    int firstFamily = addresses != nullptr ? addresses->ai_family : AF_UNSPEC;
+    for (const addrinfo* address = addresses; address != nullptr; address = address->ai_next)
+    {
+        (address->ai_family == firstFamily ? first : second).push_back(address);
+    }
+
+    std::vector<const addrinfo*> ordered;
+    for (size_t i = 0; i < std::max(first.size(), second.size()); ++i)
+    {
+        if (i < first.size())
+        {
+            ordered.push_back(first[i]);
+        }
+        if (i < second.size())
+        {
+            ordered.push_back(second[i]);
+        }
+    }
+    if (ordered.size() > maxAttempts)
+    {
+        ordered.resize(maxAttempts);
+    }
+    return ordered;
+}
+
+void CloseAttempts(std::vector<SOCKET>& attempts, SOCKET keep)
+{
+    for (SOCKET attempt : attempts)
+    {
+        if (attempt != keep)
+        {
+            closesocket(attempt);
+        }
+    }
+    attempts.clear();
+}
+} // namespace
+
+AddressList ResolveHost(const std::string& host, int port)
+{
+    addrinfo* result = nullptr;
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0)
+    {
+        return AddressList();
+    }
+    return AddressList(result);
+}
+
+SOCKET ConnectHappyEyeballs(const addrinfo* addresses, int timeoutMs, int attemptDelayMs)
+{
+    using Clock = std::chrono::steady_clock;
+    std::vector<const addrinfo*> ordered = InterleaveFamilies(addresses);
+    std::vector<SOCKET> pending;
+    size_t next = 0;
+    int lastError = WSAETIMEDOUT;
+    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    Clock::time_point nextStart = Clock::now();
+
+    while (Clock::now() < deadline)
+    {
+        // Start the next attempt when its stagger delay is up or nothing else is in flight
+        if (next < ordered.size() && (pending.empty() || Clock::now() >= nextStart))
+        {
+            const addrinfo* address = ordered[next++];
+            SOCKET attempt =
+                socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (attempt != INVALID_SOCKET)
+            {
+                ioctlsocket(attempt, FIONBIO, &nonBlocking);
+                if (connect(attempt, address->ai_addr, static_cast<int>(address->ai_addrlen)) == 0)
+                {
+                    CloseAttempts(pending, INVALID_SOCKET);
+                    ioctlsocket(attempt, FIONBIO, &blocking);
+                    return attempt;
+                }
+                if (WSAGetLastError() == WSAEWOULDBLOCK)
+                {
+                    pending.push_back(attempt);
+                }
+                else
+                {
+                    lastError = WSAGetLastError();
+                    closesocket(attempt);
+                }
+            }
+            nextStart = Clock::now() + std::chrono::milliseconds(attemptDelayMs);
+            continue;
+        }
+
+        if (pending.empty())
+        {
+            break; // Every address has been tried and failed
+        }
+
+        // Wait for an attempt to finish, but no longer than the next staggered start
+        Clock::time_point wakeUp =
+            next < ordered.size() ? std::min(nextStart, deadline) : deadline;
+        long long waitUs = std::max<long long>(
+            0,
+            std::chrono::duration_cast<std::chrono::microseconds>(wakeUp - Clock::now()).count());
+        timeval timeout = {
+            static_cast<long>(waitUs / 1000000), static_cast<long>(waitUs % 1000000)};
+
+        fd_set writeSet;
+        fd_set exceptSet;
+        FD_ZERO(&writeSet);
+        FD_ZERO(&exceptSet);
+        SOCKET highest = 0;
+        for (SOCKET attempt : pending)
+        {
+            FD_SET(attempt, &writeSet);
+            FD_SET(attempt, &exceptSet);
+            highest = std::max(highest, attempt);
+        }
+        if (select(static_cast<int>(highest) + 1, nullptr, &writeSet, &exceptSet, &timeout) <= 0)
+        {
+            continue;
+        }
+
+        // Windows reports a failed connect through the except set, other stacks as writable
+        // with SO_ERROR set, so check both
+        for (size_t i = 0; i < pending.size();)
+        {
+            SOCKET attempt = pending[i];
+            if (!FD_ISSET(attempt, &writeSet) && !FD_ISSET(attempt, &exceptSet))
+            {
+                ++i;
+                continue;
+            }
+
+            int error = 0;
+            int errorLen = sizeof(error);
+            getsockopt(
+                attempt, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &errorLen);
+            if (!FD_ISSET(attempt, &exceptSet) && error == 0)
+            {
+                CloseAttempts(pending, attempt);
+                ioctlsocket(attempt, FIONBIO, &blocking);
+                return attempt;
+            }
+
+            lastError = error != 0 ? error : lastError;
+            closesocket(attempt);
+            pending.erase(pending.begin() + i);
+            nextStart = Clock::now(); // A failure lets the next address start right away
+        }
+    }
+
+    CloseAttempts(pending, INVALID_SOCKET);
+    WSASetLastError(Clock::now() >= deadline ? WSAETIMEDOUT : lastError);
+    return INVALID_SOCKET;
+}
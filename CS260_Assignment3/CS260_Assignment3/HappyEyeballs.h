@@ -0,0 +1,40 @@
+﻿/*****************************************************************
+ * @file   HappyEyeballs.h
+ * @brief  Name resolution and RFC 8305 style connection racing across
+ * every IPv6 and IPv4 address of an upstream server.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include "NetworkUtils.h"
+#include <memory>
+#include <string>
+
+struct AddressListDeleter
+{
+    void operator()(addrinfo* list) const
+    {
+        freeaddrinfo(list);
+    }
+};
+
+using AddressList = std::unique_ptr<addrinfo, AddressListDeleter>;
+
+// Recommended "Connection Attempt Delay" from RFC 8305 section 8
+const int connectionAttemptDelayMs = 250;
+
+// Resolves every TCP address of host (IPv6 and IPv4); empty on failure
+AddressList ResolveHost(const std::string& host, int port);
+
+// Starts a non-blocking connect to each address in turn, alternating address families and
+// staggering starts by attemptDelayMs (or immediately once every pending attempt has failed).
+// The first attempt to complete wins and is returned in blocking mode; the rest are closed.
+// Returns INVALID_SOCKET if every attempt fails or timeoutMs passes first.
+SOCKET ConnectHappyEyeballs(
+    const addrinfo* addresses,
+    int timeoutMs,
+    int attemptDelayMs = connectionAttemptDelayMs);
@@ -0,0 +1,77 @@
+﻿/*****************************************************************
+ * @file   Hash.h
+ * @brief  Small non-cryptographic hash helpers used for routing and
+ * lookup tables.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// FNV-1a over a byte range
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+inline uint64_t HashString(const std::string& value)
+{
+    return HashBytes(value.data(), value.size());
+}
+
+// SplitMix64 finalizer; spreads nearby inputs (e.g. replica indices) across the full range
+inline uint64_t MixHash(uint64_t value)
+{
+    value += 0x9e3779b97f4a7c15ull;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+    return value ^ (value >> 31);
+}
+
+// Hash for bulk content, e.g. cached bodies: four independent multiply-rotate lanes take eight
+// bytes each per step, where FNV-1a takes one byte at a time
+inline uint64_t HashContent(const void* data, size_t size)
+{
+    const uint64_t prime1 = 0x9e3779b185ebca87ull;
+    const uint64_t prime2 = 0xc2b2ae3d27d4eb4full;
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t lanes[4] = {prime1 + prime2, prime2, 0, 0 - prime1};
+    size_t offset = 0;
+    for (; offset + 32 <= size; offset += 32)
+    {
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            uint64_t word;
+            memcpy(&word, bytes + offset + 8 * lane, 8);
+            uint64_t mixed = lanes[lane] + word * prime2;
+            lanes[lane] = ((mixed << 31) | (mixed >> 33)) * prime1;
+        }
+    }
+
+    uint64_t hash = MixHash(size);
+    for (uint64_t lane : lanes)
+    {
+        hash = MixHash(hash ^ lane);
+    }
+    for (; offset < size; offset += 8)
+    {
+        uint64_t word = 0;
+        memcpy(&word, bytes + offset, size - offset < 8 ? size - offset : 8);
+        hash = MixHash(hash ^ word);
+    }
+    return hash;
+}
@@ -0,0 +1,327 @@
+﻿/*****************************************************************
+ * @file   HeavyHitters.cpp
+ * @brief  Fixed-memory tracking of the busiest hosts and URLs by
+ * requests and bytes, with count-min sketches and top-K tables.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "HeavyHitters.h"
+#include "Hash.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+namespace
+{
+const size_t sketchDepth = 4;
+const size_t sketchWidth = 4096; // Counters per row; must be a power of two
+const size_t maxTopK = 256;
+const size_t keyWordCount = 16; // Keys are kept to their first 128 bytes
+
+const size_t scopeCount = static_cast<size_t>(HitterScope::Count);
+const size_t measureCount = static_cast<size_t>(HitterMeasure::Count);
+
+const char* const scopeNames[scopeCount] = {"host", "url"};
+const char* const measureNames[measureCount] = {"requests", "bytes"};
+
+// Every row hashes the key differently, and a key's estimate is its smallest counter, so a
+// collision only inflates the estimate when it happens in every row at once
+class CountMinSketch
+{
+public:
+    void Add(uint64_t keyHash, uint64_t amount)
+    {
+        for (size_t row = 0; row < sketchDepth; ++row)
+        {
+            _counters[row][Column(keyHash, row)].fetch_add(amount, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t Estimate(uint64_t keyHash) const
+    {
+        uint64_t estimate = UINT64_MAX;
+        for (size_t row = 0; row < sketchDepth; ++row)
+        {
+            estimate = std::min(
+                estimate, _counters[row][Column(keyHash, row)].load(std::memory_order_relaxed));
+        }
+        return estimate;
+    }
+
+    // Subtracting half of what was read keeps any add that lands in between
+    void Halve()
+    {
+        for (auto& row : _counters)
+        {
+            for (std::atomic<uint64_t>& counter : row)
+            {
+                counter.fetch_sub(
+                    counter.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    static size_t Column(uint64_t keyHash, size_t row)
+    {
+        return static_cast<size_t>(MixHash(keyHash + row)) & (sketchWidth - 1);
+    }
+
+    std::atomic<uint64_t> _counters[sketchDepth][sketchWidth] = {};
+};
+
+// A candidate's key is replaced under a seqlock: the sequence is odd while it is written, and
+// a reader that sees it change retries or skips the slot
+struct Candidate
+{
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<uint64_t> keyHash{0};
+    std::atomic<uint64_t> estimate{0};
+    std::atomic<uint64_t> keyWords[keyWordCount] = {};
+};
+
+// The topK keys with the largest estimates seen so far. A key that outgrows the smallest
+// candidate takes over its slot; two threads racing for the same key may briefly hold two
+// slots, which the reader merges.
+class TopKTable
+{
+public:
+    void Offer(uint64_t keyHash, const std::string& key, uint64_t estimate, size_t topK)
+    {
+        Candidate* smallest = nullptr;
+        uint64_t smallestEstimate = UINT64_MAX;
+        for (size_t i = 0; i < topK; ++i)
+        {
+            Candidate& candidate = _candidates[i];
+            if (candidate.keyHash.load(std::memory_order_relaxed) == keyHash)
+            {
+                uint64_t current = candidate.estimate.load(std::memory_order_relaxed);
+                while (current < estimate &&
+                       !candidate.estimate.compare_exchange_weak(
+                           current, estimate, std::memory_order_relaxed))
+                {
+                }
+                return;
+            }
+            uint64_t candidateEstimate = candidate.estimate.load(std::memory_order_relaxed);
+            if (candidateEstimate < smallestEstimate)
+            {
+                smallest = &candidate;
+                smallestEstimate = candidateEstimate;
+            }
+        }
+        if (smallest == nullptr || estimate <= smallestEstimate)
+        {
+            return;
+        }
+
+        // Losing the slot to another writer just drops this offer; the key will be offered again
+        uint64_t sequence = smallest->sequence.load(std::memory_order_relaxed);
+        if ((sequence & 1) != 0 ||
+            !smallest->sequence.compare_exchange_strong(
+                sequence, sequence + 1, std::memory_order_acquire))
+        {
+            return;
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        uint64_t words[keyWordCount] = {};
+        memcpy(words, key.data(), std::min(key.size(), sizeof(words)));
+        for (size_t i = 0; i < keyWordCount; ++i)
+        {
+            smallest->keyWords[i].store(words[i], std::memory_order_relaxed);
+        }
+        smallest->keyHash.store(keyHash, std::memory_order_relaxed);
+        smallest->estimate.store(estimate, std::memory_order_relaxed);
+        smallest->sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    void Halve(size_t topK)
+    {
+        for (size_t i = 0; i < topK; ++i)
+        {
+            std::atomic<uint64_t>& estimate = _candidates[i].estimate;
+            estimate.fetch_sub(
+                estimate.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+        }
+    }
+
+    std::vector<HeavyHitter> Snapshot(size_t topK) const
+    {
+        std::vector<std::pair<uint64_t, HeavyHitter>> seen;
+        for (size_t i = 0; i < topK; ++i)
+        {
+            const Candidate& candidate = _candidates[i];
+            uint64_t sequence = candidate.sequence.load(std::memory_order_acquire);
+            uint64_t keyHash = candidate.keyHash.load(std::memory_order_relaxed);
+            uint64_t estimate = candidate.estimate.load(std::memory_order_relaxed);
+            uint64_t words[keyWordCount + 1] = {};
+            for (size_t word = 0; word < keyWordCount; ++word)
+            {
+                words[word] = candidate.keyWords[word].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            // Skip empty slots and slots whose key changed while being read
+            if (estimate == 0 || (sequence & 1) != 0 ||
+                candidate.sequence.load(std::memory_order_relaxed) != sequence)
+            {
+                continue;
+            }
+
+            auto duplicate = std::find_if(seen.begin(), seen.end(), [&](const auto& entry) {
+                return entry.first == keyHash;
+            });
+            if (duplicate != seen.end())
+            {
+                duplicate->second.estimate = std::max(duplicate->second.estimate, estimate);
+                continue;
+            }
+            HeavyHitter hitter;
+            hitter.key = reinterpret_cast<const char*>(words);
+            hitter.estimate = estimate;
+            seen.emplace_back(keyHash, std::move(hitter));
+        }
+
+        std::vector<HeavyHitter> top;
+        for (auto& entry : seen)
+        {
+            top.push_back(std::move(entry.second));
+        }
+        std::sort(top.begin(), top.end(), [](const HeavyHitter& a, const HeavyHitter& b) {
+            return a.estimate > b.estimate;
+        });
+        return top;
+    }
+
+private:
+    Candidate _candidates[maxTopK];
+};
+
+struct HitterTables
+{
+    CountMinSketch sketches[scopeCount][measureCount];
+    TopKTable tables[scopeCount][measureCount];
+};
+
+std::unique_ptr<HitterTables> hitters;
+size_t topK = 0;
+
+void Count(HitterScope scope, HitterMeasure measure, const std::string& key, uint64_t amount)
+{
+    size_t s = static_cast<size_t>(scope);
+    size_t m = static_cast<size_t>(measure);
+    uint64_t keyHash = HashString(key);
+    hitters->sketches[s][m].Add(keyHash, amount);
+    hitters->tables[s][m].Offer(keyHash, key, hitters->sketches[s][m].Estimate(keyHash), topK);
+}
+
+void DecayLoop(int decaySeconds)
+{
+    while (true)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(decaySeconds));
+        for (size_t s = 0; s < scopeCount; ++s)
+        {
+            for (size_t m = 0; m < measureCount; ++m)
+            {
+                hitters->sketches[s][m].Halve();
+                hitters->tables[s][m].Halve(topK);
+            }
+        }
+    }
+}
+
+} // namespace
+
+void StartHeavyHitters(const HeavyHitterSettings& settings)
+{
+    if (settings.topK <= 0)
+    {
+        return;
+    }
+    topK = std::min(static_cast<size_t>(settings.topK), maxTopK);
+    hitters = std::make_unique<HitterTables>();
+    if (settings.decaySeconds > 0)
+    {
+        std::thread(DecayLoop, settings.decaySeconds).detach();
+    }
+}
+
+bool HeavyHittersEnabled()
+{
+    return hitters != nullptr;
+}
+
+void CountHitterRequest(const std::string& host, const std::string& url)
+{
+    if (hitters != nullptr)
+    {
+        Count(HitterScope::Host, HitterMeasure::Requests, host, 1);
+        Count(HitterScope::Url, HitterMeasure::Requests, url, 1);
+    }
+}
+
+void CountHitterBytes(const std::string& host, const std::string& url, uint64_t bytes)
+{
+    if (hitters != nullptr && bytes > 0)
+    {
+        Count(HitterScope::Host, HitterMeasure::Bytes, host, bytes);
+        Count(HitterScope::Url, HitterMeasure::Bytes, url, bytes);
+    }
+}
+
+uint64_t EstimateHitterRequests(HitterScope scope, const std::string& key)
+{
+    if (hitters == nullptr)
+    {
+        return 0;
+    }
+    return hitters->sketches[static_cast<size_t>(scope)]
+                            [static_cast<size_t>(HitterMeasure::Requests)]
+                                .Estimate(HashString(key));
+}
+
+std::vector<HeavyHitter> TopHeavyHitters(HitterScope scope, HitterMeasure measure)
+{
+    if (hitters == nullptr)
+    {
+        return {};
+    }
+    return hitters->tables[static_cast<size_t>(scope)][static_cast<size_t>(measure)].Snapshot(
+        topK);
+}
+
+std::string RenderHeavyHitters()
+{
+    std::string out;
+    for (size_t m = 0; m < measureCount; ++m)
+    {
+        out += std::string("# HELP proxy_top_") + measureNames[m] +
+               " Recent count-min estimate for the busiest keys; halves every decay period.\n";
+        out += std::string("# TYPE proxy_top_") + measureNames[m] + " gauge\n";
+        for (size_t s = 0; s < scopeCount; ++s)
+        {
+            for (const HeavyHitter& hitter :
+                 TopHeavyHitters(static_cast<HitterScope>(s), static_cast<HitterMeasure>(m)))
+            {
+                char value[32];
+                snprintf(
+                    value,
+                    sizeof(value),
+                    "%llu\n",
+                    static_cast<unsigned long long>(hitter.estimate));
+                out += std::string("proxy_top_") + measureNames[m] + "{scope=\"" + scopeNames[s] +
+                       "\",key=\"" + EscapeLabel(hitter.key) + "\"} " + value;
+            }
+        }
+    }
+    return out;
+}
@@ -0,0 +1,60 @@
+﻿/*****************************************************************
+ * @file   HeavyHitters.h
+ * @brief  Fixed-memory tracking of the busiest hosts and URLs by
+ * requests and bytes, with count-min sketches and top-K tables.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct HeavyHitterSettings
+{
+    int topK = 0;          // Keys kept per table; 0 disables tracking
+    int decaySeconds = 60; // Counts halve this often, so the tables follow recent traffic
+};
+
+enum class HitterScope
+{
+    Host, // The Host header, port included
+    Url,  // Host header and path, the same key the response cache uses
+    Count,
+};
+
+enum class HitterMeasure
+{
+    Requests,
+    Bytes, // Response bytes sent to clients
+    Count,
+};
+
+struct HeavyHitter
+{
+    std::string key;
+    uint64_t estimate = 0; // Never below the true (decayed) count; may overcount on collisions
+};
+
+// Allocates the sketches and starts the decay thread; call before any client thread starts
+void StartHeavyHitters(const HeavyHitterSettings& settings);
+
+bool HeavyHittersEnabled();
+
+// Counts one request for the host and URL; lock-free
+void CountHitterRequest(const std::string& host, const std::string& url);
+
+void CountHitterBytes(const std::string& host, const std::string& url, uint64_t bytes);
+
+// How many requests the key has seen recently, per the sketch; 0 while tracking is off
+uint64_t EstimateHitterRequests(HitterScope scope, const std::string& key);
+
+// The current top keys for the scope and measure, largest first
+std::vector<HeavyHitter> TopHeavyHitters(HitterScope scope, HitterMeasure measure);
+
+// Every top-K table as Prometheus gauges, for the admin /topk page
+std::string RenderHeavyHitters();
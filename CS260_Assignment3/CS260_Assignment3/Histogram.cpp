@@ -0,0 +1,128 @@
+﻿/*****************************************************************
+ * @file   Histogram.cpp
+ * @brief  HDR-style log-linear latency histogram with lock-free
+ * recording and mergeable snapshots.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "Histogram.h"
+#include <algorithm>
+
+namespace
+{
+int HighestBit(uint64_t value)
+{
+    int bit = 0;
+    for (int step = 32; step > 0; step /= 2)
+    {
+        if (value >> step)
+        {
+            value >>= step;
+            bit += step;
+        }
+    }
+    return bit;
+}
+} // namespace
+
+int HistogramBucketIndex(uint64_t value)
+{
+    // The first two rows (0..31) are exact; after that each power of two gets 16 buckets
+    if (value < 2 * histogramSubBuckets)
+    {
+        return static_cast<int>(value);
+    }
+    int shift = HighestBit(value) - 4;
+    int index = shift * histogramSubBuckets + static_cast<int>(value >> shift);
+    return std::min(index, histogramBucketCount - 1);
+}
+
+uint64_t HistogramBucketLowerBound(int index)
+{
+    if (index < 2 * histogramSubBuckets)
+    {
+        return static_cast<uint64_t>(index);
+    }
+    int shift = index / histogramSubBuckets - 1;
+    uint64_t mantissa = index % histogramSubBuckets + histogramSubBuckets;
+    return mantissa << shift;
+}
+
+void HistogramSnapshot::Record(uint64_t value, uint64_t count)
+{
+    counts[HistogramBucketIndex(value)] += count;
+    totalCount += count;
+    sum += value * count;
+    max = std::max(max, value);
+}
+
+void HistogramSnapshot::Merge(const HistogramSnapshot& other)
+{
+    for (int i = 0; i < histogramBucketCount; ++i)
+    {
+        counts[i] += other.counts[i];
+    }
+    totalCount += other.totalCount;
+    sum += other.sum;
+    max = std::max(max, other.max);
+}
+
+uint64_t HistogramSnapshot::ValueAtQuantile(double quantile) const
+{
+    if (totalCount == 0)
+    {
+        return 0;
+    }
+
+    uint64_t target = static_cast<uint64_t>(quantile * totalCount + 0.5);
+    target = std::max<uint64_t>(target, 1);
+    uint64_t seen = 0;
+    for (int i = 0; i < histogramBucketCount; ++i)
+    {
+        seen += counts[i];
+        if (seen >= target)
+        {
+            // Report the top of the bucket, never more than the largest value seen
+            uint64_t upper = i + 1 < histogramBucketCount ? HistogramBucketLowerBound(i + 1) - 1
+                                                           : HistogramBucketLowerBound(i);
+            return std::min(upper, max);
+        }
+    }
+    return max;
+}
+
+uint64_t HistogramSnapshot::CountAtOrBelow(uint64_t bound) const
+{
+    uint64_t count = 0;
+    for (int i = 0; i < histogramBucketCount && HistogramBucketLowerBound(i) <= bound; ++i)
+    {
+        count += counts[i];
+    }
+    return count;
+}
+
+void Histogram::Record(uint64_t value)
+{
+    _counts[HistogramBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t max = _max.load(std::memory_order_relaxed);
+    while (value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+void Histogram::AddTo(HistogramSnapshot& snapshot) const
+{
+    for (int i = 0; i < histogramBucketCount; ++i)
+    {
+        uint64_t count = _counts[i].load(std::memory_order_relaxed);
+        snapshot.counts[i] += count;
+        snapshot.totalCount += count;
+    }
+    snapshot.sum += _sum.load(std::memory_order_relaxed);
+    snapshot.max = std::max(snapshot.max, _max.load(std::memory_order_relaxed));
+}
@@ -0,0 +1,63 @@
+﻿/*****************************************************************
+ * @file   Histogram.h
+ * @brief  HDR-style log-linear latency histogram with lock-free
+ * recording and mergeable snapshots.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Values are bucketed with 4 bits of mantissa, so any recorded value is reported within
+// 1/16 (~6%) of its true value across the whole range up to 2^40 (about 12 days in us).
+const int histogramSubBuckets = 16;
+const int histogramBucketCount = 38 * histogramSubBuckets;
+
+// Plain counts, used for merging and reading
+struct HistogramSnapshot
+{
+    std::array<uint64_t, histogramBucketCount> counts = {};
+    uint64_t totalCount = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    void Record(uint64_t value, uint64_t count = 1);
+    void Merge(const HistogramSnapshot& other);
+
+    // Smallest value v such that at least quantile of the recorded values are <= v
+    uint64_t ValueAtQuantile(double quantile) const;
+
+    // Number of recorded values no larger than bound
+    uint64_t CountAtOrBelow(uint64_t bound) const;
+
+    double Mean() const
+    {
+        return totalCount == 0 ? 0.0 : static_cast<double>(sum) / totalCount;
+    }
+};
+
+// Recording side; relaxed atomic adds keep it safe to read while other threads write
+class Histogram
+{
+public:
+    void Record(uint64_t value);
+
+    // Adds this histogram's current counts into snapshot
+    void AddTo(HistogramSnapshot& snapshot) const;
+
+private:
+    std::array<std::atomic<uint64_t>, histogramBucketCount> _counts = {};
+    std::atomic<uint64_t> _sum{0};
+    std::atomic<uint64_t> _max{0};
+};
+
+int HistogramBucketIndex(uint64_t value);
+
+// Smallest value that lands in the bucket
+uint64_t HistogramBucketLowerBound(int index);
@@ -0,0 +1,275 @@
+﻿/*****************************************************************
+ * @file   HttpParser.cpp
+ * @brief  Extracts the parts of an HTTP request the proxy routes on.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "HttpParser.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+// Whether the header line starting at lineStart is the named header
+bool HeaderNameIs(const std::string& message, size_t lineStart, size_t lineEnd, const char* name)
+{
+    size_t nameLength = strlen(name);
+    return lineEnd - lineStart > nameLength && message[lineStart + nameLength] == ':' &&
+           _strnicmp(message.c_str() + lineStart, name, nameLength) == 0;
+}
+} // namespace
+
+std::string GetHostFromRequest(const std::string& request)
+{
+    std::istringstream iss(request);
+    std::string line;
+    std::string host;
+
+    while (std::getline(iss, line))
+    {
+        if (line.find("Host: ") == 0)
+        {
+            host = line.substr(6);
+            // Remove the carriage return at the end of the host
+            if (!host.empty() && host[host.size() - 1] == '\r')
+            {
+                host.pop_back();
+            }
+            break;
+        }
+    }
+
+    return host;
+}
+
+std::string GetPathFromRequest(const std::string& request)
+{
+    // Request line: "<method> <target> <version>"
+    size_t targetStart = request.find(' ');
+    if (targetStart == std::string::npos)
+    {
+        return "";
+    }
+    ++targetStart;
+    size_t targetEnd = request.find_first_of(" \r\n", targetStart);
+    std::string target = request.substr(targetStart, targetEnd - targetStart);
+
+    // Absolute-form ("http://host/path") carries the authority before the path
+    size_t scheme = target.find("://");
+    if (scheme != std::string::npos)
+    {
+        size_t pathStart = target.find('/', scheme + 3);
+        return pathStart == std::string::npos ? "/" : target.substr(pathStart);
+    }
+
+    return target;
+}
+
+bool RequestRoutable(const std::string& partial)
+{
+    if (partial.find("\r\n\r\n") != std::string::npos)
+    {
+        return true;
+    }
+    size_t host = partial.find("\nHost: ");
+    return host != std::string::npos && partial.find('\n', host + 1) != std::string::npos;
+}
+
+std::string GetHeaderValue(const std::string& message, const char* name)
+{
+    size_t nameLength = strlen(name);
+    std::string value;
+
+    // Header lines start after the first line and end at the empty line
+    size_t lineStart = message.find('\n');
+    while (lineStart != std::string::npos)
+    {
+        ++lineStart;
+        size_t lineEnd = message.find('\n', lineStart);
+        if (lineEnd == std::string::npos || lineEnd == lineStart ||
+            (lineEnd == lineStart + 1 && message[lineStart] == '\r'))
+        {
+            break;
+        }
+
+        if (lineEnd - lineStart > nameLength && message[lineStart + nameLength] == ':' &&
+            _strnicmp(message.c_str() + lineStart, name, nameLength) == 0)
+        {
+            size_t valueStart = lineStart + nameLength + 1;
+            size_t valueEnd = lineEnd;
+            while (valueStart < valueEnd &&
+                   isspace(static_cast<unsigned char>(message[valueStart])))
+            {
+                ++valueStart;
+            }
+            while (valueEnd > valueStart &&
+                   isspace(static_cast<unsigned char>(message[valueEnd - 1])))
+            {
+                --valueEnd;
+            }
+            if (!value.empty())
+            {
+                value += ", ";
+            }
+            value.append(message, valueStart, valueEnd - valueStart);
+        }
+        lineStart = lineEnd;
+    }
+
+    return value;
+}
+
+int GetResponseStatus(const std::string& response)
+{
+    // "HTTP/1.x NNN"
+    if (response.size() < 12 || response.compare(0, 5, "HTTP/") != 0)
+    {
+        return 0;
+    }
+    return atoi(response.c_str() + 9);
+}
+
+size_t GetResponseLength(const std::string& response)
+{
+    size_t headEnd = response.find("\r\n\r\n");
+    std::string length = GetHeaderValue(response, "Content-Length");
+    if (headEnd == std::string::npos || length.empty() ||
+        !isdigit(static_cast<unsigned char>(length[0])))
+    {
+        return 0;
+    }
+    return headEnd + 4 + static_cast<size_t>(strtoull(length.c_str(), nullptr, 10));
+}
+
+std::string RemoveHeaders(const std::string& message, std::initializer_list<const char*> names)
+{
+    size_t headerEnd = message.find("\r\n\r\n");
+    size_t lineEnd = message.find("\r\n");
+    if (headerEnd == std::string::npos)
+    {
+        headerEnd = lineEnd = message.size();
+    }
+
+    std::string kept = message.substr(0, lineEnd) + "\r\n";
+    while (lineEnd < headerEnd)
+    {
+        size_t lineStart = lineEnd + 2;
+        lineEnd = message.find("\r\n", lineStart);
+        bool removed = false;
+        for (const char* name : names)
+        {
+            removed = removed || HeaderNameIs(message, lineStart, lineEnd, name);
+        }
+        if (!removed)
+        {
+            kept.append(message, lineStart, lineEnd + 2 - lineStart);
+        }
+    }
+    return kept;
+}
+
+void RewriteRequestHead(const std::string& request, const RequestRewrite& rewrite, SliceList& out)
+{
+    size_t lineEnd = request.find("\r\n");
+    size_t headerEnd = request.find("\r\n\r\n");
+    size_t targetStart = request.find(' ');
+    if (headerEnd == std::string::npos || targetStart == std::string::npos ||
+        targetStart > lineEnd)
+    {
+        out.AddBytes(request.data(), request.size());
+        return;
+    }
+
+    // Absolute-form ("http://host/path") loses everything before the path
+    ++targetStart;
+    size_t targetEnd = std::min(request.find(' ', targetStart), lineEnd);
+    size_t resume = 0;
+    size_t scheme = request.find("://", targetStart);
+    if (scheme < targetEnd)
+    {
+        out.AddBytes(request.data(), targetStart);
+        resume = std::min(request.find('/', scheme + 3), targetEnd);
+        if (resume == targetEnd)
+        {
+            out.AddText("/");
+        }
+    }
+
+    // Values join the last Via or X-Forwarded-For line, or new lines go at the end of the block.
+    // A sibling's X-Proxy-Peer line is dropped, replaced by this proxy's own when it has one.
+    struct Splice
+    {
+        size_t at;
+        std::string text;
+        size_t removed;
+    };
+    std::vector<Splice> splices;
+    size_t viaEnd = std::string::npos;
+    size_t forwardedForEnd = std::string::npos;
+    for (size_t lineStart = lineEnd + 2; lineStart < headerEnd + 2;)
+    {
+        size_t nextEnd = request.find("\r\n", lineStart);
+        if (HeaderNameIs(request, lineStart, nextEnd, "Via"))
+        {
+            viaEnd = nextEnd;
+        }
+        else if (HeaderNameIs(request, lineStart, nextEnd, "X-Forwarded-For"))
+        {
+            forwardedForEnd = nextEnd;
+        }
+        else if (HeaderNameIs(request, lineStart, nextEnd, "X-Proxy-Peer"))
+        {
+            splices.push_back({lineStart, "", nextEnd + 2 - lineStart});
+        }
+        lineStart = nextEnd + 2;
+    }
+
+    if (!rewrite.via.empty())
+    {
+        splices.push_back(
+            {viaEnd,
+             viaEnd != std::string::npos ? ", " + rewrite.via : "Via: " + rewrite.via + "\r\n",
+             0});
+    }
+    if (!rewrite.forwardedFor.empty())
+    {
+        splices.push_back(
+            {forwardedForEnd,
+             forwardedForEnd != std::string::npos
+                 ? ", " + rewrite.forwardedFor
+                 : "X-Forwarded-For: " + rewrite.forwardedFor + "\r\n",
+             0});
+    }
+    if (!rewrite.peer.empty())
+    {
+        splices.push_back({std::string::npos, "X-Proxy-Peer: " + rewrite.peer + "\r\n", 0});
+    }
+    for (Splice& splice : splices)
+    {
+        if (splice.at == std::string::npos)
+        {
+            splice.at = headerEnd + 2;
+        }
+    }
+    std::stable_sort(splices.begin(), splices.end(), [](const Splice& a, const Splice& b) {
+        return a.at < b.at;
+    });
+
+    for (Splice& splice : splices)
+    {
+        out.AddBytes(request.data() + resume, splice.at - resume);
+        if (!splice.text.empty())
+        {
+            out.AddText(std::move(splice.text));
+        }
+        resume = splice.at + splice.removed;
+    }
+    out.AddBytes(request.data() + resume, request.size() - resume);
+}
@@ -0,0 +1,55 @@
+﻿/*****************************************************************
+ * @file   HttpParser.h
+ * @brief  Extracts the parts of an HTTP request the proxy routes on.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include "SliceList.h"
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+
+// What the proxy adds to a request head on its way upstream
+struct RequestRewrite
+{
+    std::string via;          // Received-by entry such as "1.1 proxy"; nothing added when empty
+    std::string forwardedFor; // Client address for X-Forwarded-For; nothing added when empty
+
+    // This proxy's name in X-Proxy-Peer, on a request sent to a sibling. Any X-Proxy-Peer the
+    // request arrived with is always removed.
+    std::string peer;
+};
+
+std::string GetHostFromRequest(const std::string& request);
+
+// Path of the request target, accepting both origin-form and absolute-form request lines
+std::string GetPathFromRequest(const std::string& request);
+
+// True once a partly received request can be routed: its Host header line is complete or the
+// header block has ended (without one)
+bool RequestRoutable(const std::string& partial);
+
+// Value of a header in the message's header block, matched case-insensitively with surrounding
+// whitespace trimmed. Repeated headers are joined with ", "; empty when absent.
+std::string GetHeaderValue(const std::string& message, const char* name);
+
+// Status code from a response's status line, or 0 if it doesn't start with one
+int GetResponseStatus(const std::string& response);
+
+// Bytes in the whole response, head included, from the start of one whose head is complete and
+// has a Content-Length; 0 when that can't be told yet
+size_t GetResponseLength(const std::string& response);
+
+// The message's first line and header lines, each ending in CRLF but without the blank line
+// that ends the block, leaving out headers with any of the given names
+std::string RemoveHeaders(const std::string& message, std::initializer_list<const char*> names);
+
+// The request with an absolute-form target turned into origin-form and the rewrite's values
+// joined to Via and X-Forwarded-For, as slices of request with the changes spliced in; request
+// must outlive out. Passed through unchanged until the header block is complete.
+void RewriteRequestHead(const std::string& request, const RequestRewrite& rewrite, SliceList& out);
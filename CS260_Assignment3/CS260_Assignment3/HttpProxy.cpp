@@ -0,0 +1,988 @@
+﻿/*****************************************************************
+ * @file   HttpProxy.cpp
+ * @brief  Per-client request handling for the HTTP proxy server.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "HttpProxy.h"
+#include "AsyncLogger.h"
+#include "Blocklist.h"
+#include "Capture.h"
+#include "ConcurrencyLimiter.h"
+#include "HappyEyeballs.h"
+#include "HeavyHitters.h"
+#include "HttpParser.h"
+#include "MemoryBudget.h"
+#include "Metrics.h"
+#include "OriginScheduler.h"
+#include "Peering.h"
+#include "ProxyConfig.h"
+#include "ResponseCache.h"
+#include "RelayScheduler.h"
+#include "ReverseProxy.h"
+#include "SliceList.h"
+#include "TcpInfo.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+const size_t maxRequestHead = 65536; // Stop waiting for a Host header after this many bytes
+const size_t maxResponseHead = 65536; // Relay a response head this long even if unfinished
+
+// Reads the client's request in two steps: just enough to route it, then (once the upstream
+// is connected) the rest of the upload streamed straight through. The request ends when the
+// client half-closes.
+class RequestReader
+{
+public:
+    RequestReader(SOCKET socket, bool keepCopy, MemoryAccount& memory)
+        : _socket(socket), _keepCopy(keepCopy), _memory(memory)
+    {
+    }
+
+    // Reads until the request can be routed, the client finishes, or the head grows too large
+    void ReadHead()
+    {
+        ReadUntil(RequestRoutable);
+    }
+
+    // Reads on until the whole header block has arrived, for decisions that need every header
+    void ReadHeaders()
+    {
+        ReadUntil([](const std::string& partial) {
+            return partial.find("\r\n\r\n") != std::string::npos;
+        });
+    }
+
+    // Everything received and not yet forwarded; after ReadHead, the start of the request
+    const std::string& Head() const
+    {
+        return _pending;
+    }
+
+    // Sends the head rewritten for the upstream, then the rest of the upload as it arrives
+    bool ForwardTo(SOCKET upstream, const RequestRewrite& rewrite)
+    {
+        ReadHeaders();
+        SliceList head;
+        RewriteRequestHead(_pending, rewrite, head);
+        if (!head.SendTo(upstream))
+        {
+            return false;
+        }
+        ClearPending();
+
+        std::vector<char> buffer(16384);
+        while (!_finished)
+        {
+            if (!Receive(buffer))
+            {
+                return false;
+            }
+            if (!_pending.empty() &&
+                send(upstream, _pending.data(), static_cast<int>(_pending.size()), 0) ==
+                    SOCKET_ERROR)
+            {
+                return false;
+            }
+            ClearPending();
+        }
+        return true;
+    }
+
+    // Reads and discards the rest of the upload, so closing with unread data can't reset the
+    // connection before the client reads an error response
+    void Drain()
+    {
+        std::vector<char> buffer(4096);
+        while (!_finished && Receive(buffer))
+        {
+            ClearPending();
+        }
+    }
+
+    SOCKET Socket() const
+    {
+        return _socket;
+    }
+
+    // Takes the socket off the memory account before closing it, so an abort can't shut down
+    // the handle once Winsock has given it to another connection
+    void CloseSocket()
+    {
+        _memory.DetachSocket();
+        closesocket(_socket);
+    }
+
+    uint64_t BytesRead() const
+    {
+        return _bytesRead;
+    }
+
+    // The whole request, kept only when asked for at construction (for capture)
+    const std::string& Copy() const
+    {
+        return _copy;
+    }
+
+private:
+    void ClearPending()
+    {
+        _memory.Release(_pending.size());
+        _pending.clear();
+    }
+
+    void ReadUntil(bool (*complete)(const std::string&))
+    {
+        std::vector<char> buffer(4096);
+        while (!_finished && !complete(_pending) && _pending.size() < maxRequestHead)
+        {
+            if (!Receive(buffer))
+            {
+                return;
+            }
+        }
+    }
+
+    bool Receive(std::vector<char>& buffer)
+    {
+        int bytesReceived = recv(_socket, buffer.data(), static_cast<int>(buffer.size()), 0);
+        if (bytesReceived == SOCKET_ERROR)
+        {
+            HandleError("recv failed");
+            _finished = true;
+            return false;
+        }
+        if (bytesReceived == 0)
+        {
+            _finished = true;
+            return true;
+        }
+        _bytesRead += bytesReceived;
+
+        // A connection aborted to free memory stops reading; its socket is already shut down
+        if (!_memory.Charge(_keepCopy ? 2 * bytesReceived : bytesReceived))
+        {
+            _finished = true;
+            return false;
+        }
+        _pending.append(buffer.data(), bytesReceived);
+        if (_keepCopy)
+        {
+            _copy.append(buffer.data(), bytesReceived);
+        }
+        return true;
+    }
+
+    SOCKET _socket;
+    bool _keepCopy;
+    MemoryAccount& _memory; // Charged for _pending and _copy
+    bool _finished = false;
+    uint64_t _bytesRead = 0;
+    std::string _pending;
+    std::string _copy;
+};
+
+// Via and, for a client's own request, X-Forwarded-For as configured
+RequestRewrite MakeRequestRewrite(const sockaddr_in* clientAddress)
+{
+    RequestRewrite rewrite;
+    if (!proxyConfig.viaName.empty())
+    {
+        rewrite.via = "1.1 " + proxyConfig.viaName;
+    }
+    if (clientAddress != nullptr && proxyConfig.forwardedFor)
+    {
+        char clientIp[INET_ADDRSTRLEN] = "";
+        inet_ntop(AF_INET, &clientAddress->sin_addr, clientIp, sizeof(clientIp));
+        rewrite.forwardedFor = clientIp;
+    }
+    return rewrite;
+}
+
+// Writes the request's access log line and totals however HandleClient exits
+class AccessLogScope
+{
+public:
+    explicit AccessLogScope(const ClientConnection& client) : _acceptedAt(client.acceptedAt)
+    {
+        entry.connectionId = client.id;
+        entry.clientIp = ntohl(client.address.sin_addr.s_addr);
+        CountConnectionOpened();
+    }
+
+    ~AccessLogScope()
+    {
+        entry.latency = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - _acceptedAt);
+        LogAccess(entry);
+        RecordStage(Stage::Total, entry.latency);
+        CountBytes(entry.bytesIn, entry.bytesOut);
+        CountConnectionClosed();
+        if (!hitterUrl.empty())
+        {
+            CountHitterBytes(hitterHost, hitterUrl, entry.bytesOut);
+        }
+    }
+
+    AccessLogScope(const AccessLogScope&) = delete;
+    AccessLogScope& operator=(const AccessLogScope&) = delete;
+
+    AccessLogEntry entry;
+
+    // Heavy-hitter keys the response bytes are charged to, once the request has been parsed
+    std::string hitterHost;
+    std::string hitterUrl;
+
+private:
+    std::chrono::steady_clock::time_point _acceptedAt;
+};
+
+// Answers the client with a proxy-generated error and closes its socket
+void FailRequest(
+    RequestReader& request,
+    AccessLogEntry& entry,
+    ErrorKind kind,
+    int status,
+    const char* reason)
+{
+    CountError(kind);
+    request.Drain();
+    SendErrorResponse(request.Socket(), status, reason);
+    entry.status = status;
+    entry.bytesIn = request.BytesRead();
+    shutdown(request.Socket(), SD_SEND);
+    request.CloseSocket();
+}
+
+// Holds the sender back while the client is over its bandwidth share
+void PaceClient(RateLimiter::ClientHandle rateLimit, size_t bytes)
+{
+    std::chrono::microseconds throttle = rateLimiter.ConsumeBytes(rateLimit, bytes);
+    if (throttle.count() > 0)
+    {
+        std::this_thread::sleep_for(throttle);
+    }
+}
+
+// Sends a reply built from the cache, paced like a relayed response
+void SendCachedReply(
+    SOCKET clientSocket,
+    const CachedReply& reply,
+    RateLimiter::ClientHandle rateLimit,
+    TcpWatch& clientTcp,
+    AccessLogEntry& entry)
+{
+    entry.status = reply.status;
+
+    // Compressed chunks are expanded one at a time as they come up, into a buffer kept while
+    // later slices still come from the same chunk
+    std::string expanded;
+    const BodyChunk* expandedChunk = nullptr;
+    size_t nextPacked = 0;
+    for (const auto& piece : reply.slices.Pieces())
+    {
+        const char* data = piece.first;
+        if (data == nullptr)
+        {
+            const PackedSlice& slice = reply.packed[nextPacked++];
+            if (slice.chunk != expandedChunk)
+            {
+                expandedChunk = slice.chunk;
+                if (!ExpandChunk(*slice.chunk, expanded))
+                {
+                    return;
+                }
+            }
+            data = expanded.data() + slice.offset;
+        }
+        for (size_t sent = 0; sent < piece.second;)
+        {
+            int chunk = static_cast<int>(std::min<size_t>(piece.second - sent, 16384));
+            if (send(clientSocket, data + sent, chunk, 0) == SOCKET_ERROR)
+            {
+                return;
+            }
+            sent += chunk;
+            entry.bytesOut += chunk;
+            PaceClient(rateLimit, chunk);
+            clientTcp.Poll();
+        }
+    }
+}
+
+// Answers the whole request from the cache and closes the client socket
+void ServeFromCache(
+    RequestReader& request,
+    const ClientConnection& client,
+    AccessLogEntry& entry,
+    const CachedReply& reply)
+{
+    request.Drain();
+    shutdown(request.Socket(), SD_RECEIVE);
+    entry.bytesIn = request.BytesRead();
+    TcpWatch clientTcp(
+        request.Socket(), TcpSide::Client, std::chrono::milliseconds(proxyConfig.tcpSampleMs));
+    SendCachedReply(request.Socket(), reply, client.rateLimit, clientTcp, entry);
+    entry.clientTcp = clientTcp.Finish();
+    shutdown(request.Socket(), SD_SEND);
+    request.CloseSocket();
+}
+
+// Stands a stale copy in for a failed upstream while its stale-if-error window allows
+bool ServeStaleOnError(
+    RequestReader& request,
+    const ClientConnection& client,
+    AccessLogEntry& entry,
+    const std::shared_ptr<const CachedResponse>& stale,
+    const std::string& requestHead,
+    ErrorKind kind)
+{
+    CachedReply reply;
+    if (stale == nullptr || !WithinStaleIfError(*stale, std::chrono::steady_clock::now()) ||
+        !BuildCachedReply(stale, requestHead, reply))
+    {
+        return false;
+    }
+    CountError(kind);
+    CountCacheResult(CacheResult::StaleIfError);
+    ServeFromCache(request, client, entry, reply);
+    return true;
+}
+
+// Revalidates a stale copy off the request path, while clients are served the stale copy.
+// Runs detached; the caller has claimed the key with BeginRefresh.
+void RefreshCachedResponse(
+    std::string key,
+    std::string conditionalRequest,
+    std::string host,
+    int port,
+    std::string path,
+    std::shared_ptr<const CachedResponse> cached)
+{
+    std::unique_ptr<BackendLease> backendLease;
+    AddressList resolved;
+    const addrinfo* addresses = nullptr;
+    if (RouteTable* routes = GetRouteTable())
+    {
+        const Route* route = routes->Match(host, path);
+        Backend* backend = route != nullptr ? route->pool->Select(host + path) : nullptr;
+        if (backend != nullptr)
+        {
+            backendLease = std::make_unique<BackendLease>(backend);
+            addresses = backend->addresses.get();
+        }
+    }
+    else
+    {
+        resolved = ResolveHost(host, port);
+        addresses = resolved.get();
+    }
+
+    // Read the whole answer, giving up once it can no longer fit in the cache
+    std::string response;
+    bool complete = false;
+    SOCKET webServerSocket = addresses != nullptr
+                                 ? ConnectHappyEyeballs(addresses, proxyConfig.connectTimeoutMs)
+                                 : INVALID_SOCKET;
+    SliceList request;
+    RewriteRequestHead(conditionalRequest, MakeRequestRewrite(nullptr), request);
+    if (webServerSocket != INVALID_SOCKET)
+    {
+        if (request.SendTo(webServerSocket))
+        {
+            shutdown(webServerSocket, SD_SEND);
+            std::vector<char> buffer(16384);
+            while (response.size() <= responseCache.GetSettings().maxEntryBytes)
+            {
+                int bytesReceived =
+                    recv(webServerSocket, buffer.data(), static_cast<int>(buffer.size()), 0);
+                if (bytesReceived <= 0)
+                {
+                    complete = bytesReceived == 0;
+                    break;
+                }
+                response.append(buffer.data(), bytesReceived);
+            }
+        }
+        shutdown(webServerSocket, SD_BOTH);
+        closesocket(webServerSocket);
+    }
+
+    // Failures leave the stale copy in place for the rest of its windows
+    int status = GetResponseStatus(response);
+    if (status == 304)
+    {
+        responseCache.Freshen(key, cached, response);
+    }
+    else if (complete && status == 200)
+    {
+        responseCache.Store(key, response);
+    }
+    responseCache.EndRefresh(key);
+}
+} // namespace
+
+void RefuseClient(SOCKET clientSocket, int statusCode, const char* reason, int retryAfterSeconds)
+{
+    std::string extraHeaders;
+    if (retryAfterSeconds > 0)
+    {
+        extraHeaders = "Retry-After: " + std::to_string(retryAfterSeconds) + "\r\n";
+    }
+    SendErrorResponse(clientSocket, statusCode, reason, extraHeaders);
+    shutdown(clientSocket, SD_SEND);
+
+    // Drain whatever part of the request already arrived so closing doesn't reset the
+    // connection before the client reads the response
+    ioctlsocket(clientSocket, FIONBIO, &nonBlocking);
+    std::vector<char> discard(4096);
+    while (recv(clientSocket, discard.data(), static_cast<int>(discard.size()), 0) > 0)
+    {
+    }
+    closesocket(clientSocket);
+}
+
+void HandleClient(ClientConnection client)
+{
+    SOCKET clientSocket = client.socket;
+    ApplyPlacement(client.placement);
+    ClientAdmission admission(rateLimiter, client.rateLimit);
+    MemoryAccount memory(memoryBudget, clientSocket);
+    AccessLogScope access(client);
+    RecordStage(
+        Stage::AcceptWait,
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - client.acceptedAt));
+
+    bool traced = ShouldTrace(client.id);
+
+    // Receive only as much of the request as routing needs, so resolving and connecting
+    // overlap with the rest of the upload instead of waiting for the client to finish
+    bool captured = IsCapturing();
+    StageTimer readTimer(Stage::RequestRead);
+    TraceSpan receiveSpan(traced, client.id, TracePhase::Receive);
+    RequestReader request(clientSocket, captured, memory);
+
+    // Under memory pressure turn the request away before buffering any of it
+    if (memoryBudget.GetLevel() >= ShedLevel::RejectRequests)
+    {
+        readTimer.Stop();
+        receiveSpan.Stop();
+        FailRequest(request, access.entry, ErrorKind::Overloaded, 503, "Service Unavailable");
+        return;
+    }
+    request.ReadHead();
+    const std::string& head = request.Head();
+    readTimer.Stop();
+    receiveSpan.Stop();
+    if (memory.Aborted())
+    {
+        request.CloseSocket();
+        return;
+    }
+
+    // Parse the HTTP request to get the host
+    TraceSpan parseSpan(traced, client.id, TracePhase::ParseHost);
+    std::string hostHeader = GetHostFromRequest(head);
+    if (hostHeader.empty())
+    {
+        HandleError("Host header not found in the request");
+        FailRequest(request, access.entry, ErrorKind::BadRequest, 400, "Host header required");
+        return;
+    }
+
+    std::string path = GetPathFromRequest(head);
+    access.entry.target = head.substr(0, head.find(' ')) + " " + hostHeader + path;
+    if (HeavyHittersEnabled())
+    {
+        access.hitterHost = hostHeader;
+        access.hitterUrl = hostHeader + path;
+        CountHitterRequest(access.hitterHost, access.hitterUrl);
+    }
+
+    std::string host;
+    int port = 80;
+    if (!SplitHostPort(hostHeader, host, port))
+    {
+        HandleError("Invalid Host header in the request");
+        FailRequest(request, access.entry, ErrorKind::BadRequest, 400, "Invalid Host header");
+        return;
+    }
+
+    // Blocked requests are refused before the cache or any upstream sees them
+    std::shared_ptr<const Blocklist> blocklist = GetBlocklist();
+    if (blocklist != nullptr && blocklist->Match(host, path) != nullptr)
+    {
+        FailRequest(request, access.entry, ErrorKind::Blocked, 403, "Blocked by proxy policy");
+        return;
+    }
+
+    // GET responses may come from the cache, which needs every header to decide. A stale copy
+    // is kept through the upstream exchange to revalidate it or stand in for a failure, along
+    // with the request head, since forwarding consumes it.
+    std::string cacheKey;
+    std::string cacheHead;
+    std::shared_ptr<const CachedResponse> cached;
+    if (responseCache.IsEnabled() && head.compare(0, 4, "GET ") == 0)
+    {
+        request.ReadHeaders();
+        size_t headEnd = head.find("\r\n\r\n");
+        if (headEnd != std::string::npos && RequestCacheable(head))
+        {
+            cacheKey = hostHeader + path;
+            cacheHead = head.substr(0, headEnd + 4);
+            cached = responseCache.Lookup(cacheKey);
+        }
+    }
+    if (cached != nullptr)
+    {
+        CacheState state = GetCacheState(*cached, std::chrono::steady_clock::now());
+        if (RequestForcesRevalidation(cacheHead))
+        {
+            state = CacheState::Stale;
+        }
+        CachedReply reply;
+        if (state != CacheState::Stale && BuildCachedReply(cached, cacheHead, reply))
+        {
+            if (state == CacheState::StaleWhileRevalidate && responseCache.BeginRefresh(cacheKey))
+            {
+                std::thread(
+                    RefreshCachedResponse,
+                    cacheKey,
+                    MakeConditionalRequest(cacheHead, *cached),
+                    host,
+                    port,
+                    path,
+                    cached)
+                    .detach();
+            }
+            parseSpan.Stop();
+            CountCacheResult(
+                state == CacheState::Fresh ? CacheResult::Hit : CacheResult::StaleHit);
+            ServeFromCache(request, client, access.entry, reply);
+            return;
+        }
+
+        // Ranges a partial object lacks are fetched as asked and merged in, not revalidated
+        if (!cached->IsComplete())
+        {
+            cached = nullptr;
+        }
+    }
+
+    // A miss goes to a sibling cache when one has the object or owns it, unless a sibling sent
+    // the request, so requests never loop between siblings
+    Peer* peer = nullptr;
+    if (!cacheKey.empty() && cached == nullptr && PeersEnabled() && !IsPeerRequest(cacheHead))
+    {
+        peer = ChoosePeer(cacheKey);
+    }
+
+    // In reverse-proxy mode the route table picks the backend instead of the Host header
+    std::unique_ptr<BackendLease> backendLease;
+    std::string upstreamName;
+    AddressList resolved;
+    const addrinfo* webServerAddresses = nullptr;
+    OriginTicket originTicket;
+    ConcurrencyPermit permit;
+    SOCKET webServerSocket = INVALID_SOCKET;
+
+    // A sibling that answered the lookup can still refuse the connection, overloaded or
+    // restarting; the request then takes the usual route, as though no sibling had the object
+    while (true)
+    {
+        upstreamName = host + ":" + std::to_string(port);
+        if (peer != nullptr)
+        {
+            upstreamName = peer->name;
+            webServerAddresses = peer->addresses.get();
+            parseSpan.Stop();
+        }
+        else if (RouteTable* routes = GetRouteTable())
+        {
+            const Route* route = routes->Match(host, path);
+            if (route == nullptr)
+            {
+                FailRequest(
+                    request, access.entry, ErrorKind::NoRoute, 404, "No route for request");
+                return;
+            }
+
+            Backend* backend = route->pool->Select(host + path);
+            if (backend == nullptr)
+            {
+                if (!ServeStaleOnError(
+                        request, client, access.entry, cached, cacheHead, ErrorKind::NoBackend))
+                {
+                    FailRequest(
+                        request,
+                        access.entry,
+                        ErrorKind::NoBackend,
+                        503,
+                        "No healthy backend available");
+                }
+                return;
+            }
+
+            backendLease = std::make_unique<BackendLease>(backend);
+            upstreamName = backend->host + ":" + std::to_string(backend->port);
+            webServerAddresses = backend->addresses.get();
+            parseSpan.Stop();
+        }
+        else
+        {
+            parseSpan.Stop();
+
+            // Resolve every IPv6 and IPv4 address of the host; literals resolve to themselves
+            StageTimer dnsTimer(Stage::Dns);
+            TraceSpan resolveSpan(traced, client.id, TracePhase::Resolve);
+            resolved = ResolveHost(host, port);
+            dnsTimer.Stop();
+            resolveSpan.Stop();
+            if (resolved == nullptr)
+            {
+                HandleError("getaddrinfo failed");
+                if (!ServeStaleOnError(
+                        request, client, access.entry, cached, cacheHead, ErrorKind::Resolve))
+                {
+                    FailRequest(
+                        request, access.entry, ErrorKind::Resolve, 502, "Unable to resolve host");
+                }
+                return;
+            }
+            webServerAddresses = resolved.get();
+        }
+
+        // Wait for a connection slot to the upstream, taking turns with requests queued for
+        // others
+        originTicket = originScheduler.Acquire(upstreamName);
+        if (!originTicket)
+        {
+            if (!ServeStaleOnError(
+                    request,
+                    client,
+                    access.entry,
+                    cached,
+                    cacheHead,
+                    ErrorKind::OriginQueueTimeout))
+            {
+                FailRequest(
+                    request,
+                    access.entry,
+                    ErrorKind::OriginQueueTimeout,
+                    503,
+                    "Timed out waiting for the upstream");
+            }
+            return;
+        }
+
+        // Keep the requests in flight to each upstream under its adaptive limit, waiting briefly
+        // for one to finish when it is reached
+        permit = concurrencyLimiter.Acquire(upstreamName);
+        if (!permit)
+        {
+            if (!ServeStaleOnError(
+                    request,
+                    client,
+                    access.entry,
+                    cached,
+                    cacheHead,
+                    ErrorKind::ConcurrencyLimited))
+            {
+                FailRequest(
+                    request,
+                    access.entry,
+                    ErrorKind::ConcurrencyLimited,
+                    503,
+                    "Upstream at its concurrency limit");
+            }
+            return;
+        }
+
+        // Race connections to the web server's addresses so one dead address can't stall the
+        // request
+        StageTimer connectTimer(Stage::Connect);
+        TraceSpan connectSpan(traced, client.id, TracePhase::Connect);
+        webServerSocket = ConnectHappyEyeballs(webServerAddresses, proxyConfig.connectTimeoutMs);
+        connectTimer.Stop();
+        connectSpan.Stop();
+        if (webServerSocket != INVALID_SOCKET)
+        {
+            break;
+        }
+        HandleError("Connect to web server failed");
+        permit.Drop();
+        if (peer != nullptr)
+        {
+            peer->connectFailures.fetch_add(1, std::memory_order_relaxed);
+            permit = ConcurrencyPermit();
+            originTicket = OriginTicket();
+            peer = nullptr;
+            continue;
+        }
+        if (!ServeStaleOnError(
+                request, client, access.entry, cached, cacheHead, ErrorKind::Connect))
+        {
+            FailRequest(
+                request, access.entry, ErrorKind::Connect, 502, "Unable to connect to host");
+        }
+        return;
+    }
+
+    // Send what has arrived so far, then stream the rest of the request as the client sends it.
+    // A stale copy is revalidated instead, so an unchanged resource costs the origin a 304. The
+    // upload is paced by the client, so it doesn't count toward the upstream's latency.
+    permit.PauseTiming();
+    TraceSpan uploadSpan(traced, client.id, TracePhase::Upload);
+    RequestRewrite rewrite = MakeRequestRewrite(&client.address);
+    if (peer != nullptr)
+    {
+        rewrite.peer = proxyConfig.peers.selfName;
+    }
+    bool sent = false;
+    if (cached != nullptr)
+    {
+        std::string conditionalRequest = MakeConditionalRequest(cacheHead, *cached);
+        request.Drain();
+        SliceList conditionalHead;
+        RewriteRequestHead(conditionalRequest, rewrite, conditionalHead);
+        sent = conditionalHead.SendTo(webServerSocket);
+    }
+    else
+    {
+        sent = request.ForwardTo(webServerSocket, rewrite);
+    }
+    if (!sent && memory.Aborted())
+    {
+        closesocket(webServerSocket);
+        request.CloseSocket();
+        return;
+    }
+    if (!sent)
+    {
+        HandleError("Send to web server failed");
+        permit.Drop();
+        closesocket(webServerSocket);
+        if (!ServeStaleOnError(
+                request, client, access.entry, cached, cacheHead, ErrorKind::UpstreamSend))
+        {
+            FailRequest(
+                request,
+                access.entry,
+                ErrorKind::UpstreamSend,
+                502,
+                "Unable to send request to host");
+        }
+        return;
+    }
+    uploadSpan.Stop();
+    permit.ResumeTiming();
+
+    // A sibling, like this proxy, takes the request to be over once its sender half-closes
+    if (peer != nullptr)
+    {
+        shutdown(webServerSocket, SD_SEND);
+    }
+
+    // Shutdown the client socket for receiving
+    shutdown(clientSocket, SD_RECEIVE);
+    access.entry.bytesIn = request.BytesRead();
+    if (captured)
+    {
+        CaptureRequest(client.id, client.acceptedAt, request.Copy());
+    }
+    StageTimer firstByteTimer(Stage::FirstByte);
+
+    // Both connections' TCP state is sampled through a long relay and again as it ends
+    std::chrono::milliseconds tcpSampleInterval(proxyConfig.tcpSampleMs);
+    TcpWatch clientTcp(clientSocket, TcpSide::Client, tcpSampleInterval);
+    TcpWatch upstreamTcp(webServerSocket, TcpSide::Upstream, tcpSampleInterval);
+
+    // The relay span encloses the first-byte span, so traces show the wait nested inside it
+    TraceSpan relaySpan(traced, client.id, TracePhase::Relay);
+    TraceSpan firstByteSpan(traced, client.id, TracePhase::FirstByte);
+
+    // Forward the response from the web server to the client. A cacheable response is also
+    // collected as it streams past, as long as it fits in an entry.
+    RelayBuffer buffer(client.placement.node);
+    int bytesReceived = 0;
+    std::string fill;
+    bool filling = !cacheKey.empty() && (cached != nullptr || responseCache.Admits(cacheKey));
+    bool servedFromCache = false;
+    RelayFlow flow;
+    std::string responseHead;
+    bool headComplete = false;
+
+    while (true)
+    {
+        bytesReceived =
+            recv(webServerSocket, buffer.data(), static_cast<int>(buffer.size()) - 1, 0);
+        if (bytesReceived == SOCKET_ERROR)
+        {
+            // If the socket is non-blocking and there is no data to receive, sleep for a bit
+            int error = WSAGetLastError();
+            if (error == WSAEWOULDBLOCK)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            else
+            {
+                HandleError("recv from web server failed");
+                CountError(ErrorKind::UpstreamReceive);
+                permit.Drop();
+                filling = false;
+                if (cached != nullptr && access.entry.bytesOut == 0 &&
+                    WithinStaleIfError(*cached, std::chrono::steady_clock::now()))
+                {
+                    CountCacheResult(CacheResult::StaleIfError);
+                    servedFromCache = true;
+                }
+                break;
+            }
+        }
+
+        // A response cut off inside its head is still passed on as far as it got
+        if (bytesReceived == 0 && (headComplete || responseHead.empty()))
+        {
+            break;
+        }
+        firstByteTimer.Stop();
+        firstByteSpan.Stop();
+
+        // Nothing is relayed until the whole head has arrived, so the status and the headers
+        // acted on below are never read from a fragment of it
+        const char* data = buffer.data();
+        int size = bytesReceived;
+        if (!headComplete)
+        {
+            responseHead.append(buffer.data(), bytesReceived);
+            if (bytesReceived > 0 && responseHead.find("\r\n\r\n") == std::string::npos &&
+                responseHead.size() < maxResponseHead)
+            {
+                continue;
+            }
+            headComplete = true;
+            data = responseHead.data();
+            size = static_cast<int>(responseHead.size());
+            access.entry.status = GetResponseStatus(responseHead);
+
+            // An upstream shedding load answers quickly, which mustn't read as spare capacity
+            if (access.entry.status == 503 || access.entry.status == 504)
+            {
+                permit.Drop();
+            }
+            permit.Complete();
+
+            // Revalidating: a 304 confirms the stored copy, and a 5xx falls back to it while
+            // its stale-if-error window allows
+            if (cached != nullptr)
+            {
+                // A 304 whose head never finished still confirms the copy, but only a whole
+                // one may change its freshness
+                size_t headEnd = responseHead.find("\r\n\r\n");
+                if (access.entry.status == 304)
+                {
+                    if (headEnd != std::string::npos)
+                    {
+                        cached = responseCache.Freshen(
+                            cacheKey, cached, responseHead.substr(0, headEnd + 4));
+                    }
+                    CountCacheResult(CacheResult::Revalidated);
+                    servedFromCache = true;
+                }
+                else if (
+                    access.entry.status >= 500 &&
+                    WithinStaleIfError(*cached, std::chrono::steady_clock::now()))
+                {
+                    CountCacheResult(CacheResult::StaleIfError);
+                    servedFromCache = true;
+                }
+                if (servedFromCache)
+                {
+                    filling = false;
+                    break;
+                }
+            }
+
+            // A response that announces its length is scheduled by what it has left to send
+            if (relayScheduler.IsEnabled())
+            {
+                flow.totalBytes = GetResponseLength(responseHead);
+            }
+        }
+
+        relayScheduler.Wait(flow, size);
+        send(clientSocket, data, size, 0);
+        access.entry.bytesOut += size;
+        if (captured)
+        {
+            CaptureResponse(client.id, data, size);
+        }
+        if (filling)
+        {
+            filling = fill.size() + size <= responseCache.GetSettings().maxEntryBytes &&
+                      memory.Charge(size);
+            if (filling)
+            {
+                fill.append(data, size);
+            }
+            else
+            {
+                memory.Release(fill.size());
+                std::string().swap(fill);
+            }
+        }
+
+        // The client socket of an aborted connection is already shut down, and the body
+        // collected so far is incomplete
+        if (memory.Aborted())
+        {
+            filling = false;
+            break;
+        }
+        PaceClient(client.rateLimit, size);
+        clientTcp.Poll();
+        upstreamTcp.Poll();
+    }
+
+    if (servedFromCache)
+    {
+        CachedReply reply;
+        BuildCachedReply(cached, cacheHead, reply);
+        SendCachedReply(clientSocket, reply, client.rateLimit, clientTcp, access.entry);
+    }
+
+    firstByteSpan.Stop();
+    relaySpan.Stop();
+    if (filling)
+    {
+        responseCache.Store(cacheKey, fill);
+    }
+    if (!cacheKey.empty() && !servedFromCache)
+    {
+        CountCacheResult(CacheResult::Miss);
+    }
+
+    // Close sockets
+    TraceSpan closeSpan(traced, client.id, TracePhase::Close);
+    access.entry.clientTcp = clientTcp.Finish();
+    access.entry.upstreamTcp = upstreamTcp.Finish();
+    shutdown(webServerSocket, SD_BOTH);
+    closesocket(webServerSocket);
+    shutdown(clientSocket, SD_SEND);
+    request.CloseSocket();
+    if (captured)
+    {
+        CaptureClose(client.id);
+    }
+}
@@ -0,0 +1,34 @@
+﻿/*****************************************************************
+ * @file   HttpProxy.h
+ * @brief  Per-client request handling for the HTTP proxy server.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include "NetworkUtils.h"
+#include "Placement.h"
+#include "RateLimiter.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Everything the accept loop hands over to a client thread
+struct ClientConnection
+{
+    uint64_t id = 0; // Sequential per accepted connection, for correlating logs
+    SOCKET socket = INVALID_SOCKET;
+    sockaddr_in address = {};
+    std::chrono::steady_clock::time_point acceptedAt;
+    RateLimiter::ClientHandle rateLimit = nullptr;
+    SocketPlacement placement;
+};
+
+// Answers a client with an error before any thread is spent on it, then closes the socket
+void RefuseClient(SOCKET clientSocket, int statusCode, const char* reason, int retryAfterSeconds);
+
+// Runs on its own thread for every accepted client and closes the client socket when done
+void HandleClient(ClientConnection client);
@@ -0,0 +1,172 @@
+﻿/*****************************************************************
+ * @file   MemoryBudget.cpp
+ * @brief  Global and per-connection accounting of buffered request
+ * and response bytes, shedding load in stages as the budget fills.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "MemoryBudget.h"
+#include "Metrics.h"
+
+MemoryBudget memoryBudget;
+
+namespace
+{
+const size_t maxAccounts = 4096; // Connections beyond this are counted but never aborted
+
+// Shares of the budget at which each stage starts, in percent
+const int stopAcceptingPercent = 80;
+const int rejectRequestsPercent = 90;
+} // namespace
+
+MemoryBudget::MemoryBudget() : _slots(maxAccounts)
+{
+}
+
+void MemoryBudget::Configure(const MemorySettings& settings)
+{
+    _settings = settings;
+}
+
+size_t MemoryBudget::GetUsed() const
+{
+    int64_t used = _used.load(std::memory_order_relaxed);
+    return used > 0 ? static_cast<size_t>(used) : 0;
+}
+
+ShedLevel MemoryBudget::GetLevel() const
+{
+    if (!IsEnabled())
+    {
+        return ShedLevel::None;
+    }
+    size_t used = GetUsed();
+    if (used > _settings.budgetBytes)
+    {
+        return ShedLevel::AbortLargest;
+    }
+    if (used * 100 >= _settings.budgetBytes * rejectRequestsPercent)
+    {
+        return ShedLevel::RejectRequests;
+    }
+    if (used * 100 >= _settings.budgetBytes * stopAcceptingPercent)
+    {
+        return ShedLevel::StopAccepting;
+    }
+    return ShedLevel::None;
+}
+
+MemoryBudget::Slot* MemoryBudget::Open(SOCKET socket)
+{
+    if (!IsEnabled())
+    {
+        return nullptr;
+    }
+    Slot* slot = _slots.Acquire();
+    if (slot != nullptr)
+    {
+        slot->bytes.store(0, std::memory_order_relaxed);
+        slot->aborted.store(false, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(slot->socketLock);
+        slot->socket = socket;
+    }
+    return slot;
+}
+
+void MemoryBudget::Close(Slot* slot)
+{
+    if (slot == nullptr)
+    {
+        return;
+    }
+
+    // An aborted slot's bytes left the total when it was aborted, and what the owner released
+    // since then was taken off twice; both leave the slot's balance to settle here
+    _used.fetch_sub(slot->bytes.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+    DetachSocket(slot);
+    _slots.Release(slot);
+}
+
+void MemoryBudget::DetachSocket(Slot* slot)
+{
+    if (slot != nullptr)
+    {
+        std::lock_guard<std::mutex> lock(slot->socketLock);
+        slot->socket = INVALID_SOCKET;
+    }
+}
+
+bool MemoryBudget::Charge(Slot* slot, size_t bytes)
+{
+    if (!IsEnabled())
+    {
+        return true;
+    }
+    if (slot != nullptr && slot->aborted.load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+
+    int64_t delta = static_cast<int64_t>(bytes);
+    if (slot != nullptr)
+    {
+        slot->bytes.fetch_add(delta, std::memory_order_relaxed);
+    }
+    int64_t used = _used.fetch_add(delta, std::memory_order_relaxed) + delta;
+    if (used > static_cast<int64_t>(_settings.budgetBytes))
+    {
+        AbortLargest();
+    }
+    return slot == nullptr || !slot->aborted.load(std::memory_order_relaxed);
+}
+
+void MemoryBudget::Release(Slot* slot, size_t bytes)
+{
+    if (!IsEnabled())
+    {
+        return;
+    }
+    int64_t delta = static_cast<int64_t>(bytes);
+    if (slot != nullptr)
+    {
+        slot->bytes.fetch_sub(delta, std::memory_order_relaxed);
+    }
+    _used.fetch_sub(delta, std::memory_order_relaxed);
+}
+
+void MemoryBudget::AbortLargest()
+{
+    Slot* largest = nullptr;
+    int64_t largestBytes = 0;
+    _slots.ForEach([&](Slot& slot) {
+        int64_t bytes = slot.bytes.load(std::memory_order_relaxed);
+        if (bytes > largestBytes && !slot.aborted.load(std::memory_order_relaxed))
+        {
+            largest = &slot;
+            largestBytes = bytes;
+        }
+    });
+
+    // Losing the race to another thread aborting the same connection frees the same bytes
+    bool expected = false;
+    if (largest == nullptr ||
+        !largest->aborted.compare_exchange_strong(expected, true, std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    // Its memory counts as freed right away, so the next charge doesn't abort another
+    // connection while this one is still unwinding. Shutting the socket down wakes its thread
+    // from any blocking call.
+    int64_t freed = largest->bytes.exchange(0, std::memory_order_relaxed);
+    _used.fetch_sub(freed, std::memory_order_relaxed);
+    CountError(ErrorKind::MemoryAborted);
+    std::lock_guard<std::mutex> lock(largest->socketLock);
+    if (largest->socket != INVALID_SOCKET)
+    {
+        shutdown(largest->socket, SD_BOTH);
+    }
+}
@@ -0,0 +1,142 @@
+﻿/*****************************************************************
+ * @file   MemoryBudget.h
+ * @brief  Global and per-connection accounting of buffered request
+ * and response bytes, shedding load in stages as the budget fills.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include "PerThreadPool.h"
+#include <WinSock2.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+struct MemorySettings
+{
+    size_t budgetBytes = 0; // Bytes all connections may buffer together; 0 disables shedding
+};
+
+// Each stage includes the ones before it
+enum class ShedLevel
+{
+    None,
+    StopAccepting,  // From 80% of the budget new connections wait in the listen backlog
+    RejectRequests, // From 90% requests on accepted connections are answered with a 503
+    AbortLargest,   // Over budget the connections buffering the most are cut off
+};
+
+// Counts what connections buffer: request heads, uploads kept for capture and responses
+// collected for the cache. Fixed per-connection buffers and the cache itself (which has its
+// own capacity) are not counted.
+class MemoryBudget
+{
+public:
+    struct Slot
+    {
+        std::atomic<int64_t> bytes{0};
+        std::atomic<bool> aborted{false};
+
+        // An abort shuts the socket down while holding the lock, and the owner detaches it
+        // under the lock before closing it, so a handle Winsock has reused is never touched
+        std::mutex socketLock;
+        SOCKET socket = INVALID_SOCKET;
+    };
+
+    MemoryBudget();
+
+    void Configure(const MemorySettings& settings);
+
+    bool IsEnabled() const
+    {
+        return _settings.budgetBytes > 0;
+    }
+
+    size_t GetBudget() const
+    {
+        return _settings.budgetBytes;
+    }
+
+    // Buffered bytes, less those of connections already aborted but not yet closed
+    size_t GetUsed() const;
+
+    ShedLevel GetLevel() const;
+
+    // Called when a connection starts; nullptr when shedding is disabled or every slot is taken
+    Slot* Open(SOCKET socket);
+
+    // Returns what the connection still has charged
+    void Close(Slot* slot);
+
+    // The connection's socket is about to close; waits out an abort shutting it down, and any
+    // later abort only stops the connection's charges
+    void DetachSocket(Slot* slot);
+
+    // False once the connection has been aborted to free memory; its socket is already shut
+    // down and it should give up. Going over budget aborts the largest connection.
+    bool Charge(Slot* slot, size_t bytes);
+
+    void Release(Slot* slot, size_t bytes);
+
+    bool IsAborted(const Slot* slot) const
+    {
+        return slot != nullptr && slot->aborted.load(std::memory_order_relaxed);
+    }
+
+private:
+    void AbortLargest();
+
+    MemorySettings _settings;
+    std::atomic<int64_t> _used{0};
+    PerThreadPool<Slot> _slots;
+};
+
+// A connection's share of the budget, handed back however the connection ends
+class MemoryAccount
+{
+public:
+    MemoryAccount(MemoryBudget& budget, SOCKET socket) : _budget(budget), _slot(budget.Open(socket))
+    {
+    }
+
+    ~MemoryAccount()
+    {
+        _budget.Close(_slot);
+    }
+
+    MemoryAccount(const MemoryAccount&) = delete;
+    MemoryAccount& operator=(const MemoryAccount&) = delete;
+
+    bool Charge(size_t bytes)
+    {
+        return _budget.Charge(_slot, bytes);
+    }
+
+    void Release(size_t bytes)
+    {
+        _budget.Release(_slot, bytes);
+    }
+
+    bool Aborted() const
+    {
+        return _budget.IsAborted(_slot);
+    }
+
+    // Call before closing the socket; charges may still follow
+    void DetachSocket()
+    {
+        _budget.DetachSocket(_slot);
+    }
+
+private:
+    MemoryBudget& _budget;
+    MemoryBudget::Slot* _slot;
+};
+
+// Configured by main before any client thread starts
+extern MemoryBudget memoryBudget;
@@ -0,0 +1,470 @@
+﻿/*****************************************************************
+ * @file   Metrics.cpp
+ * @brief  Per-stage latency histograms and counters for the proxy,
+ * recorded per thread and merged when scraped.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "Metrics.h"
+#include "Histogram.h"
+#include "MemoryBudget.h"
+#include "PerThreadPool.h"
+#include "ResponseCache.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+
+namespace
+{
+const size_t stageCount = static_cast<size_t>(Stage::Count);
+const size_t errorKindCount = static_cast<size_t>(ErrorKind::Count);
+const size_t cacheResultCount = static_cast<size_t>(CacheResult::Count);
+const size_t tcpSideCount = static_cast<size_t>(TcpSide::Count);
+const size_t sendLimitCount = 3;
+
+const char* const stageNames[stageCount] =
+    {"accept_wait", "request_read", "dns", "connect", "first_byte", "total"};
+
+const char* const errorKindNames[errorKindCount] = {
+    "bad_request",
+    "no_route",
+    "no_backend",
+    "resolve",
+    "connect",
+    "upstream_send",
+    "upstream_receive",
+    "rate_limited",
+    "overloaded",
+    "memory_aborted",
+    "concurrency_limited",
+    "origin_queue_timeout",
+    "blocked"};
+
+const char* const cacheResultNames[cacheResultCount] =
+    {"hit", "stale_hit", "revalidated", "stale_if_error", "miss"};
+
+const char* const tcpSideNames[tcpSideCount] = {"client", "upstream"};
+
+// What held a sender back: the peer's receive window, the congestion window, or itself
+const char* const sendLimitNames[sendLimitCount] = {"receiver", "congestion", "sender"};
+
+// Bucket bounds exported to Prometheus, in microseconds; the HDR buckets are finer than this
+const uint64_t exportedBoundsUs[] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000,
+    2500000, 5000000, 10000000};
+
+const double exportedQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+// Everything one thread records. Only the owning thread writes (apart from the shared
+// overflow block), so the atomic adds never contend.
+struct MetricsBlock
+{
+    Histogram stages[stageCount];
+    std::atomic<uint64_t> bytesIn{0};
+    std::atomic<uint64_t> bytesOut{0};
+    std::atomic<uint64_t> errors[errorKindCount] = {};
+    std::atomic<uint64_t> cacheResults[cacheResultCount] = {};
+    std::atomic<uint64_t> connectionsOpened{0};
+    std::atomic<uint64_t> connectionsClosed{0};
+    Histogram tcpRtt[tcpSideCount];
+    Histogram tcpDeliveryRate[tcpSideCount];
+    std::atomic<uint64_t> tcpConnections[tcpSideCount] = {};
+    std::atomic<uint64_t> tcpBytesSent[tcpSideCount] = {};
+    std::atomic<uint64_t> tcpBytesRetransmitted[tcpSideCount] = {};
+    std::atomic<uint64_t> tcpTimeoutEpisodes[tcpSideCount] = {};
+    std::atomic<uint64_t> tcpSendLimitedMs[tcpSideCount][sendLimitCount] = {};
+};
+
+struct ThreadMetrics
+{
+    std::atomic<MetricsBlock*> block{nullptr}; // Allocated by the first owner, never freed
+};
+
+PerThreadPool<ThreadMetrics> threadMetrics(1024);
+MetricsBlock overflowBlock; // Shared by threads that find the pool exhausted
+
+MetricsBlock& LocalBlock()
+{
+    thread_local PerThreadEntry<ThreadMetrics> entry(threadMetrics);
+    ThreadMetrics* slot = entry.get();
+    if (slot == nullptr)
+    {
+        return overflowBlock;
+    }
+
+    MetricsBlock* block = slot->block.load(std::memory_order_acquire);
+    if (block == nullptr)
+    {
+        block = new MetricsBlock();
+        slot->block.store(block, std::memory_order_release);
+    }
+    return *block;
+}
+
+template <typename Visitor>
+void ForEachBlock(Visitor visitor)
+{
+    threadMetrics.ForEach([&](ThreadMetrics& slot) {
+        MetricsBlock* block = slot.block.load(std::memory_order_acquire);
+        if (block != nullptr)
+        {
+            visitor(*block);
+        }
+    });
+    visitor(overflowBlock);
+}
+
+void AppendLine(std::string& out, const char* format, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    out += buffer;
+}
+
+// Cumulative buckets, sum and count of a histogram recorded in microseconds, in seconds
+void AppendSecondsHistogram(
+    std::string& out,
+    const char* name,
+    const char* label,
+    const char* labelValue,
+    const HistogramSnapshot& snapshot)
+{
+    for (uint64_t bound : exportedBoundsUs)
+    {
+        AppendLine(
+            out,
+            "%s_bucket{%s=\"%s\",le=\"%g\"} %llu\n",
+            name,
+            label,
+            labelValue,
+            bound / 1e6,
+            static_cast<unsigned long long>(snapshot.CountAtOrBelow(bound)));
+    }
+    AppendLine(
+        out,
+        "%s_bucket{%s=\"%s\",le=\"+Inf\"} %llu\n",
+        name,
+        label,
+        labelValue,
+        static_cast<unsigned long long>(snapshot.totalCount));
+    AppendLine(out, "%s_sum{%s=\"%s\"} %.6f\n", name, label, labelValue, snapshot.sum / 1e6);
+    AppendLine(
+        out,
+        "%s_count{%s=\"%s\"} %llu\n",
+        name,
+        label,
+        labelValue,
+        static_cast<unsigned long long>(snapshot.totalCount));
+}
+} // namespace
+
+void RecordStage(Stage stage, std::chrono::microseconds duration)
+{
+    LocalBlock().stages[static_cast<size_t>(stage)].Record(
+        static_cast<uint64_t>(std::max<long long>(duration.count(), 0)));
+}
+
+void CountBytes(uint64_t bytesIn, uint64_t bytesOut)
+{
+    MetricsBlock& block = LocalBlock();
+    block.bytesIn.fetch_add(bytesIn, std::memory_order_relaxed);
+    block.bytesOut.fetch_add(bytesOut, std::memory_order_relaxed);
+}
+
+void CountError(ErrorKind kind)
+{
+    LocalBlock().errors[static_cast<size_t>(kind)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void CountCacheResult(CacheResult result)
+{
+    LocalBlock().cacheResults[static_cast<size_t>(result)].fetch_add(
+        1, std::memory_order_relaxed);
+}
+
+void CountConnectionOpened()
+{
+    LocalBlock().connectionsOpened.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CountConnectionClosed()
+{
+    LocalBlock().connectionsClosed.fetch_add(1, std::memory_order_relaxed);
+}
+
+void RecordTcpSample(TcpSide side, const TcpSample& sample, uint64_t deliveryBytesPerSecond)
+{
+    MetricsBlock& block = LocalBlock();
+    size_t index = static_cast<size_t>(side);
+    block.tcpRtt[index].Record(sample.rttUs);
+    if (deliveryBytesPerSecond > 0)
+    {
+        block.tcpDeliveryRate[index].Record(deliveryBytesPerSecond);
+    }
+}
+
+void CountTcpConnection(TcpSide side, const TcpSample& sample)
+{
+    MetricsBlock& block = LocalBlock();
+    size_t index = static_cast<size_t>(side);
+    block.tcpConnections[index].fetch_add(1, std::memory_order_relaxed);
+    block.tcpBytesSent[index].fetch_add(sample.bytesSent, std::memory_order_relaxed);
+    block.tcpBytesRetransmitted[index].fetch_add(
+        sample.bytesRetransmitted, std::memory_order_relaxed);
+    block.tcpTimeoutEpisodes[index].fetch_add(sample.timeoutEpisodes, std::memory_order_relaxed);
+    const uint64_t limitedMs[sendLimitCount] = {
+        sample.receiverLimitedMs, sample.congestionLimitedMs, sample.senderLimitedMs};
+    for (size_t i = 0; i < sendLimitCount; ++i)
+    {
+        block.tcpSendLimitedMs[index][i].fetch_add(limitedMs[i], std::memory_order_relaxed);
+    }
+}
+
+std::string EscapeLabel(const std::string& value)
+{
+    std::string escaped;
+    for (char c : value)
+    {
+        if (c == '\\' || c == '"')
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (c == '\n')
+        {
+            escaped += "\\n";
+        }
+        else
+        {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+std::string RenderMetrics()
+{
+    HistogramSnapshot stages[stageCount];
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    uint64_t errors[errorKindCount] = {};
+    uint64_t cacheResults[cacheResultCount] = {};
+    uint64_t opened = 0;
+    uint64_t closed = 0;
+    HistogramSnapshot tcpRtt[tcpSideCount];
+    HistogramSnapshot tcpDeliveryRate[tcpSideCount];
+    uint64_t tcpConnections[tcpSideCount] = {};
+    uint64_t tcpBytesSent[tcpSideCount] = {};
+    uint64_t tcpBytesRetransmitted[tcpSideCount] = {};
+    uint64_t tcpTimeoutEpisodes[tcpSideCount] = {};
+    uint64_t tcpSendLimitedMs[tcpSideCount][sendLimitCount] = {};
+
+    ForEachBlock([&](const MetricsBlock& block) {
+        for (size_t i = 0; i < stageCount; ++i)
+        {
+            block.stages[i].AddTo(stages[i]);
+        }
+        bytesIn += block.bytesIn.load(std::memory_order_relaxed);
+        bytesOut += block.bytesOut.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < errorKindCount; ++i)
+        {
+            errors[i] += block.errors[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < cacheResultCount; ++i)
+        {
+            cacheResults[i] += block.cacheResults[i].load(std::memory_order_relaxed);
+        }
+        opened += block.connectionsOpened.load(std::memory_order_relaxed);
+        closed += block.connectionsClosed.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < tcpSideCount; ++i)
+        {
+            block.tcpRtt[i].AddTo(tcpRtt[i]);
+            block.tcpDeliveryRate[i].AddTo(tcpDeliveryRate[i]);
+            tcpConnections[i] += block.tcpConnections[i].load(std::memory_order_relaxed);
+            tcpBytesSent[i] += block.tcpBytesSent[i].load(std::memory_order_relaxed);
+            tcpBytesRetransmitted[i] +=
+                block.tcpBytesRetransmitted[i].load(std::memory_order_relaxed);
+            tcpTimeoutEpisodes[i] += block.tcpTimeoutEpisodes[i].load(std::memory_order_relaxed);
+            for (size_t j = 0; j < sendLimitCount; ++j)
+            {
+                tcpSendLimitedMs[i][j] +=
+                    block.tcpSendLimitedMs[i][j].load(std::memory_order_relaxed);
+            }
+        }
+    });
+
+    std::string out;
+    out += "# HELP proxy_stage_duration_seconds Time spent in each phase of a request.\n";
+    out += "# TYPE proxy_stage_duration_seconds histogram\n";
+    for (size_t i = 0; i < stageCount; ++i)
+    {
+        AppendSecondsHistogram(
+            out, "proxy_stage_duration_seconds", "stage", stageNames[i], stages[i]);
+    }
+
+    out += "# HELP proxy_stage_duration_quantile_seconds Quantiles from the full-resolution "
+           "histograms.\n";
+    out += "# TYPE proxy_stage_duration_quantile_seconds gauge\n";
+    for (size_t i = 0; i < stageCount; ++i)
+    {
+        for (double quantile : exportedQuantiles)
+        {
+            AppendLine(
+                out,
+                "proxy_stage_duration_quantile_seconds{stage=\"%s\",quantile=\"%g\"} %.6f\n",
+                stageNames[i],
+                quantile,
+                stages[i].ValueAtQuantile(quantile) / 1e6);
+        }
+    }
+
+    out += "# TYPE proxy_bytes_received_total counter\n";
+    AppendLine(
+        out, "proxy_bytes_received_total %llu\n", static_cast<unsigned long long>(bytesIn));
+    out += "# TYPE proxy_bytes_sent_total counter\n";
+    AppendLine(out, "proxy_bytes_sent_total %llu\n", static_cast<unsigned long long>(bytesOut));
+    out += "# TYPE proxy_connections_total counter\n";
+    AppendLine(out, "proxy_connections_total %llu\n", static_cast<unsigned long long>(opened));
+    out += "# TYPE proxy_connections_active gauge\n";
+    AppendLine(
+        out,
+        "proxy_connections_active %lld\n",
+        static_cast<long long>(opened) - static_cast<long long>(closed));
+    out += "# HELP proxy_buffered_bytes Request and response bytes held by connections.\n";
+    out += "# TYPE proxy_buffered_bytes gauge\n";
+    AppendLine(
+        out,
+        "proxy_buffered_bytes %llu\n",
+        static_cast<unsigned long long>(memoryBudget.GetUsed()));
+    out += "# HELP proxy_shed_level 0 normal, 1 not accepting, 2 rejecting, 3 aborting.\n";
+    out += "# TYPE proxy_shed_level gauge\n";
+    AppendLine(out, "proxy_shed_level %d\n", static_cast<int>(memoryBudget.GetLevel()));
+    out += "# TYPE proxy_errors_total counter\n";
+    for (size_t i = 0; i < errorKindCount; ++i)
+    {
+        AppendLine(
+            out,
+            "proxy_errors_total{kind=\"%s\"} %llu\n",
+            errorKindNames[i],
+            static_cast<unsigned long long>(errors[i]));
+    }
+    out += "# TYPE proxy_cache_requests_total counter\n";
+    for (size_t i = 0; i < cacheResultCount; ++i)
+    {
+        AppendLine(
+            out,
+            "proxy_cache_requests_total{result=\"%s\"} %llu\n",
+            cacheResultNames[i],
+            static_cast<unsigned long long>(cacheResults[i]));
+    }
+
+    // TCP_INFO samples of client and upstream sockets. A client side held back by its
+    // congestion window or retransmitting points at the network, by the receive window at a
+    // slow client, and by the sender at the proxy or its upstream.
+    out += "# HELP proxy_tcp_rtt_seconds Smoothed round-trip time of sampled sockets.\n";
+    out += "# TYPE proxy_tcp_rtt_seconds histogram\n";
+    for (size_t i = 0; i < tcpSideCount; ++i)
+    {
+        AppendSecondsHistogram(out, "proxy_tcp_rtt_seconds", "side", tcpSideNames[i], tcpRtt[i]);
+    }
+    out += "# HELP proxy_tcp_delivery_rate_bytes_per_second Response bytes delivered between "
+           "samples.\n";
+    out += "# TYPE proxy_tcp_delivery_rate_bytes_per_second gauge\n";
+    for (size_t i = 0; i < tcpSideCount; ++i)
+    {
+        for (double quantile : exportedQuantiles)
+        {
+            AppendLine(
+                out,
+                "proxy_tcp_delivery_rate_bytes_per_second{side=\"%s\",quantile=\"%g\"} %llu\n",
+                tcpSideNames[i],
+                quantile,
+                static_cast<unsigned long long>(tcpDeliveryRate[i].ValueAtQuantile(quantile)));
+        }
+    }
+    out += "# TYPE proxy_tcp_connections_sampled_total counter\n";
+    out += "# TYPE proxy_tcp_sent_bytes_total counter\n";
+    out += "# TYPE proxy_tcp_retransmitted_bytes_total counter\n";
+    out += "# TYPE proxy_tcp_timeout_episodes_total counter\n";
+    for (size_t i = 0; i < tcpSideCount; ++i)
+    {
+        AppendLine(
+            out,
+            "proxy_tcp_connections_sampled_total{side=\"%s\"} %llu\n",
+            tcpSideNames[i],
+            static_cast<unsigned long long>(tcpConnections[i]));
+        AppendLine(
+            out,
+            "proxy_tcp_sent_bytes_total{side=\"%s\"} %llu\n",
+            tcpSideNames[i],
+            static_cast<unsigned long long>(tcpBytesSent[i]));
+        AppendLine(
+            out,
+            "proxy_tcp_retransmitted_bytes_total{side=\"%s\"} %llu\n",
+            tcpSideNames[i],
+            static_cast<unsigned long long>(tcpBytesRetransmitted[i]));
+        AppendLine(
+            out,
+            "proxy_tcp_timeout_episodes_total{side=\"%s\"} %llu\n",
+            tcpSideNames[i],
+            static_cast<unsigned long long>(tcpTimeoutEpisodes[i]));
+    }
+    out += "# TYPE proxy_tcp_send_limited_seconds_total counter\n";
+    for (size_t i = 0; i < tcpSideCount; ++i)
+    {
+        for (size_t j = 0; j < sendLimitCount; ++j)
+        {
+            AppendLine(
+                out,
+                "proxy_tcp_send_limited_seconds_total{side=\"%s\",by=\"%s\"} %.3f\n",
+                tcpSideNames[i],
+                sendLimitNames[j],
+                tcpSendLimitedMs[i][j] / 1e3);
+        }
+    }
+
+    // Bodies the entries hold against the distinct chunks kept for them, before and after
+    // compression
+    CacheStats cache = responseCache.GetStats();
+    out += "# TYPE proxy_cache_entries gauge\n";
+    AppendLine(out, "proxy_cache_entries %llu\n", static_cast<unsigned long long>(cache.entries));
+    out += "# TYPE proxy_cache_stored_bytes gauge\n";
+    AppendLine(
+        out,
+        "proxy_cache_stored_bytes %llu\n",
+        static_cast<unsigned long long>(cache.storedBytes));
+    out += "# TYPE proxy_cache_body_bytes gauge\n";
+    AppendLine(
+        out,
+        "proxy_cache_body_bytes{kind=\"logical\"} %llu\n",
+        static_cast<unsigned long long>(cache.bodyBytes));
+    AppendLine(
+        out,
+        "proxy_cache_body_bytes{kind=\"distinct\"} %llu\n",
+        static_cast<unsigned long long>(cache.contentBytes));
+    AppendLine(
+        out,
+        "proxy_cache_body_bytes{kind=\"stored\"} %llu\n",
+        static_cast<unsigned long long>(cache.chunkBytes));
+    out += "# TYPE proxy_cache_dedup_ratio gauge\n";
+    AppendLine(
+        out,
+        "proxy_cache_dedup_ratio %.3f\n",
+        cache.contentBytes == 0 ? 1.0
+                                : static_cast<double>(cache.bodyBytes) / cache.contentBytes);
+    out += "# TYPE proxy_cache_compression_ratio gauge\n";
+    AppendLine(
+        out,
+        "proxy_cache_compression_ratio %.3f\n",
+        cache.chunkBytes == 0 ? 1.0
+                              : static_cast<double>(cache.contentBytes) / cache.chunkBytes);
+
+    return out;
+}
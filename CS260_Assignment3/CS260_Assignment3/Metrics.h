@@ -0,0 +1,114 @@
+﻿/*****************************************************************
+ * @file   Metrics.h
+ * @brief  Per-stage latency histograms and counters for the proxy,
+ * recorded per thread and merged when scraped.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include "TcpInfo.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+enum class Stage
+{
+    AcceptWait,  // Accepted until the client thread starts running
+    RequestRead, // Reading the request until it can be routed
+    Dns,         // Resolving the upstream host
+    Connect,     // Racing connections to the upstream
+    FirstByte,   // Request sent until the first response byte arrives
+    Total,       // Accepted until the client socket is closed
+    Count,
+};
+
+enum class ErrorKind
+{
+    BadRequest,
+    NoRoute,
+    NoBackend,
+    Resolve,
+    Connect,
+    UpstreamSend,
+    UpstreamReceive,
+    RateLimited,
+    Overloaded,         // Turned away with a 503 while memory was short
+    MemoryAborted,      // Cut off for buffering the most when memory ran out
+    ConcurrencyLimited, // Turned away because its upstream was at its concurrency limit
+    OriginQueueTimeout, // Waited too long for an upstream connection to its origin
+    Blocked,            // Refused by the blocklist
+    Count,
+};
+
+enum class CacheResult
+{
+    Hit,          // Fresh copy served
+    StaleHit,     // Stale copy served while a background refresh revalidates it
+    Revalidated,  // The origin answered 304 and the stored copy was served
+    StaleIfError, // Stale copy served because the origin failed
+    Miss,         // No usable copy; the origin's full response was relayed
+    Count,
+};
+
+void RecordStage(Stage stage, std::chrono::microseconds duration);
+
+void CountBytes(uint64_t bytesIn, uint64_t bytesOut);
+
+void CountError(ErrorKind kind);
+
+void CountCacheResult(CacheResult result);
+
+void CountConnectionOpened();
+
+void CountConnectionClosed();
+
+// One TCP_INFO reading of a socket, with the rate it delivered since the previous one
+// (0 when unknown)
+void RecordTcpSample(TcpSide side, const TcpSample& sample, uint64_t deliveryBytesPerSecond);
+
+// A socket's last reading as its request ends, whose totals cover the whole connection
+void CountTcpConnection(TcpSide side, const TcpSample& sample);
+
+// Merges every thread's recordings into Prometheus text exposition format
+std::string RenderMetrics();
+
+// Prometheus label values escape backslashes, quotes and newlines
+std::string EscapeLabel(const std::string& value);
+
+// Times one stage from construction until Stop (or destruction)
+class StageTimer
+{
+public:
+    explicit StageTimer(Stage stage) : _stage(stage), _start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~StageTimer()
+    {
+        Stop();
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+    void Stop()
+    {
+        if (!_stopped)
+        {
+            _stopped = true;
+            RecordStage(
+                _stage,
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - _start));
+        }
+    }
+
+private:
+    Stage _stage;
+    std::chrono::steady_clock::time_point _start;
+    bool _stopped = false;
+};
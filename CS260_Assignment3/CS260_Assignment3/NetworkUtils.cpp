@@ -0,0 +1,135 @@
+﻿/*****************************************************************
+ * @file   NetworkUtils.cpp
+ * @brief  Socket helpers shared by the proxy, its health checks and
+ * the admin endpoints.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "NetworkUtils.h"
+#include "AsyncLogger.h"
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+unsigned long nonBlocking = 1;
+unsigned long blocking = 0;
+
+void HandleError(const std::string& errorMessage)
+{
+    LogError(errorMessage.c_str(), WSAGetLastError());
+}
+
+SOCKET CreateSocket(int protocol, int family)
+{
+    return socket(family, protocol == IPPROTO_TCP ? SOCK_STREAM : SOCK_DGRAM, protocol);
+}
+
+int SetAddress(const char* address, int port, sockaddr_in& addr, bool useAny)
+{
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (useAny)
+    {
+        addr.sin_addr.s_addr = INADDR_ANY;
+        return 1;
+    }
+    return inet_pton(AF_INET, address, &addr.sin_addr);
+}
+
+bool SplitHostPort(const std::string& hostPort, std::string& host, int& port)
+{
+    // Bracketed IPv6 literals ("[::1]:8080") keep their colons inside the brackets
+    size_t colon = std::string::npos;
+    if (!hostPort.empty() && hostPort[0] == '[')
+    {
+        size_t close = hostPort.find(']');
+        if (close == std::string::npos)
+        {
+            return false;
+        }
+        host = hostPort.substr(1, close - 1);
+        if (close + 1 < hostPort.size() && hostPort[close + 1] == ':')
+        {
+            colon = close + 1;
+        }
+    }
+    else
+    {
+        colon = hostPort.rfind(':');
+        host = hostPort.substr(0, colon);
+    }
+
+    if (colon != std::string::npos)
+    {
+        try
+        {
+            port = std::stoi(hostPort.substr(colon + 1));
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+        if (port <= 0 || port > 65535)
+        {
+            return false;
+        }
+    }
+
+    return !host.empty();
+}
+
+void SendErrorResponse(
+    SOCKET socket,
+    int statusCode,
+    const char* reason,
+    const std::string& extraHeaders)
+{
+    std::string response = "HTTP/1.1 " + std::to_string(statusCode) + " " + reason +
+                           "\r\nContent-Type: text/plain\r\nContent-Length: " +
+                           std::to_string(strlen(reason) + 1) + "\r\n" + extraHeaders +
+                           "Connection: close\r\n\r\n" + reason + "\n";
+    send(socket, response.c_str(), static_cast<int>(response.size()), 0);
+}
+
+std::string ReceiveData(SOCKET socket)
+{
+    std::vector<char> buffer(4096);
+    std::ostringstream oss;
+    int bytesReceived = 0;
+
+    // Receive the entire HTTP request from the client
+    while (true)
+    {
+        bytesReceived = recv(socket, buffer.data(), static_cast<int>(buffer.size()) - 1, 0);
+        if (bytesReceived == SOCKET_ERROR)
+        {
+            // If the socket is non-blocking and there is no data to receive, sleep for a bit
+            int error = WSAGetLastError();
+            if (error == WSAEWOULDBLOCK)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            else
+            {
+                HandleError("recv failed");
+                return "";
+            }
+        }
+        else if (bytesReceived == 0)
+        {
+            break;
+        }
+        else
+        {
+            buffer[bytesReceived] = '\0'; // Null-terminate the received data
+            oss << buffer.data();
+        }
+    }
+
+    return oss.str();
+}
@@ -0,0 +1,39 @@
+﻿/*****************************************************************
+ * @file   NetworkUtils.h
+ * @brief  Socket helpers shared by the proxy, its health checks and
+ * the admin endpoints.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <WS2tcpip.h>
+#include <WinSock2.h>
+#include <string>
+
+extern unsigned long nonBlocking;
+extern unsigned long blocking;
+
+// Helper function to handle errors and print the error message and the error code
+void HandleError(const std::string& errorMessage);
+
+SOCKET CreateSocket(int protocol, int family = AF_INET);
+
+int SetAddress(const char* address, int port, sockaddr_in& addr, bool useAny = false);
+
+// Splits "host[:port]" into its parts, leaving port untouched when none is given
+bool SplitHostPort(const std::string& hostPort, std::string& host, int& port);
+
+// Sends a minimal HTTP error response that the proxy generated itself; extraHeaders must be
+// empty or complete "Name: value\r\n" lines
+void SendErrorResponse(
+    SOCKET socket,
+    int statusCode,
+    const char* reason,
+    const std::string& extraHeaders = "");
+
+// Reads until the peer shuts down its sending side
+std::string ReceiveData(SOCKET socket);
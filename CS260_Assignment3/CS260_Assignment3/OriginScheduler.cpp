@@ -0,0 +1,271 @@
+﻿/*****************************************************************
+ * @file   OriginScheduler.cpp
+ * @brief  Caps on upstream connections per origin and overall, with
+ * deficit round robin across the origins' waiting requests.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "OriginScheduler.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+
+OriginScheduler originScheduler;
+
+namespace
+{
+const size_t maxOrigins = 4096; // Origins beyond this share one queue
+const char* const overflowOrigin = "(other)";
+
+// Connection time, in ms, each waiting origin is credited per round
+const double quantumMs = 100;
+
+// Weight of each connection's hold time in its origin's average
+const double holdWeight = 0.2;
+} // namespace
+
+struct OriginScheduler::Waiter
+{
+    std::condition_variable wake;
+    bool granted = false;
+};
+
+struct OriginTicket::Origin
+{
+    int active = 0;
+    std::deque<OriginScheduler::Waiter*> queue;
+    bool inRing = false;
+    double deficitMs = 0;
+    double holdMs = 1; // Average connection hold time, the cost of each request
+
+    // Reported on /origins; requests that didn't queue count as waits of zero
+    double waitSeconds = 0;
+    uint64_t waits = 0;
+    uint64_t timeouts = 0;
+};
+
+OriginTicket::OriginTicket(OriginTicket&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+OriginTicket& OriginTicket::operator=(OriginTicket&& other) noexcept
+{
+    if (this != &other)
+    {
+        Release();
+        _scheduler = other._scheduler;
+        _origin = other._origin;
+        _granted = other._granted;
+        _grantedAt = other._grantedAt;
+        other._scheduler = nullptr;
+        other._granted = false;
+    }
+    return *this;
+}
+
+OriginTicket::~OriginTicket()
+{
+    Release();
+}
+
+void OriginTicket::Release()
+{
+    if (_scheduler == nullptr)
+    {
+        return;
+    }
+    _scheduler->Release(*_origin, std::chrono::steady_clock::now() - _grantedAt);
+    _scheduler = nullptr;
+}
+
+OriginScheduler::OriginScheduler() = default;
+
+OriginScheduler::~OriginScheduler() = default;
+
+void OriginScheduler::Configure(const OriginSettings& settings)
+{
+    _settings = settings;
+}
+
+OriginTicket OriginScheduler::Acquire(const std::string& origin)
+{
+    OriginTicket ticket;
+    if (!IsEnabled())
+    {
+        ticket._granted = true;
+        return ticket;
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> guard(_lock);
+    Origin& state = FindOrigin(origin);
+
+    // Nobody is ahead of this request and there is room, so it doesn't queue at all
+    if (state.queue.empty() && HasRoom(state))
+    {
+        ++state.active;
+        ++_active;
+        ++state.waits;
+    }
+    else
+    {
+        Waiter waiter;
+        state.queue.push_back(&waiter);
+        if (!state.inRing)
+        {
+            state.inRing = true;
+            _ring.push_back(&state);
+        }
+        Dispatch();
+
+        auto deadline = started + std::chrono::milliseconds(_settings.queueTimeoutMs);
+        waiter.wake.wait_until(guard, deadline, [&] { return waiter.granted; });
+        auto waited = std::chrono::steady_clock::now() - started;
+        state.waitSeconds += std::chrono::duration<double>(waited).count();
+        ++state.waits;
+        if (!waiter.granted)
+        {
+            state.queue.erase(std::find(state.queue.begin(), state.queue.end(), &waiter));
+            ++state.timeouts;
+            return ticket;
+        }
+    }
+
+    ticket._scheduler = this;
+    ticket._origin = &state;
+    ticket._granted = true;
+    ticket._grantedAt = std::chrono::steady_clock::now();
+    return ticket;
+}
+
+OriginScheduler::Origin& OriginScheduler::FindOrigin(const std::string& origin)
+{
+    auto found = _origins.find(origin);
+    if (found == _origins.end())
+    {
+        // Origins are never erased, so tickets and the ring can keep pointing at them
+        auto& slot = _origins[_origins.size() < maxOrigins ? origin : overflowOrigin];
+        if (slot == nullptr)
+        {
+            slot = std::make_unique<Origin>();
+        }
+        return *slot;
+    }
+    return *found->second;
+}
+
+bool OriginScheduler::HasRoom(const Origin& origin) const
+{
+    return (_settings.maxPerOrigin <= 0 || origin.active < _settings.maxPerOrigin) &&
+           (_settings.maxTotal <= 0 || _active < _settings.maxTotal);
+}
+
+void OriginScheduler::Grant(Origin& origin)
+{
+    Waiter* waiter = origin.queue.front();
+    origin.queue.pop_front();
+    ++origin.active;
+    ++_active;
+    waiter->granted = true;
+    waiter->wake.notify_one();
+}
+
+void OriginScheduler::Dispatch()
+{
+    // Origins at their own cap are passed over without credit; once every origin left in the
+    // ring has been passed over in a row, nothing more can go until a connection is released
+    size_t passed = 0;
+    while (!_ring.empty() && passed < _ring.size() &&
+           (_settings.maxTotal <= 0 || _active < _settings.maxTotal))
+    {
+        Origin* origin = _ring.front();
+        _ring.pop_front();
+        if (origin->queue.empty())
+        {
+            // Its waiters all timed out
+            origin->inRing = false;
+            origin->deficitMs = 0;
+            continue;
+        }
+        if (!HasRoom(*origin))
+        {
+            _ring.push_back(origin);
+            ++passed;
+            continue;
+        }
+
+        passed = 0;
+        origin->deficitMs += quantumMs;
+        while (!origin->queue.empty() && origin->deficitMs >= origin->holdMs && HasRoom(*origin))
+        {
+            origin->deficitMs -= origin->holdMs;
+            Grant(*origin);
+        }
+        if (origin->queue.empty())
+        {
+            origin->inRing = false;
+            origin->deficitMs = 0;
+        }
+        else
+        {
+            _ring.push_back(origin);
+        }
+    }
+}
+
+void OriginScheduler::Release(Origin& origin, std::chrono::steady_clock::duration held)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    --origin.active;
+    --_active;
+    double heldMs = std::chrono::duration<double, std::milli>(held).count();
+    origin.holdMs = std::max(1.0, origin.holdMs + holdWeight * (heldMs - origin.holdMs));
+    Dispatch();
+}
+
+std::string OriginScheduler::Render()
+{
+    struct Family
+    {
+        const char* name;
+        const char* type;
+        double (*value)(const Origin&);
+    };
+    static const Family families[] = {
+        {"proxy_origin_connections",
+         "gauge",
+         [](const Origin& o) { return static_cast<double>(o.active); }},
+        {"proxy_origin_queue_depth",
+         "gauge",
+         [](const Origin& o) { return static_cast<double>(o.queue.size()); }},
+        {"proxy_origin_hold_seconds", "gauge", [](const Origin& o) { return o.holdMs / 1000; }},
+        {"proxy_origin_queue_wait_seconds_total",
+         "counter",
+         [](const Origin& o) { return o.waitSeconds; }},
+        {"proxy_origin_queue_waits_total",
+         "counter",
+         [](const Origin& o) { return static_cast<double>(o.waits); }},
+        {"proxy_origin_queue_timeouts_total",
+         "counter",
+         [](const Origin& o) { return static_cast<double>(o.timeouts); }}};
+
+    std::lock_guard<std::mutex> guard(_lock);
+    std::string out;
+    for (const Family& family : families)
+    {
+        out += std::string("# TYPE ") + family.name + " " + family.type + "\n";
+        for (const auto& entry : _origins)
+        {
+            char value[32];
+            snprintf(value, sizeof(value), "} %.15g\n", family.value(*entry.second));
+            out += std::string(family.name) + "{origin=\"" + EscapeLabel(entry.first) + "\"" +
+                   value;
+        }
+    }
+    return out;
+}
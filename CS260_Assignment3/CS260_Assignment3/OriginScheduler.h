@@ -0,0 +1,107 @@
+﻿/*****************************************************************
+ * @file   OriginScheduler.h
+ * @brief  Caps on upstream connections per origin and overall, with
+ * deficit round robin across the origins' waiting requests.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct OriginSettings
+{
+    int maxPerOrigin = 0; // Upstream connections one origin may hold; 0 for no cap
+    int maxTotal = 0;     // Upstream connections across every origin; 0 for no cap
+    int queueTimeoutMs = 5000;
+
+    bool IsEnabled() const
+    {
+        return maxPerOrigin > 0 || maxTotal > 0;
+    }
+};
+
+class OriginScheduler;
+
+// One request's upstream connection slot, held until it goes out of scope
+class OriginTicket
+{
+public:
+    OriginTicket() = default;
+    OriginTicket(OriginTicket&& other) noexcept;
+    OriginTicket& operator=(OriginTicket&& other) noexcept;
+    ~OriginTicket();
+
+    OriginTicket(const OriginTicket&) = delete;
+    OriginTicket& operator=(const OriginTicket&) = delete;
+
+    // False when the request timed out in its origin's queue
+    explicit operator bool() const
+    {
+        return _granted;
+    }
+
+private:
+    friend class OriginScheduler;
+    struct Origin;
+
+    void Release();
+
+    OriginScheduler* _scheduler = nullptr; // Null when not holding a slot
+    Origin* _origin = nullptr;
+    bool _granted = false;
+    std::chrono::steady_clock::time_point _grantedAt;
+};
+
+// Requests over an origin's cap, or arriving while every connection is taken, wait in a queue
+// per origin. Freed connections go to the queues by deficit round robin, where each request
+// costs its origin's average connection hold time, so an origin that turns slow gets fewer
+// turns and the rest keep flowing.
+class OriginScheduler
+{
+public:
+    OriginScheduler();
+    ~OriginScheduler();
+
+    void Configure(const OriginSettings& settings);
+
+    bool IsEnabled() const
+    {
+        return _settings.IsEnabled();
+    }
+
+    // Waits up to the queue timeout for a slot. Always granted while no cap is set.
+    OriginTicket Acquire(const std::string& origin);
+
+    // Per-origin connections, queue depth and queue waits as Prometheus metrics
+    std::string Render();
+
+private:
+    friend class OriginTicket;
+    using Origin = OriginTicket::Origin;
+    struct Waiter;
+
+    Origin& FindOrigin(const std::string& origin);
+    bool HasRoom(const Origin& origin) const;
+    void Grant(Origin& origin);
+    void Dispatch();
+    void Release(Origin& origin, std::chrono::steady_clock::duration held);
+
+    OriginSettings _settings;
+    std::mutex _lock; // Guards everything below and every origin's state
+    std::unordered_map<std::string, std::unique_ptr<Origin>> _origins;
+    std::deque<Origin*> _ring; // Origins with waiting requests, in round robin order
+    int _active = 0;
+};
+
+// Configured by main before any client thread starts
+extern OriginScheduler originScheduler;
@@ -0,0 +1,431 @@
+﻿/*****************************************************************
+ * @file   Peering.cpp
+ * @brief  Sibling proxies sharing their caches: lookups over UDP and
+ * a consistent hash ring giving every object one owner.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "Peering.h"
+#include "Handover.h"
+#include "Hash.h"
+#include "HttpParser.h"
+#include "Metrics.h"
+#include "NetworkUtils.h"
+#include "ResponseCache.h"
+#include <WS2tcpip.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace
+{
+enum class Opcode : unsigned char
+{
+    Query = 1,
+    Hit = 2,
+    Miss = 3,
+};
+
+const unsigned char protocolVersion = 1;
+const size_t headerBytes = 8;
+const size_t maxDatagramBytes = 1472; // Fits one Ethernet frame; longer keys skip the siblings
+const int ringReplicas = 64;
+const int self = -1; // Ring entry for this instance
+
+struct Message
+{
+    Opcode opcode = Opcode::Query;
+    uint32_t request = 0;
+    std::string key;
+};
+
+PeerSettings peerSettings;
+std::vector<std::unique_ptr<Peer>> peers;
+std::vector<std::pair<uint64_t, int>> ring; // (point on the ring, index into peers or self)
+std::atomic<uint32_t> nextRequest{1};
+std::atomic<uint64_t> answeredHits{0};
+std::atomic<uint64_t> answeredMisses{0};
+
+std::string EncodeMessage(Opcode opcode, uint32_t request, const std::string& key)
+{
+    std::string datagram(headerBytes, '\0');
+    uint16_t length = htons(static_cast<uint16_t>(headerBytes + key.size()));
+    request = htonl(request);
+    datagram[0] = static_cast<char>(opcode);
+    datagram[1] = static_cast<char>(protocolVersion);
+    memcpy(&datagram[2], &length, sizeof(length));
+    memcpy(&datagram[4], &request, sizeof(request));
+    return datagram + key;
+}
+
+bool DecodeMessage(const char* datagram, size_t size, Message& message)
+{
+    uint16_t length = 0;
+    if (size < headerBytes)
+    {
+        return false;
+    }
+    memcpy(&length, datagram + 2, sizeof(length));
+    unsigned char opcode = static_cast<unsigned char>(datagram[0]);
+    if (opcode < 1 || opcode > 3 || static_cast<unsigned char>(datagram[1]) != protocolVersion ||
+        ntohs(length) != size)
+    {
+        return false;
+    }
+    message.opcode = static_cast<Opcode>(opcode);
+    memcpy(&message.request, datagram + 4, sizeof(message.request));
+    message.request = ntohl(message.request);
+    message.key.assign(datagram + headerBytes, size - headerBytes);
+    return true;
+}
+
+// Splits "host:port:queryPort" and resolves both ports of the sibling
+std::unique_ptr<Peer> ResolvePeer(const std::string& spec)
+{
+    size_t colon = spec.rfind(':');
+    std::string host;
+    int port = 0;
+    if (colon == std::string::npos || !SplitHostPort(spec.substr(0, colon), host, port) ||
+        port == 0)
+    {
+        return nullptr;
+    }
+    int queryPort = atoi(spec.c_str() + colon + 1);
+
+    auto peer = std::make_unique<Peer>();
+    peer->name = spec.substr(0, colon);
+    peer->addresses = ResolveHost(host, port);
+    if (peer->addresses == nullptr || queryPort <= 0)
+    {
+        return nullptr;
+    }
+
+    // Lookups go over IPv4 to the first such address
+    for (const addrinfo* address = peer->addresses.get(); address != nullptr;
+         address = address->ai_next)
+    {
+        if (address->ai_family == AF_INET)
+        {
+            memcpy(&peer->queryAddress, address->ai_addr, sizeof(peer->queryAddress));
+            peer->queryAddress.sin_port = htons(static_cast<u_short>(queryPort));
+            return peer;
+        }
+    }
+    return nullptr;
+}
+
+// The sibling owning the key, or nullptr when this instance does
+Peer* FindOwner(const std::string& key)
+{
+    uint64_t point = MixHash(HashString(key));
+    auto owner = std::lower_bound(ring.begin(), ring.end(), std::make_pair(point, self));
+    if (owner == ring.end())
+    {
+        owner = ring.begin();
+    }
+    return owner->second == self ? nullptr : peers[owner->second].get();
+}
+
+Peer* FindPeer(const sockaddr_in& address)
+{
+    for (const auto& peer : peers)
+    {
+        if (peer->queryAddress.sin_addr.s_addr == address.sin_addr.s_addr &&
+            peer->queryAddress.sin_port == address.sin_port)
+        {
+            return peer.get();
+        }
+    }
+    return nullptr;
+}
+
+// A sibling asking is served from the cache only while the copy is fresh, so say hit only then.
+// The query alone doesn't count as a use: only the fetch that may follow keeps the entry.
+bool HoldsFreshCopy(const std::string& key)
+{
+    std::shared_ptr<const CachedResponse> cached = responseCache.Peek(key);
+    return cached != nullptr && cached->IsComplete() &&
+           GetCacheState(*cached, std::chrono::steady_clock::now()) == CacheState::Fresh;
+}
+
+void ResponderLoop(SOCKET querySocket)
+{
+    std::vector<char> buffer(maxDatagramBytes);
+    while (true)
+    {
+        sockaddr_in from = {};
+        int fromSize = sizeof(from);
+        int received = recvfrom(
+            querySocket,
+            buffer.data(),
+            static_cast<int>(buffer.size()),
+            0,
+            reinterpret_cast<sockaddr*>(&from),
+            &fromSize);
+
+        // A successor process took the port, and closed this process's copy of it
+        if (received == SOCKET_ERROR && HandedOver())
+        {
+            return;
+        }
+
+        // Errors include the ICMP unreachable of an earlier answer; keep serving
+        Message message;
+        if (received == SOCKET_ERROR || !DecodeMessage(buffer.data(), received, message) ||
+            message.opcode != Opcode::Query)
+        {
+            continue;
+        }
+
+        bool hit = HoldsFreshCopy(message.key);
+        (hit ? answeredHits : answeredMisses).fetch_add(1, std::memory_order_relaxed);
+        std::string answer =
+            EncodeMessage(hit ? Opcode::Hit : Opcode::Miss, message.request, message.key);
+        sendto(
+            querySocket,
+            answer.data(),
+            static_cast<int>(answer.size()),
+            0,
+            reinterpret_cast<sockaddr*>(&from),
+            fromSize);
+    }
+}
+
+SOCKET BindQueryPort()
+{
+    SOCKET querySocket = CreateSocket(IPPROTO_UDP);
+    if (querySocket == INVALID_SOCKET)
+    {
+        HandleError("Peer socket creation failed");
+        return INVALID_SOCKET;
+    }
+
+    sockaddr_in queryAddr;
+    SetAddress("0.0.0.0", peerSettings.queryPort, queryAddr, true);
+    if (bind(querySocket, reinterpret_cast<sockaddr*>(&queryAddr), sizeof(queryAddr)) ==
+        SOCKET_ERROR)
+    {
+        HandleError("Peer bind failed");
+        closesocket(querySocket);
+        return INVALID_SOCKET;
+    }
+    return querySocket;
+}
+} // namespace
+
+bool ConfigurePeers(const PeerSettings& settings)
+{
+    peerSettings = settings;
+    for (const std::string& spec : settings.peers)
+    {
+        std::unique_ptr<Peer> peer = ResolvePeer(spec);
+        if (peer == nullptr)
+        {
+            HandleError("Unable to resolve sibling " + spec);
+            return false;
+        }
+        peers.push_back(std::move(peer));
+    }
+
+    // Every instance builds the same ring from the same names, so they agree on owners
+    uint64_t base = HashString(settings.selfName);
+    for (int replica = 0; replica < ringReplicas; ++replica)
+    {
+        ring.emplace_back(MixHash(base + replica), self);
+    }
+    for (size_t i = 0; i < peers.size(); ++i)
+    {
+        base = HashString(peers[i]->name);
+        for (int replica = 0; replica < ringReplicas; ++replica)
+        {
+            ring.emplace_back(MixHash(base + replica), static_cast<int>(i));
+        }
+    }
+    std::sort(ring.begin(), ring.end());
+    return true;
+}
+
+bool PeersEnabled()
+{
+    return !peers.empty();
+}
+
+bool StartPeerResponder()
+{
+    // A socket taken over from a predecessor is already bound
+    SOCKET querySocket = InheritedSocket(HandoverRole::Peer);
+    if (querySocket == INVALID_SOCKET)
+    {
+        querySocket = BindQueryPort();
+        if (querySocket == INVALID_SOCKET)
+        {
+            return false;
+        }
+    }
+
+    OfferForHandover(HandoverRole::Peer, querySocket);
+    std::thread(ResponderLoop, querySocket).detach();
+    return true;
+}
+
+Peer* ChoosePeer(const std::string& key)
+{
+    if (headerBytes + key.size() > maxDatagramBytes)
+    {
+        return nullptr;
+    }
+    SOCKET querySocket = CreateSocket(IPPROTO_UDP);
+    if (querySocket == INVALID_SOCKET)
+    {
+        return nullptr;
+    }
+
+    uint32_t request = nextRequest.fetch_add(1, std::memory_order_relaxed);
+    std::string query = EncodeMessage(Opcode::Query, request, key);
+    for (const auto& peer : peers)
+    {
+        sendto(
+            querySocket,
+            query.data(),
+            static_cast<int>(query.size()),
+            0,
+            reinterpret_cast<const sockaddr*>(&peer->queryAddress),
+            sizeof(peer->queryAddress));
+        peer->queries.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Collect answers until one is a hit, every sibling has answered or time runs out
+    Peer* owner = FindOwner(key);
+    Peer* hit = nullptr;
+    bool ownerAnswered = false;
+    std::vector<Peer*> answered;
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(peerSettings.queryTimeoutMs);
+    std::vector<char> buffer(maxDatagramBytes);
+    while (hit == nullptr && answered.size() < peers.size())
+    {
+        long long waitUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                               deadline - std::chrono::steady_clock::now())
+                               .count();
+        if (waitUs <= 0)
+        {
+            break;
+        }
+        timeval timeout = {
+            static_cast<long>(waitUs / 1000000), static_cast<long>(waitUs % 1000000)};
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(querySocket, &readSet);
+        if (select(static_cast<int>(querySocket) + 1, &readSet, nullptr, nullptr, &timeout) <= 0)
+        {
+            break;
+        }
+
+        sockaddr_in from = {};
+        int fromSize = sizeof(from);
+        int received = recvfrom(
+            querySocket,
+            buffer.data(),
+            static_cast<int>(buffer.size()),
+            0,
+            reinterpret_cast<sockaddr*>(&from),
+            &fromSize);
+        Message message;
+        Peer* peer = FindPeer(from);
+        if (received == SOCKET_ERROR || peer == nullptr ||
+            !DecodeMessage(buffer.data(), received, message) || message.request != request ||
+            message.key != key || message.opcode == Opcode::Query ||
+            std::find(answered.begin(), answered.end(), peer) != answered.end())
+        {
+            continue;
+        }
+        answered.push_back(peer);
+        if (message.opcode == Opcode::Hit)
+        {
+            peer->hits.fetch_add(1, std::memory_order_relaxed);
+            hit = peer;
+        }
+        else
+        {
+            peer->misses.fetch_add(1, std::memory_order_relaxed);
+            ownerAnswered = ownerAnswered || peer == owner;
+        }
+    }
+    closesocket(querySocket);
+
+    if (hit == nullptr)
+    {
+        for (const auto& peer : peers)
+        {
+            if (std::find(answered.begin(), answered.end(), peer.get()) == answered.end())
+            {
+                peer->timeouts.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    Peer* chosen = hit != nullptr ? hit : (ownerAnswered ? owner : nullptr);
+    if (chosen != nullptr)
+    {
+        chosen->fetches.fetch_add(1, std::memory_order_relaxed);
+    }
+    return chosen;
+}
+
+bool IsPeerRequest(const std::string& requestHead)
+{
+    return !GetHeaderValue(requestHead, "X-Proxy-Peer").empty();
+}
+
+std::string RenderPeers()
+{
+    struct Family
+    {
+        const char* name;
+        const char* label; // Extra label, or nullptr
+        std::atomic<uint64_t> Peer::*value;
+    };
+    static const Family families[] = {
+        {"proxy_peer_queries_total", nullptr, &Peer::queries},
+        {"proxy_peer_answers_total", "answer=\"hit\"", &Peer::hits},
+        {"proxy_peer_answers_total", "answer=\"miss\"", &Peer::misses},
+        {"proxy_peer_answers_total", "answer=\"timeout\"", &Peer::timeouts},
+        {"proxy_peer_fetches_total", nullptr, &Peer::fetches},
+        {"proxy_peer_connect_failures_total", nullptr, &Peer::connectFailures}};
+
+    std::string out;
+    const char* previous = "";
+    for (const Family& family : families)
+    {
+        if (strcmp(family.name, previous) != 0)
+        {
+            out += std::string("# TYPE ") + family.name + " counter\n";
+            previous = family.name;
+        }
+        for (const auto& peer : peers)
+        {
+            char value[32];
+            snprintf(
+                value,
+                sizeof(value),
+                "} %llu\n",
+                static_cast<unsigned long long>((*peer.*family.value).load()));
+            out += std::string(family.name) + "{peer=\"" + EscapeLabel(peer->name) + "\"" +
+                   (family.label != nullptr ? std::string(",") + family.label : "") + value;
+        }
+    }
+
+    out += "# TYPE proxy_peer_lookups_answered_total counter\n";
+    out += "proxy_peer_lookups_answered_total{answer=\"hit\"} " +
+           std::to_string(answeredHits.load()) + "\n";
+    out += "proxy_peer_lookups_answered_total{answer=\"miss\"} " +
+           std::to_string(answeredMisses.load()) + "\n";
+    return out;
+}
@@ -0,0 +1,69 @@
+﻿/*****************************************************************
+ * @file   Peering.h
+ * @brief  Sibling proxies sharing their caches: lookups over UDP and
+ * a consistent hash ring giving every object one owner.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *
+ * Lookup datagram, in the manner of ICP, integers in network byte order:
+ *   opcode    1 byte   1 query, 2 hit, 3 miss
+ *   version   1 byte   1
+ *   length    2 bytes  of the whole datagram
+ *   request   4 bytes  chosen by the querier and echoed in the answer
+ *   key       the rest: host and path, as the cache keys the object
+ *****************************************************************/
+
+#pragma once
+
+#include "HappyEyeballs.h"
+#include <WinSock2.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct PeerSettings
+{
+    int queryPort = 0;              // UDP port answering siblings' lookups; 0 disables peering
+    std::string selfName;           // This instance as its siblings list it, host:port
+    std::vector<std::string> peers; // Siblings as host:port:queryPort
+    int queryTimeoutMs = 20;        // How long a miss waits for the siblings' answers
+};
+
+struct Peer
+{
+    std::string name;      // host:port, which places it on the ring
+    AddressList addresses; // Its proxy port, for fetching
+    sockaddr_in queryAddress = {};
+
+    std::atomic<uint64_t> queries{0};
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> timeouts{0};
+    std::atomic<uint64_t> fetches{0};
+    std::atomic<uint64_t> connectFailures{0}; // Fetches that fell back to the origin
+};
+
+// Resolves the siblings and builds the ring over them and this instance; false if a sibling
+// can't be resolved
+bool ConfigurePeers(const PeerSettings& settings);
+
+bool PeersEnabled();
+
+// Answers siblings' lookups from the response cache on a background thread; false if the query
+// port can't be bound
+bool StartPeerResponder();
+
+// Asks every sibling about a key missing from the cache. The first to hold a fresh copy serves
+// it; failing that the key's owner fetches it, when that is a sibling that answered, so the
+// fleet goes to the origin for each object once. nullptr means fetch from the origin directly.
+Peer* ChoosePeer(const std::string& key);
+
+// Whether a sibling sent the request, which is then never passed on to another
+bool IsPeerRequest(const std::string& requestHead);
+
+// Per-sibling lookup answers, fetches and failed connections, and lookups answered, as
+// Prometheus counters
+std::string RenderPeers();
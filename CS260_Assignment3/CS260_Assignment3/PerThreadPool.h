@@ -0,0 +1,115 @@
+﻿/*****************************************************************
+ * @file   PerThreadPool.h
+ * @brief  Fixed pool of objects that client threads claim for their
+ * lifetime, so hot-path state is never shared between writers.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Client threads are short-lived, so rather than one object per thread ever created the pool
+// hands out a bounded set of entries that are recycled as threads exit. Entries keep their
+// contents across owners, which lets a reader (a log drainer, a metrics scrape) walk every
+// entry without caring which thread owns it right now.
+template <typename T>
+class PerThreadPool
+{
+public:
+    explicit PerThreadPool(size_t capacity)
+        : _entries(std::make_unique<Entry[]>(capacity)), _capacity(capacity)
+    {
+    }
+
+    // Claims a free entry without locking; nullptr once every entry is in use
+    T* Acquire()
+    {
+        for (size_t i = 0; i < _capacity; ++i)
+        {
+            bool expected = false;
+            if (!_entries[i].claimed.load(std::memory_order_relaxed) &&
+                _entries[i].claimed.compare_exchange_strong(
+                    expected, true, std::memory_order_acquire))
+            {
+                // Publish how far readers need to look
+                size_t used = _used.load(std::memory_order_relaxed);
+                while (used < i + 1 &&
+                       !_used.compare_exchange_weak(used, i + 1, std::memory_order_release))
+                {
+                }
+                return &_entries[i].value;
+            }
+        }
+        return nullptr;
+    }
+
+    void Release(T* value)
+    {
+        for (size_t i = 0; i < _capacity; ++i)
+        {
+            if (&_entries[i].value == value)
+            {
+                _entries[i].claimed.store(false, std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+    // Visits every entry that has ever been claimed, owned or not
+    template <typename Visitor>
+    void ForEach(Visitor visitor)
+    {
+        size_t used = _used.load(std::memory_order_acquire);
+        for (size_t i = 0; i < used; ++i)
+        {
+            visitor(_entries[i].value);
+        }
+    }
+
+private:
+    struct Entry
+    {
+        std::atomic<bool> claimed{false};
+        T value;
+    };
+
+    std::unique_ptr<Entry[]> _entries;
+    size_t _capacity;
+    std::atomic<size_t> _used{0};
+};
+
+// Thread-local owner of one pool entry, returned to the pool when the thread exits
+template <typename T>
+class PerThreadEntry
+{
+public:
+    explicit PerThreadEntry(PerThreadPool<T>& pool) : _pool(pool), _value(pool.Acquire())
+    {
+    }
+
+    ~PerThreadEntry()
+    {
+        if (_value != nullptr)
+        {
+            _pool.Release(_value);
+        }
+    }
+
+    PerThreadEntry(const PerThreadEntry&) = delete;
+    PerThreadEntry& operator=(const PerThreadEntry&) = delete;
+
+    T* get() const
+    {
+        return _value;
+    }
+
+private:
+    PerThreadPool<T>& _pool;
+    T* _value;
+};
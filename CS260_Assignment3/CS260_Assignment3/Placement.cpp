@@ -0,0 +1,196 @@
+﻿/*****************************************************************
+ * @file   Placement.cpp
+ * @brief  Pins client threads near the processor that receives their
+ * connection's packets and keeps relay buffers on that NUMA node.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "Placement.h"
+#include <mstcpip.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+// Allocation granularity on Windows, so a slab wastes no address space
+const size_t slabBytes = 65536;
+
+struct Processor
+{
+    WORD group;
+    BYTE number;
+    int node;
+};
+
+// Relay buffers returned by finished connections, ready for the next one on the same node.
+// Slabs are kept for the life of the process, so a list grows to the node's peak concurrency.
+struct NodePool
+{
+    std::mutex lock;
+    std::vector<char*> free;
+};
+
+PlacementPolicy placementPolicy = PlacementPolicy::None;
+std::vector<Processor> processors;
+std::vector<GROUP_AFFINITY> nodeAffinity; // Indexed by node; a zero mask for a node not found
+std::unique_ptr<NodePool[]> nodePools;
+std::atomic<size_t> nextProcessor{0};
+} // namespace
+
+bool ParsePlacementPolicy(const std::string& text, PlacementPolicy& policy)
+{
+    if (text == "none")
+    {
+        policy = PlacementPolicy::None;
+    }
+    else if (text == "core")
+    {
+        policy = PlacementPolicy::Core;
+    }
+    else if (text == "node")
+    {
+        policy = PlacementPolicy::Node;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+void ConfigurePlacement(PlacementPolicy policy)
+{
+    placementPolicy = policy;
+    if (policy == PlacementPolicy::None || !nodeAffinity.empty())
+    {
+        return;
+    }
+
+    ULONG highestNode = 0;
+    GetNumaHighestNodeNumber(&highestNode);
+    nodeAffinity.assign(highestNode + 1, GROUP_AFFINITY{});
+    for (ULONG node = 0; node <= highestNode; ++node)
+    {
+        GROUP_AFFINITY affinity = {};
+        if (!GetNumaNodeProcessorMaskEx(static_cast<USHORT>(node), &affinity))
+        {
+            continue;
+        }
+        nodeAffinity[node] = affinity;
+        for (BYTE number = 0; number < sizeof(KAFFINITY) * 8; ++number)
+        {
+            if ((affinity.Mask & (static_cast<KAFFINITY>(1) << number)) != 0)
+            {
+                processors.push_back({affinity.Group, number, static_cast<int>(node)});
+            }
+        }
+    }
+    nodePools = std::make_unique<NodePool[]>(nodeAffinity.size());
+}
+
+SocketPlacement PlaceConnection(SOCKET socket)
+{
+    SocketPlacement placement;
+    if (placementPolicy == PlacementPolicy::None || processors.empty())
+    {
+        return placement;
+    }
+
+    SOCKET_PROCESSOR_AFFINITY affinity = {};
+    DWORD bytesReturned = 0;
+    if (WSAIoctl(
+            socket,
+            SIO_QUERY_RSS_PROCESSOR_INFO,
+            nullptr,
+            0,
+            &affinity,
+            sizeof(affinity),
+            &bytesReturned,
+            nullptr,
+            nullptr) == 0 &&
+        affinity.NumaNodeId < nodeAffinity.size() && nodeAffinity[affinity.NumaNodeId].Mask != 0)
+    {
+        placement.group = affinity.Processor.Group;
+        placement.processor = affinity.Processor.Number;
+        placement.node = affinity.NumaNodeId;
+    }
+    else
+    {
+        const Processor& processor = processors[nextProcessor++ % processors.size()];
+        placement.group = processor.group;
+        placement.processor = processor.number;
+        placement.node = processor.node;
+    }
+    placement.placed = true;
+    return placement;
+}
+
+void ApplyPlacement(const SocketPlacement& placement)
+{
+    if (!placement.placed)
+    {
+        return;
+    }
+
+    GROUP_AFFINITY affinity = {};
+    if (placementPolicy == PlacementPolicy::Core)
+    {
+        affinity.Group = placement.group;
+        affinity.Mask = static_cast<KAFFINITY>(1) << placement.processor;
+    }
+    else
+    {
+        affinity = nodeAffinity[placement.node];
+    }
+    SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr);
+}
+
+RelayBuffer::RelayBuffer(int node) : _node(node), _data(nullptr)
+{
+    if (_node >= 0)
+    {
+        NodePool& pool = nodePools[_node];
+        std::lock_guard<std::mutex> guard(pool.lock);
+        if (pool.free.empty())
+        {
+            char* slab = static_cast<char*>(VirtualAllocExNuma(
+                GetCurrentProcess(),
+                nullptr,
+                slabBytes,
+                MEM_RESERVE | MEM_COMMIT,
+                PAGE_READWRITE,
+                static_cast<DWORD>(_node)));
+            for (size_t offset = 0; slab != nullptr && offset < slabBytes; offset += bufferBytes)
+            {
+                pool.free.push_back(slab + offset);
+            }
+        }
+        if (!pool.free.empty())
+        {
+            _data = pool.free.back();
+            pool.free.pop_back();
+            return;
+        }
+    }
+
+    // Unplaced, or the node is out of memory
+    _node = -1;
+    _data = new char[bufferBytes];
+}
+
+RelayBuffer::~RelayBuffer()
+{
+    if (_node < 0)
+    {
+        delete[] _data;
+        return;
+    }
+    NodePool& pool = nodePools[_node];
+    std::lock_guard<std::mutex> guard(pool.lock);
+    pool.free.push_back(_data);
+}
@@ -0,0 +1,73 @@
+﻿/*****************************************************************
+ * @file   Placement.h
+ * @brief  Pins client threads near the processor that receives their
+ * connection's packets and keeps relay buffers on that NUMA node.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <WinSock2.h>
+#include <cstddef>
+#include <string>
+
+enum class PlacementPolicy
+{
+    None, // Threads float wherever the scheduler puts them
+    Core, // A connection's thread runs only on the processor that receives its packets
+    Node, // A connection's thread runs on any processor of that processor's NUMA node
+};
+
+// Where a connection's thread and buffers belong, worked out on the accept thread
+struct SocketPlacement
+{
+    bool placed = false;
+    WORD group = 0; // Processor group, and the processor's number within it
+    BYTE processor = 0;
+    int node = -1; // NUMA node for the relay buffer; -1 allocates from the default heap
+};
+
+// "none", "core" or "node"
+bool ParsePlacementPolicy(const std::string& text, PlacementPolicy& policy);
+
+// Sets the policy, reading the machine's processors and NUMA nodes the first time one needs
+// them; call before any client thread starts
+void ConfigurePlacement(PlacementPolicy policy);
+
+// Uses the receive-side scaling processor of an accepted socket. Sockets without one (loopback,
+// NICs without RSS) are spread round-robin over every processor instead.
+SocketPlacement PlaceConnection(SOCKET socket);
+
+// Restricts the calling thread to the placement's processor or node
+void ApplyPlacement(const SocketPlacement& placement);
+
+// Fixed-size relay buffer taken from a per-node free list. Buffers are carved from slabs
+// allocated on their node, so the pages a thread relays through stay local to it.
+class RelayBuffer
+{
+public:
+    static const size_t bufferBytes = 4096;
+
+    explicit RelayBuffer(int node);
+    ~RelayBuffer();
+
+    RelayBuffer(const RelayBuffer&) = delete;
+    RelayBuffer& operator=(const RelayBuffer&) = delete;
+
+    char* data() const
+    {
+        return _data;
+    }
+
+    size_t size() const
+    {
+        return bufferBytes;
+    }
+
+private:
+    int _node;
+    char* _data;
+};
@@ -0,0 +1,304 @@
+﻿/*****************************************************************
+ * @file   ProxyConfig.cpp
+ * @brief  Command line options for the HTTP proxy server.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "ProxyConfig.h"
+#include <iostream>
+#include <stdexcept>
+
+ProxyConfig proxyConfig;
+
+void PrintUsage(const char* program)
+{
+    std::cerr << "Usage: " << program << " <port> [options]\n"
+              << "  --routes <file>               Reverse proxy using the given route table\n"
+              << "  --connect-timeout-ms <n>      Give up connecting upstream after n ms\n"
+              << "  --log-file <file>             Write the error log here instead of stderr\n"
+              << "  --access-log <file>           Write one line per request to this file\n"
+              << "  --rate-limit-rps <n>          Requests per second allowed per client IP\n"
+              << "  --rate-limit-burst <n>        Requests a client may burst above its rate\n"
+              << "  --rate-limit-bps <n>          Response bytes per second per client IP\n"
+              << "  --max-client-connections <n>  Concurrent connections per client IP\n"
+              << "  --memory-budget-mb <n>        Shed load as buffered requests near n MB\n"
+              << "  --adaptive-concurrency <0|1>  Limit requests per upstream by its latency\n"
+              << "  --max-concurrency <n>         Highest limit an upstream can reach\n"
+              << "  --concurrency-queue-ms <n>    Wait up to n ms for room under the limit\n"
+              << "  --origin-max-connections <n>  Upstream connections per origin\n"
+              << "  --max-upstream <n>            Upstream connections across all origins\n"
+              << "  --origin-queue-ms <n>         Wait up to n ms for an upstream connection\n"
+              << "  --relay-bps <n>               Share n bytes/sec of outbound bandwidth\n"
+              << "  --relay-policy <fifo|srpt>    Order relays by arrival or least remaining\n"
+              << "  --blocklist <file>            Refuse hosts and URLs listed in this file\n"
+              << "  --blocklist-reload <s>        Check the blocklist for changes every s seconds\n"
+              << "  --cache-mb <n>                Cache up to n MB of GET responses in memory\n"
+              << "  --cache-entry-kb <n>          Largest response the cache stores, in KB\n"
+              << "  --stale-while-revalidate <s>  Serve stale up to s seconds while refreshing\n"
+              << "  --stale-if-error <s>          Serve stale up to s seconds if the origin fails\n"
+              << "  --cache-admit-after <n>       Cache a URL once seen n times (needs --topk)\n"
+              << "  --cache-compress <0|1>        Hold cached bodies compressed in memory\n"
+              << "  --peer-port <port>            Answer sibling cache lookups on this UDP port\n"
+              << "  --peer <host:port:udpPort>    Consult this sibling on a miss (repeatable)\n"
+              << "  --peer-name <host:port>       This proxy as its siblings list it\n"
+              << "  --peer-timeout-ms <n>         Wait up to n ms for the siblings' answers\n"
+              << "  --via <name>                  Pseudonym added to Via (default cs260-proxy)\n"
+              << "  --forwarded-for <0|1>         Add the client to X-Forwarded-For (default 1)\n"
+              << "  --admin-port <port>           Serve metrics on this port on 127.0.0.1\n"
+              << "  --trace-sample <n>            Trace one in n requests (needs --admin-port)\n"
+              << "  --tcp-sample-ms <n>           Sample sockets' TCP_INFO every n ms of a relay\n"
+              << "  --placement <none|core|node>  Pin connection threads near their NIC queue\n"
+              << "  --topk <n>                    Track the n busiest hosts and URLs\n"
+              << "  --topk-decay <s>              Halve the busiest-key counts every s seconds\n"
+              << "  --capture <file>              Record traffic to this file for replay\n"
+              << "  --handover-port <n>           Hand sockets and cache to a successor here\n"
+              << "  --take-over <0|1>             Take over from the proxy on --handover-port\n"
+              << "  --drain-timeout <s>           Once replaced, let connections finish for s"
+              << std::endl;
+}
+
+bool ParseCommandLine(int argc, char* argv[], ProxyConfig& config)
+{
+    if (argc < 2)
+    {
+        PrintUsage(argv[0]);
+        return false;
+    }
+
+    try
+    {
+        config.port = std::stoi(argv[1]);
+    }
+    catch (const std::exception&)
+    {
+        config.port = 0;
+    }
+    if (config.port <= 0 || config.port > 65535)
+    {
+        std::cerr << "Invalid port number. Port must be between 1 and 65535." << std::endl;
+        return false;
+    }
+
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Missing value for " << option << std::endl;
+            PrintUsage(argv[0]);
+            return false;
+        }
+        std::string value = argv[++i];
+
+        try
+        {
+            if (option == "--routes")
+            {
+                config.routesFile = value;
+            }
+            else if (option == "--connect-timeout-ms")
+            {
+                config.connectTimeoutMs = std::stoi(value);
+            }
+            else if (option == "--log-file")
+            {
+                config.logFile = value;
+            }
+            else if (option == "--access-log")
+            {
+                config.accessLogFile = value;
+            }
+            else if (option == "--rate-limit-rps")
+            {
+                config.rateLimits.requestsPerSecond = std::stod(value);
+            }
+            else if (option == "--rate-limit-burst")
+            {
+                config.rateLimits.requestBurst = std::stoi(value);
+            }
+            else if (option == "--rate-limit-bps")
+            {
+                config.rateLimits.bytesPerSecond = std::stod(value);
+            }
+            else if (option == "--max-client-connections")
+            {
+                config.rateLimits.maxConnections = std::stoi(value);
+            }
+            else if (option == "--memory-budget-mb")
+            {
+                config.memory.budgetBytes = static_cast<size_t>(std::stoull(value)) * 1024 * 1024;
+            }
+            else if (option == "--adaptive-concurrency")
+            {
+                config.concurrency.enabled = std::stoi(value) != 0;
+            }
+            else if (option == "--max-concurrency")
+            {
+                config.concurrency.maxLimit = std::stoi(value);
+            }
+            else if (option == "--concurrency-queue-ms")
+            {
+                config.concurrency.queueTimeoutMs = std::stoi(value);
+            }
+            else if (option == "--origin-max-connections")
+            {
+                config.origins.maxPerOrigin = std::stoi(value);
+            }
+            else if (option == "--max-upstream")
+            {
+                config.origins.maxTotal = std::stoi(value);
+            }
+            else if (option == "--origin-queue-ms")
+            {
+                config.origins.queueTimeoutMs = std::stoi(value);
+            }
+            else if (option == "--blocklist")
+            {
+                config.blocklist.fileName = value;
+            }
+            else if (option == "--blocklist-reload")
+            {
+                config.blocklist.reloadSeconds = std::stoi(value);
+            }
+            else if (option == "--relay-bps")
+            {
+                config.relay.bytesPerSecond = std::stod(value);
+            }
+            else if (option == "--relay-policy")
+            {
+                if (!ParseRelayPolicy(value, config.relay.policy))
+                {
+                    throw std::invalid_argument(value);
+                }
+            }
+            else if (option == "--cache-mb")
+            {
+                config.cache.capacityBytes = static_cast<size_t>(std::stoull(value)) * 1024 * 1024;
+            }
+            else if (option == "--cache-entry-kb")
+            {
+                config.cache.maxEntryBytes = static_cast<size_t>(std::stoull(value)) * 1024;
+            }
+            else if (option == "--stale-while-revalidate")
+            {
+                config.cache.staleWhileRevalidateSeconds = std::stoi(value);
+            }
+            else if (option == "--stale-if-error")
+            {
+                config.cache.staleIfErrorSeconds = std::stoi(value);
+            }
+            else if (option == "--cache-admit-after")
+            {
+                config.cache.admitAfterRequests = std::stoi(value);
+            }
+            else if (option == "--cache-compress")
+            {
+                config.cache.compressBodies = std::stoi(value) != 0;
+            }
+            else if (option == "--peer-port")
+            {
+                config.peers.queryPort = std::stoi(value);
+            }
+            else if (option == "--peer")
+            {
+                config.peers.peers.push_back(value);
+            }
+            else if (option == "--peer-name")
+            {
+                config.peers.selfName = value;
+            }
+            else if (option == "--peer-timeout-ms")
+            {
+                config.peers.queryTimeoutMs = std::stoi(value);
+            }
+            else if (option == "--via")
+            {
+                config.viaName = value;
+            }
+            else if (option == "--forwarded-for")
+            {
+                config.forwardedFor = std::stoi(value) != 0;
+            }
+            else if (option == "--admin-port")
+            {
+                config.adminPort = std::stoi(value);
+            }
+            else if (option == "--trace-sample")
+            {
+                config.traceSampleEvery = std::stoi(value);
+            }
+            else if (option == "--tcp-sample-ms")
+            {
+                config.tcpSampleMs = std::stoi(value);
+            }
+            else if (option == "--placement")
+            {
+                if (!ParsePlacementPolicy(value, config.placement))
+                {
+                    throw std::invalid_argument(value);
+                }
+            }
+            else if (option == "--topk")
+            {
+                config.heavyHitters.topK = std::stoi(value);
+            }
+            else if (option == "--topk-decay")
+            {
+                config.heavyHitters.decaySeconds = std::stoi(value);
+            }
+            else if (option == "--capture")
+            {
+                config.captureFile = value;
+            }
+            else if (option == "--handover-port")
+            {
+                config.handover.port = std::stoi(value);
+            }
+            else if (option == "--take-over")
+            {
+                config.handover.takeOver = std::stoi(value) != 0;
+            }
+            else if (option == "--drain-timeout")
+            {
+                config.handover.drainSeconds = std::stoi(value);
+            }
+            else
+            {
+                std::cerr << "Unknown option " << option << std::endl;
+                PrintUsage(argv[0]);
+                return false;
+            }
+        }
+        catch (const std::exception&)
+        {
+            std::cerr << "Invalid value for " << option << ": " << value << std::endl;
+            return false;
+        }
+    }
+
+    if (config.cache.admitAfterRequests > 0 && config.heavyHitters.topK <= 0)
+    {
+        std::cerr << "--cache-admit-after needs --topk to count requests" << std::endl;
+        return false;
+    }
+    if (!config.peers.peers.empty() &&
+        (config.peers.queryPort == 0 || config.cache.capacityBytes == 0))
+    {
+        std::cerr << "--peer needs --peer-port and --cache-mb to share a cache" << std::endl;
+        return false;
+    }
+    if (config.handover.takeOver && config.handover.port == 0)
+    {
+        std::cerr << "--take-over needs --handover-port to find the running proxy" << std::endl;
+        return false;
+    }
+    if (config.peers.selfName.empty())
+    {
+        config.peers.selfName = "127.0.0.1:" + std::to_string(config.port);
+    }
+
+    return true;
+}
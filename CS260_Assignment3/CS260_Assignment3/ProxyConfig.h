@@ -0,0 +1,90 @@
+﻿/*****************************************************************
+ * @file   ProxyConfig.h
+ * @brief  Command line options for the HTTP proxy server.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include "Blocklist.h"
+#include "ConcurrencyLimiter.h"
+#include "Handover.h"
+#include "HeavyHitters.h"
+#include "MemoryBudget.h"
+#include "OriginScheduler.h"
+#include "Peering.h"
+#include "Placement.h"
+#include "RateLimiter.h"
+#include "RelayScheduler.h"
+#include "ResponseCache.h"
+#include <string>
+
+struct ProxyConfig
+{
+    int port = 0;
+
+    // Route table file; when set the proxy runs as a reverse proxy in front of backend pools
+    std::string routesFile;
+
+    // Upper bound on racing connections to all of an upstream's addresses
+    int connectTimeoutMs = 10000;
+
+    RateLimitSettings rateLimits;
+
+    MemorySettings memory;
+
+    ConcurrencySettings concurrency;
+
+    OriginSettings origins;
+
+    RelaySettings relay;
+
+    BlocklistSettings blocklist;
+
+    CacheSettings cache;
+
+    // Sibling proxies whose caches are consulted on a miss
+    PeerSettings peers;
+
+    // Pseudonym added to each request's Via header; none added when empty
+    std::string viaName = "cs260-proxy";
+
+    // Add the client's address to X-Forwarded-For
+    bool forwardedFor = true;
+
+    std::string logFile;       // Error log; stderr when empty
+    std::string accessLogFile; // Per-request access log; disabled when empty
+
+    // Loopback port serving /metrics and other admin pages; disabled when 0
+    int adminPort = 0;
+
+    // Trace one in every n connections for the admin /trace page; disabled when 0
+    int traceSampleEvery = 0;
+
+    // Sample client and upstream sockets' TCP state every n ms of a relay and as each request
+    // ends, for the metrics and the access log; disabled when 0
+    int tcpSampleMs = 0;
+
+    // Which processors each connection's thread may run on
+    PlacementPolicy placement = PlacementPolicy::None;
+
+    // Busiest hosts and URLs, served on the admin /topk page and used for cache admission
+    HeavyHitterSettings heavyHitters;
+
+    // Records every connection's request and response here for replay; disabled when empty
+    std::string captureFile;
+
+    // Restarts that hand the listening sockets and cache to a new process
+    HandoverSettings handover;
+};
+
+// Filled in by main before any client thread starts and read-only afterwards
+extern ProxyConfig proxyConfig;
+
+void PrintUsage(const char* program);
+
+// Parses "<port> [--option value]..." into config, printing the problem on failure
+bool ParseCommandLine(int argc, char* argv[], ProxyConfig& config);
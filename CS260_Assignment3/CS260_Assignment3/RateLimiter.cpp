@@ -0,0 +1,209 @@
+﻿/*****************************************************************
+ * @file   RateLimiter.cpp
+ * @brief  Per-client request and bandwidth limits for the proxy,
+ * kept in a fixed-size lock-free table keyed by client IP.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "RateLimiter.h"
+#include "Hash.h"
+#include <algorithm>
+#include <cmath>
+
+RateLimiter rateLimiter;
+
+namespace
+{
+// 4096 sets of 8 slots tracks ~32k clients in about 1 MB
+const size_t setCount = 4096;
+const size_t slotsPerSet = 8;
+
+// Longest single pause handed to a relay, so a huge burst cannot park a thread indefinitely
+const int64_t maxThrottleNanos = 1000000000;
+
+const uint64_t connectionMask = 0xffffffffull;
+
+int64_t NowNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+} // namespace
+
+RateLimiter::RateLimiter() : _slots(setCount * slotsPerSet)
+{
+}
+
+void RateLimiter::Configure(const RateLimitSettings& settings)
+{
+    _settings = settings;
+    _enabled = settings.requestsPerSecond > 0.0 || settings.bytesPerSecond > 0.0 ||
+               settings.maxConnections > 0;
+
+    if (settings.requestsPerSecond > 0.0)
+    {
+        _requestInterval = static_cast<int64_t>(1e9 / settings.requestsPerSecond);
+        _requestWindow = _requestInterval * std::max(settings.requestBurst, 1);
+    }
+    if (settings.bytesPerSecond > 0.0)
+    {
+        // One second worth of bytes may be sent before throttling starts
+        _nanosPerByte = 1e9 / settings.bytesPerSecond;
+        _byteWindow = 1000000000;
+    }
+}
+
+RateLimiter::ClientHandle RateLimiter::AcquireSlot(
+    uint32_t clientIp, int64_t now, bool& overConnectionLimit)
+{
+    Slot* set = &_slots[(MixHash(clientIp) % setCount) * slotsPerSet];
+    uint64_t key = static_cast<uint64_t>(clientIp) << 32;
+    overConnectionLimit = false;
+
+    // A few attempts are enough; losing every race just means the client goes unlimited once
+    for (int attempt = 0; attempt < 4; ++attempt)
+    {
+        Slot* victim = nullptr;
+        uint64_t victimOwner = 0;
+        bool victimDrained = false;
+        bool raced = false;
+
+        for (size_t i = 0; i < slotsPerSet && !raced; ++i)
+        {
+            Slot& slot = set[i];
+            uint64_t owner = slot.owner.load(std::memory_order_acquire);
+            if ((owner & ~connectionMask) == key && owner != 0)
+            {
+                uint64_t connections = owner & connectionMask;
+                if (_settings.maxConnections > 0 &&
+                    connections >= static_cast<uint64_t>(_settings.maxConnections))
+                {
+                    overConnectionLimit = true;
+                    return nullptr;
+                }
+                if (slot.owner.compare_exchange_strong(owner, owner + 1))
+                {
+                    return &slot;
+                }
+                raced = true;
+                continue;
+            }
+
+            // Only idle slots can be recycled; prefer ones with nothing left to remember
+            if ((owner & connectionMask) != 0)
+            {
+                continue;
+            }
+            bool drained = owner == 0 || (slot.requestTat.load(std::memory_order_relaxed) <= now &&
+                                          slot.byteTat.load(std::memory_order_relaxed) <= now);
+            if (victim == nullptr || (drained && !victimDrained) ||
+                (drained == victimDrained &&
+                 slot.lastSeen.load(std::memory_order_relaxed) <
+                     victim->lastSeen.load(std::memory_order_relaxed)))
+            {
+                victim = &slot;
+                victimOwner = owner;
+                victimDrained = drained;
+            }
+        }
+
+        if (raced)
+        {
+            continue;
+        }
+        if (victim == nullptr)
+        {
+            return nullptr;
+        }
+        if (victim->owner.compare_exchange_strong(victimOwner, key | 1))
+        {
+            victim->requestTat.store(0, std::memory_order_relaxed);
+            victim->byteTat.store(0, std::memory_order_relaxed);
+            return victim;
+        }
+    }
+
+    return nullptr;
+}
+
+Admission RateLimiter::Admit(uint32_t clientIp, ClientHandle& handle, int& retryAfterSeconds)
+{
+    handle = nullptr;
+    retryAfterSeconds = 0;
+    if (!_enabled)
+    {
+        return Admission::Allowed;
+    }
+
+    int64_t now = NowNanos();
+    bool overConnectionLimit = false;
+    handle = AcquireSlot(clientIp, now, overConnectionLimit);
+    if (overConnectionLimit)
+    {
+        retryAfterSeconds = 1;
+        return Admission::TooManyConnections;
+    }
+    if (handle == nullptr)
+    {
+        return Admission::Allowed;
+    }
+    handle->lastSeen.store(static_cast<uint32_t>(now / 1000000000), std::memory_order_relaxed);
+
+    if (_requestInterval == 0)
+    {
+        return Admission::Allowed;
+    }
+
+    // GCRA: each request pushes the theoretical arrival time one interval further; the
+    // request conforms while that time stays within the burst window ahead of now
+    int64_t tat = handle->requestTat.load(std::memory_order_relaxed);
+    while (true)
+    {
+        int64_t newTat = std::max(tat, now) + _requestInterval;
+        if (newTat - now > _requestWindow)
+        {
+            int64_t waitNanos = newTat - _requestWindow - now;
+            retryAfterSeconds = static_cast<int>(std::ceil(waitNanos / 1e9));
+            Release(handle);
+            handle = nullptr;
+            return Admission::TooManyRequests;
+        }
+        if (handle->requestTat.compare_exchange_weak(tat, newTat, std::memory_order_relaxed))
+        {
+            return Admission::Allowed;
+        }
+    }
+}
+
+void RateLimiter::Release(ClientHandle handle)
+{
+    if (handle != nullptr)
+    {
+        handle->owner.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+std::chrono::microseconds RateLimiter::ConsumeBytes(ClientHandle handle, size_t bytes)
+{
+    if (handle == nullptr || _byteWindow == 0)
+    {
+        return std::chrono::microseconds(0);
+    }
+
+    // Bytes are always charged; the caller is throttled by however far the bucket is overdrawn
+    int64_t now = NowNanos();
+    int64_t cost = static_cast<int64_t>(bytes * _nanosPerByte);
+    int64_t tat = handle->byteTat.load(std::memory_order_relaxed);
+    int64_t newTat = 0;
+    do
+    {
+        newTat = std::max(tat, now) + cost;
+    } while (!handle->byteTat.compare_exchange_weak(tat, newTat, std::memory_order_relaxed));
+
+    int64_t overdraw = std::min(newTat - now - _byteWindow, maxThrottleNanos);
+    return std::chrono::microseconds(overdraw > 0 ? overdraw / 1000 : 0);
+}
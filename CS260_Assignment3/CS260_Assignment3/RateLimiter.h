@@ -0,0 +1,103 @@
+﻿/*****************************************************************
+ * @file   RateLimiter.h
+ * @brief  Per-client request and bandwidth limits for the proxy,
+ * kept in a fixed-size lock-free table keyed by client IP.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+struct RateLimitSettings
+{
+    double requestsPerSecond = 0.0; // 0 disables the request limit
+    int requestBurst = 10;
+    double bytesPerSecond = 0.0; // 0 disables relay throttling
+    int maxConnections = 0;      // Concurrent connections per client, 0 for unlimited
+};
+
+enum class Admission
+{
+    Allowed,
+    TooManyRequests,
+    TooManyConnections,
+};
+
+// Token buckets are stored as GCRA "theoretical arrival times", so each bucket is a single
+// atomic updated with compare-and-swap. Clients hash into small fixed-size sets; a client's
+// slot cannot be reused while it has open connections, and otherwise the slot whose buckets
+// have refilled (or failing that the least recently seen) is recycled for a new client.
+class RateLimiter
+{
+public:
+    struct Slot;
+    using ClientHandle = Slot*;
+
+    RateLimiter();
+
+    void Configure(const RateLimitSettings& settings);
+
+    bool IsEnabled() const
+    {
+        return _enabled;
+    }
+
+    // Called at accept; on Allowed the handle must be passed to Release when the connection
+    // closes. The handle is nullptr when limiting is disabled or the client's set is full.
+    Admission Admit(uint32_t clientIp, ClientHandle& handle, int& retryAfterSeconds);
+
+    void Release(ClientHandle handle);
+
+    // Charges relayed bytes to the client and returns how long to pause to stay under the limit
+    std::chrono::microseconds ConsumeBytes(ClientHandle handle, size_t bytes);
+
+    struct Slot
+    {
+        std::atomic<uint64_t> owner{0}; // Client IP in the high half, open connections in the low
+        std::atomic<uint32_t> lastSeen{0};
+        std::atomic<int64_t> requestTat{0};
+        std::atomic<int64_t> byteTat{0};
+    };
+
+private:
+    ClientHandle AcquireSlot(uint32_t clientIp, int64_t now, bool& overConnectionLimit);
+
+    RateLimitSettings _settings;
+    bool _enabled = false;
+    int64_t _requestInterval = 0; // Nanoseconds per request
+    int64_t _requestWindow = 0;   // Nanoseconds of burst credit
+    double _nanosPerByte = 0.0;
+    int64_t _byteWindow = 0;
+    std::vector<Slot> _slots;
+};
+
+// Keeps a client's connection counted against its limit until the connection closes
+class ClientAdmission
+{
+public:
+    ClientAdmission(RateLimiter& limiter, RateLimiter::ClientHandle handle)
+        : _limiter(limiter), _handle(handle)
+    {
+    }
+
+    ~ClientAdmission()
+    {
+        _limiter.Release(_handle);
+    }
+
+    ClientAdmission(const ClientAdmission&) = delete;
+    ClientAdmission& operator=(const ClientAdmission&) = delete;
+
+private:
+    RateLimiter& _limiter;
+    RateLimiter::ClientHandle _handle;
+};
+
+extern RateLimiter rateLimiter;
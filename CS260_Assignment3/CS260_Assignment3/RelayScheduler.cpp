@@ -0,0 +1,133 @@
+﻿/*****************************************************************
+ * @file   RelayScheduler.cpp
+ * @brief  Shares the proxy's outbound bandwidth among relayed
+ * responses, favouring those with the least left to send.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "RelayScheduler.h"
+#include <algorithm>
+
+RelayScheduler relayScheduler;
+
+namespace
+{
+// Share of the link's rate each response is credited per second since it started
+const double agingShare = 0.01;
+
+// Most the bucket holds while nobody is sending, in seconds of the link's rate
+const double burstSeconds = 0.005;
+} // namespace
+
+bool ParseRelayPolicy(const std::string& text, RelayPolicy& policy)
+{
+    if (text == "fifo")
+    {
+        policy = RelayPolicy::Fifo;
+    }
+    else if (text == "srpt")
+    {
+        policy = RelayPolicy::ShortestRemaining;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+void RelayScheduler::Configure(const RelaySettings& settings)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    _settings = settings;
+    _tokens = 0;
+    _refilledAt = std::chrono::steady_clock::now();
+}
+
+void RelayScheduler::Wait(RelayFlow& flow, size_t bytes)
+{
+    if (!IsEnabled())
+    {
+        flow.sentBytes += bytes;
+        return;
+    }
+
+    std::unique_lock<std::mutex> guard(_lock);
+    flow.readyAt = std::chrono::steady_clock::now();
+    _waiting.push_back(&flow);
+    while (true)
+    {
+        auto now = std::chrono::steady_clock::now();
+        Refill(now);
+        RelayFlow* best = Best(now);
+        if (best != &flow)
+        {
+            // Rankings shift as flows age, so the best may be asleep behind a flow that was
+            // ahead when it last looked
+            best->turn.notify_one();
+            flow.turn.wait(guard);
+            continue;
+        }
+        if (_tokens > 0)
+        {
+            break;
+        }
+        auto refillTime = std::chrono::duration<double>(-_tokens / _settings.bytesPerSecond);
+        flow.turn.wait_for(guard, refillTime);
+    }
+
+    // The chunk goes out whole and the bucket may go into debt for it, which the next sender
+    // waits off
+    _tokens -= static_cast<double>(bytes);
+    flow.sentBytes += bytes;
+    _waiting.erase(std::find(_waiting.begin(), _waiting.end(), &flow));
+    if (!_waiting.empty())
+    {
+        Best(std::chrono::steady_clock::now())->turn.notify_one();
+    }
+}
+
+double RelayScheduler::Rank(
+    const RelayFlow& flow,
+    std::chrono::steady_clock::time_point now) const
+{
+    if (_settings.policy == RelayPolicy::Fifo)
+    {
+        return std::chrono::duration<double>(flow.readyAt.time_since_epoch()).count();
+    }
+    double left = static_cast<double>(flow.sentBytes);
+    if (flow.totalBytes > 0)
+    {
+        left = static_cast<double>(flow.totalBytes - std::min(flow.sentBytes, flow.totalBytes));
+    }
+    double age = std::chrono::duration<double>(now - flow.started).count();
+    return left - age * agingShare * _settings.bytesPerSecond;
+}
+
+RelayFlow* RelayScheduler::Best(std::chrono::steady_clock::time_point now) const
+{
+    RelayFlow* best = nullptr;
+    double bestRank = 0;
+    for (RelayFlow* flow : _waiting)
+    {
+        double rank = Rank(*flow, now);
+        if (best == nullptr || rank < bestRank)
+        {
+            best = flow;
+            bestRank = rank;
+        }
+    }
+    return best;
+}
+
+void RelayScheduler::Refill(std::chrono::steady_clock::time_point now)
+{
+    double elapsed = std::chrono::duration<double>(now - _refilledAt).count();
+    _refilledAt = now;
+    _tokens = std::min(
+        _tokens + elapsed * _settings.bytesPerSecond,
+        burstSeconds * _settings.bytesPerSecond);
+}
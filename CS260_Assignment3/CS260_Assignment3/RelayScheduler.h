@@ -0,0 +1,79 @@
+﻿/*****************************************************************
+ * @file   RelayScheduler.h
+ * @brief  Shares the proxy's outbound bandwidth among relayed
+ * responses, favouring those with the least left to send.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class RelayPolicy
+{
+    Fifo,              // Chunks go in the order they are ready, sharing the link evenly
+    ShortestRemaining, // The response with the fewest bytes left goes first, with aging
+};
+
+struct RelaySettings
+{
+    double bytesPerSecond = 0; // Outbound capacity the scheduler shares out; 0 disables it
+    RelayPolicy policy = RelayPolicy::ShortestRemaining;
+};
+
+// Accepts "fifo" and "srpt"
+bool ParseRelayPolicy(const std::string& text, RelayPolicy& policy);
+
+// One response's progress, kept by its relay loop
+struct RelayFlow
+{
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    size_t totalBytes = 0; // Head and body, when Content-Length gave it; 0 while unknown
+    size_t sentBytes = 0;
+
+    // Only touched under the scheduler's lock while waiting
+    std::condition_variable turn;
+    std::chrono::steady_clock::time_point readyAt;
+};
+
+// Paces every relayed chunk through one token bucket at the configured rate, the way a
+// saturated link would, and picks which waiting chunk goes next. Under ShortestRemaining a
+// response of known length ranks by the bytes it has left and one of unknown length by the
+// bytes it has already sent, so small responses finish first whether or not they announce
+// their size. Each response is credited a hundredth of the link's rate for every second since
+// it started, so a large one can't be passed over indefinitely.
+class RelayScheduler
+{
+public:
+    void Configure(const RelaySettings& settings);
+
+    bool IsEnabled() const
+    {
+        return _settings.bytesPerSecond > 0;
+    }
+
+    // Blocks until the flow may send bytes more, then counts them as sent
+    void Wait(RelayFlow& flow, size_t bytes);
+
+private:
+    double Rank(const RelayFlow& flow, std::chrono::steady_clock::time_point now) const;
+    RelayFlow* Best(std::chrono::steady_clock::time_point now) const;
+    void Refill(std::chrono::steady_clock::time_point now);
+
+    RelaySettings _settings;
+    std::mutex _lock;
+    std::vector<RelayFlow*> _waiting;
+    double _tokens = 0; // Bytes that may go out now; negative while paying off a large chunk
+    std::chrono::steady_clock::time_point _refilledAt;
+};
+
+// Configured by main before any client thread starts
+extern RelayScheduler relayScheduler;
@@ -0,0 +1,1030 @@
+﻿/*****************************************************************
+ * @file   ResponseCache.cpp
+ * @brief  In-memory cache of origin responses, with conditional
+ * revalidation, stale serving windows and byte-range replies.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "ResponseCache.h"
+#include "Compression.h"
+#include "Hash.h"
+#include "HeavyHitters.h"
+#include "HttpParser.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+
+ResponseCache responseCache;
+
+namespace
+{
+const size_t maxRanges = 16; // A Range header asking for more than this is ignored
+
+// Inclusive, as in Range and Content-Range
+struct ByteRange
+{
+    uint64_t first = 0;
+    uint64_t last = 0;
+};
+
+enum class RangeRequest
+{
+    Whole,         // No usable Range header; the whole response is wanted
+    Ranges,        // At least one range overlaps the body
+    Unsatisfiable, // Every range lies beyond the body
+};
+
+struct CacheControl
+{
+    bool noStore = false;
+    bool noCache = false;
+    bool isPrivate = false;
+    bool mustRevalidate = false; // must-revalidate or proxy-revalidate
+    long long maxAge = -1;       // -1 when the directive is absent
+    long long sharedMaxAge = -1; // s-maxage, which overrides max-age for a shared cache
+    long long staleWhileRevalidate = -1;
+    long long staleIfError = -1;
+};
+
+std::string Trim(const std::string& value)
+{
+    size_t start = 0;
+    size_t end = value.size();
+    while (start < end && isspace(static_cast<unsigned char>(value[start])))
+    {
+        ++start;
+    }
+    while (end > start && isspace(static_cast<unsigned char>(value[end - 1])))
+    {
+        --end;
+    }
+    return value.substr(start, end - start);
+}
+
+CacheControl ParseCacheControl(const std::string& value)
+{
+    CacheControl control;
+    size_t at = 0;
+    while (at < value.size())
+    {
+        size_t end = value.find(',', at);
+        if (end == std::string::npos)
+        {
+            end = value.size();
+        }
+        std::string directive = Trim(value.substr(at, end - at));
+        std::transform(
+            directive.begin(),
+            directive.end(),
+            directive.begin(),
+            [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        at = end + 1;
+
+        std::string name = directive;
+        long long seconds = -1;
+        size_t equals = directive.find('=');
+        if (equals != std::string::npos)
+        {
+            name = Trim(directive.substr(0, equals));
+            std::string argument = Trim(directive.substr(equals + 1));
+            argument.erase(std::remove(argument.begin(), argument.end(), '"'), argument.end());
+            seconds = argument.empty() ? -1 : std::max(strtoll(argument.c_str(), nullptr, 10), 0LL);
+        }
+
+        if (name == "no-store")
+        {
+            control.noStore = true;
+        }
+        else if (name == "no-cache")
+        {
+            control.noCache = true;
+        }
+        else if (name == "private")
+        {
+            control.isPrivate = true;
+        }
+        else if (name == "must-revalidate" || name == "proxy-revalidate")
+        {
+            control.mustRevalidate = true;
+        }
+        else if (name == "max-age")
+        {
+            control.maxAge = seconds;
+        }
+        else if (name == "s-maxage")
+        {
+            control.sharedMaxAge = seconds;
+        }
+        else if (name == "stale-while-revalidate")
+        {
+            control.staleWhileRevalidate = seconds;
+        }
+        else if (name == "stale-if-error")
+        {
+            control.staleIfError = seconds;
+        }
+    }
+    return control;
+}
+
+// Sets the freshness lifetime and stale windows from the response's headers; false when the
+// response must not be stored at all
+bool ApplyFreshness(
+    CachedResponse& cached,
+    const std::string& headers,
+    const CacheSettings& settings)
+{
+    CacheControl control = ParseCacheControl(GetHeaderValue(headers, "Cache-Control"));
+    if (control.noStore || control.isPrivate)
+    {
+        return false;
+    }
+
+    // Without an explicit lifetime the copy is stored stale and revalidated on every use
+    long long lifetime = control.sharedMaxAge >= 0 ? control.sharedMaxAge : control.maxAge;
+    if (lifetime < 0 || control.noCache)
+    {
+        lifetime = 0;
+    }
+    long long age = std::max(atoll(GetHeaderValue(headers, "Age").c_str()), 0LL);
+    cached.originAge = std::chrono::seconds(age);
+    cached.freshFor = std::chrono::seconds(std::max(lifetime - age, 0LL));
+
+    bool mayServeStale = !control.noCache && !control.mustRevalidate;
+    long long staleWhileRevalidate = control.staleWhileRevalidate >= 0
+                                         ? control.staleWhileRevalidate
+                                         : settings.staleWhileRevalidateSeconds;
+    long long staleIfError =
+        control.staleIfError >= 0 ? control.staleIfError : settings.staleIfErrorSeconds;
+    cached.staleWhileRevalidate = std::chrono::seconds(mayServeStale ? staleWhileRevalidate : 0);
+    cached.staleIfError = std::chrono::seconds(mayServeStale ? staleIfError : 0);
+    return true;
+}
+
+bool AllDigits(const std::string& value)
+{
+    return std::all_of(
+        value.begin(), value.end(), [](unsigned char c) { return std::isdigit(c) != 0; });
+}
+
+// Resolves a "bytes=" Range header against the body length. Headers that are malformed, use
+// another unit or ask for too many ranges are ignored, as a server is allowed to.
+RangeRequest ParseRange(const std::string& value, uint64_t length, std::vector<ByteRange>& ranges)
+{
+    if (_strnicmp(value.c_str(), "bytes=", 6) != 0)
+    {
+        return RangeRequest::Whole;
+    }
+
+    bool anySpec = false;
+    size_t at = 6;
+    while (at <= value.size())
+    {
+        size_t end = value.find(',', at);
+        if (end == std::string::npos)
+        {
+            end = value.size();
+        }
+        std::string spec = Trim(value.substr(at, end - at));
+        at = end + 1;
+        if (spec.empty())
+        {
+            continue;
+        }
+
+        size_t dash = spec.find('-');
+        std::string from = dash == std::string::npos ? spec : Trim(spec.substr(0, dash));
+        std::string to = dash == std::string::npos ? "" : Trim(spec.substr(dash + 1));
+        if (dash == std::string::npos || !AllDigits(from) || !AllDigits(to) ||
+            (from.empty() && to.empty()))
+        {
+            return RangeRequest::Whole;
+        }
+        anySpec = true;
+
+        ByteRange range;
+        if (from.empty())
+        {
+            // "-n" is the last n bytes
+            uint64_t suffix = strtoull(to.c_str(), nullptr, 10);
+            if (suffix == 0 || length == 0)
+            {
+                continue;
+            }
+            range.first = length - std::min(suffix, length);
+            range.last = length - 1;
+        }
+        else
+        {
+            range.first = strtoull(from.c_str(), nullptr, 10);
+            uint64_t last = to.empty() ? UINT64_MAX : strtoull(to.c_str(), nullptr, 10);
+            if (last < range.first)
+            {
+                return RangeRequest::Whole;
+            }
+            if (range.first >= length)
+            {
+                continue;
+            }
+            range.last = std::min(last, length - 1);
+        }
+
+        ranges.push_back(range);
+        if (ranges.size() > maxRanges)
+        {
+            return RangeRequest::Whole;
+        }
+    }
+
+    if (!anySpec)
+    {
+        return RangeRequest::Whole;
+    }
+    return ranges.empty() ? RangeRequest::Unsatisfiable : RangeRequest::Ranges;
+}
+
+// Parses a 206's "bytes first-last/length"; an unknown length ("*") is rejected
+bool ParseContentRange(const std::string& value, uint64_t& first, uint64_t& last, uint64_t& length)
+{
+    if (value.compare(0, 6, "bytes ") != 0)
+    {
+        return false;
+    }
+    const char* at = value.c_str() + 6;
+    char* end = nullptr;
+    first = strtoull(at, &end, 10);
+    if (end == at || *end != '-')
+    {
+        return false;
+    }
+    at = end + 1;
+    last = strtoull(at, &end, 10);
+    if (end == at || *end != '/')
+    {
+        return false;
+    }
+    at = end + 1;
+    length = strtoull(at, &end, 10);
+    if (end == at || *end != '\0')
+    {
+        return false;
+    }
+    return first <= last && last < length;
+}
+
+// An If-Range validator that no longer matches means the client's partial copy is outdated,
+// so the whole response must be sent instead of the ranges
+bool IfRangeMatches(const std::string& requestHead, const CachedResponse& cached)
+{
+    std::string ifRange = GetHeaderValue(requestHead, "If-Range");
+    if (ifRange.empty())
+    {
+        return true;
+    }
+    if (ifRange[0] == '"' || ifRange.compare(0, 2, "W/") == 0)
+    {
+        // Only a strong entity tag may be used, and it must match exactly
+        return ifRange[0] == '"' && ifRange == cached.etag;
+    }
+    return ifRange == cached.lastModified;
+}
+
+std::string ContentRange(const ByteRange& range, uint64_t length)
+{
+    return "bytes " + std::to_string(range.first) + "-" + std::to_string(range.last) + "/" +
+           std::to_string(length);
+}
+
+// Adds bytes at first, coalescing with any stored segments they overlap or touch
+void AddSegment(SegmentMap& segments, uint64_t first, std::string bytes)
+{
+    uint64_t end = first + bytes.size();
+    auto next = segments.upper_bound(first);
+    if (next != segments.begin())
+    {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second->size() >= first)
+        {
+            next = previous;
+        }
+    }
+
+    uint64_t start = first;
+    std::string prefix;
+    std::string suffix;
+    while (next != segments.end() && next->first <= end)
+    {
+        const std::string& stored = *next->second;
+        if (next->first < start)
+        {
+            prefix = stored.substr(0, start - next->first);
+            start = next->first;
+        }
+        if (next->first + stored.size() > end)
+        {
+            suffix = stored.substr(end - next->first);
+        }
+        next = segments.erase(next);
+    }
+    segments[start] = std::make_shared<const std::string>(prefix + bytes + suffix);
+}
+
+// Whether a body is worth compressing: not once the origin has encoded it, nor for media and
+// archive formats that are compressed already
+bool CompressibleBody(const std::string& headers, const CacheSettings& settings)
+{
+    if (!settings.compressBodies)
+    {
+        return false;
+    }
+    std::string encoding = GetHeaderValue(headers, "Content-Encoding");
+    if (!encoding.empty() && _stricmp(encoding.c_str(), "identity") != 0)
+    {
+        return false;
+    }
+
+    std::string type = GetHeaderValue(headers, "Content-Type");
+    std::transform(
+        type.begin(),
+        type.end(),
+        type.begin(),
+        [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (type.compare(0, 6, "image/") == 0)
+    {
+        return type.find("svg") != std::string::npos;
+    }
+    static const char* const compressedTypes[] = {
+        "video/",
+        "audio/",
+        "font/woff",
+        "application/zip",
+        "application/gzip",
+        "application/x-gzip",
+        "application/x-7z",
+        "application/x-bzip2",
+        "application/x-xz",
+        "application/x-rar",
+        "application/zstd",
+        "application/pdf"};
+    for (const char* compressedType : compressedTypes)
+    {
+        if (type.compare(0, strlen(compressedType), compressedType) == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The body cut into chunks of bodyChunkBytes, each hashed and, where it pays, compressed; not
+// yet shared with the cache's
+std::vector<BodyChunk> ChunkBody(const char* body, size_t size, bool compress)
+{
+    std::vector<BodyChunk> chunks;
+    chunks.reserve((size + bodyChunkBytes - 1) / bodyChunkBytes);
+    std::string packed;
+    for (size_t offset = 0; offset < size; offset += bodyChunkBytes)
+    {
+        size_t chunkSize = std::min(bodyChunkBytes, size - offset);
+        BodyChunk chunk;
+        chunk.hash = HashContent(body + offset, chunkSize);
+        chunk.size = chunkSize;
+        if (compress && CompressBlock(body + offset, chunkSize, packed))
+        {
+            chunk.packed = true;
+            chunk.bytes = std::make_shared<const std::string>(std::move(packed));
+        }
+        else
+        {
+            chunk.bytes = std::make_shared<const std::string>(body + offset, chunkSize);
+        }
+        chunks.push_back(std::move(chunk));
+    }
+    return chunks;
+}
+
+// Whether two chunks hold the same content, however each is held
+bool SameContent(const BodyChunk& first, const BodyChunk& second)
+{
+    if (first.size != second.size)
+    {
+        return false;
+    }
+    if (first.packed == second.packed)
+    {
+        return *first.bytes == *second.bytes;
+    }
+    const BodyChunk& packed = first.packed ? first : second;
+    const BodyChunk& plain = first.packed ? second : first;
+    std::string expanded;
+    return ExpandChunk(packed, expanded) && expanded == *plain.bytes;
+}
+
+// A stored copy of the response, or nullptr when it may not or need not be cached
+std::shared_ptr<CachedResponse> MakeCachedResponse(
+    const std::string& response,
+    const CacheSettings& settings)
+{
+    size_t headerEnd = response.find("\r\n\r\n");
+    if (GetResponseStatus(response) != 200 || headerEnd == std::string::npos ||
+        response.size() > settings.maxEntryBytes)
+    {
+        return nullptr;
+    }
+    std::string headers = response.substr(0, headerEnd + 2);
+
+    // The key is only host and path, so any Vary would mix up variants; cookies are per user
+    if (!GetHeaderValue(headers, "Vary").empty() || !GetHeaderValue(headers, "Set-Cookie").empty())
+    {
+        return nullptr;
+    }
+
+    // Only a body whose length is announced can be told apart from one the origin connection
+    // cut short; a chunked body would also be stored with its framing, so neither is kept
+    std::string contentLength = GetHeaderValue(headers, "Content-Length");
+    if (!GetHeaderValue(headers, "Transfer-Encoding").empty() || contentLength.empty() ||
+        !AllDigits(contentLength) ||
+        strtoull(contentLength.c_str(), nullptr, 10) != response.size() - headerEnd - 4)
+    {
+        return nullptr;
+    }
+
+    auto cached = std::make_shared<CachedResponse>();
+    if (!ApplyFreshness(*cached, headers, settings))
+    {
+        return nullptr;
+    }
+    cached->etag = GetHeaderValue(headers, "ETag");
+    cached->lastModified = GetHeaderValue(headers, "Last-Modified");
+    if (cached->freshFor.count() == 0 && !cached->HasValidators())
+    {
+        return nullptr;
+    }
+    cached->head = RemoveHeaders(response.substr(0, headerEnd + 4), {"Age"}) + "\r\n";
+    cached->length = response.size() - headerEnd - 4;
+    cached->chunks = ChunkBody(
+        response.data() + headerEnd + 4,
+        cached->length,
+        CompressibleBody(headers, settings));
+    cached->storedAt = std::chrono::steady_clock::now();
+    return cached;
+}
+} // namespace
+
+bool CachedResponse::HasBody(uint64_t first, uint64_t last) const
+{
+    if (last >= length)
+    {
+        return false;
+    }
+    if (IsComplete())
+    {
+        return true;
+    }
+
+    auto segment = segments.upper_bound(first);
+    if (segment == segments.begin())
+    {
+        return false;
+    }
+    --segment;
+    return segment->first + segment->second->size() > last;
+}
+
+void CachedResponse::AddBody(uint64_t first, uint64_t last, CachedReply& reply) const
+{
+    if (!IsComplete())
+    {
+        auto segment = --segments.upper_bound(first);
+        reply.slices.AddBytes(
+            segment->second->data() + (first - segment->first),
+            static_cast<size_t>(last - first + 1));
+        return;
+    }
+
+    // A range spanning chunks goes out as one slice per chunk
+    for (uint64_t offset = first; offset <= last;)
+    {
+        const BodyChunk& chunk = chunks[static_cast<size_t>(offset / bodyChunkBytes)];
+        size_t start = static_cast<size_t>(offset % bodyChunkBytes);
+        size_t size =
+            static_cast<size_t>(std::min<uint64_t>(chunk.size - start, last - offset + 1));
+        if (chunk.packed)
+        {
+            reply.slices.AddBytes(nullptr, size);
+            reply.packed.push_back({&chunk, start, size});
+        }
+        else
+        {
+            reply.slices.AddBytes(chunk.bytes->data() + start, size);
+        }
+        offset += size;
+    }
+}
+
+size_t CachedResponse::StoredBytes() const
+{
+    size_t bytes = head.size();
+    for (const auto& segment : segments)
+    {
+        bytes += segment.second->size();
+    }
+    return bytes;
+}
+
+bool ExpandChunk(const BodyChunk& chunk, std::string& buffer)
+{
+    buffer.resize(chunk.size);
+    return DecompressBlock(*chunk.bytes, &buffer[0], chunk.size);
+}
+
+CacheState GetCacheState(const CachedResponse& cached, std::chrono::steady_clock::time_point now)
+{
+    std::chrono::steady_clock::duration age = now - cached.storedAt;
+    if (age < cached.freshFor)
+    {
+        return CacheState::Fresh;
+    }
+    if (age < cached.freshFor + cached.staleWhileRevalidate)
+    {
+        return CacheState::StaleWhileRevalidate;
+    }
+    return CacheState::Stale;
+}
+
+bool WithinStaleIfError(const CachedResponse& cached, std::chrono::steady_clock::time_point now)
+{
+    return now - cached.storedAt < cached.freshFor + cached.staleIfError;
+}
+
+bool RequestCacheable(const std::string& requestHead)
+{
+    if (requestHead.compare(0, 4, "GET ") != 0 ||
+        !GetHeaderValue(requestHead, "Authorization").empty())
+    {
+        return false;
+    }
+    return !ParseCacheControl(GetHeaderValue(requestHead, "Cache-Control")).noStore;
+}
+
+bool RequestForcesRevalidation(const std::string& requestHead)
+{
+    CacheControl control = ParseCacheControl(GetHeaderValue(requestHead, "Cache-Control"));
+    return control.noCache || control.maxAge == 0 ||
+           GetHeaderValue(requestHead, "Pragma").find("no-cache") != std::string::npos;
+}
+
+std::string MakeConditionalRequest(const std::string& requestHead, const CachedResponse& cached)
+{
+    if (requestHead.find("\r\n\r\n") == std::string::npos)
+    {
+        return requestHead;
+    }
+
+    std::string request = RemoveHeaders(
+        requestHead,
+        {"If-None-Match",
+         "If-Modified-Since",
+         "If-Match",
+         "If-Unmodified-Since",
+         "If-Range",
+         "Range"});
+    if (!cached.etag.empty())
+    {
+        request += "If-None-Match: " + cached.etag + "\r\n";
+    }
+    if (!cached.lastModified.empty())
+    {
+        request += "If-Modified-Since: " + cached.lastModified + "\r\n";
+    }
+    return request + "\r\n";
+}
+
+bool BuildCachedReply(
+    const std::shared_ptr<const CachedResponse>& cached,
+    const std::string& requestHead,
+    CachedReply& reply)
+{
+    const CachedResponse& entry = *cached;
+    reply.source = cached;
+    // The stored head has no Age of its own: what the origin reported plus the time held here
+    std::chrono::seconds ageSeconds =
+        entry.originAge + std::chrono::duration_cast<std::chrono::seconds>(
+                              std::chrono::steady_clock::now() - entry.storedAt);
+    std::string age = "Age: " + std::to_string(ageSeconds.count()) + "\r\n";
+
+    std::vector<ByteRange> ranges;
+    RangeRequest request = RangeRequest::Whole;
+    std::string rangeHeader = GetHeaderValue(requestHead, "Range");
+    if (!rangeHeader.empty() && IfRangeMatches(requestHead, entry))
+    {
+        request = ParseRange(rangeHeader, entry.length, ranges);
+    }
+
+    size_t statusLineEnd = entry.head.find("\r\n") + 2;
+    if (request == RangeRequest::Whole)
+    {
+        if (!entry.IsComplete())
+        {
+            return false;
+        }
+        reply.status = GetResponseStatus(entry.head);
+        reply.slices.AddText(entry.head.substr(0, statusLineEnd) + age);
+        reply.slices.AddBytes(
+            entry.head.data() + statusLineEnd, entry.head.size() - statusLineEnd);
+        if (entry.length > 0)
+        {
+            entry.AddBody(0, entry.length - 1, reply);
+        }
+        return true;
+    }
+
+    std::string version = entry.head.substr(0, entry.head.find(' '));
+    if (request == RangeRequest::Unsatisfiable)
+    {
+        reply.status = 416;
+        reply.slices.AddText(
+            version + " 416 Range Not Satisfiable\r\n" + age + "Content-Range: bytes */" +
+            std::to_string(entry.length) + "\r\nContent-Length: 0\r\n\r\n");
+        return true;
+    }
+
+    // Every requested byte must be at hand before anything is sent
+    for (const ByteRange& range : ranges)
+    {
+        if (!entry.HasBody(range.first, range.last))
+        {
+            return false;
+        }
+    }
+
+    // The stored body is never chunked, and the 206 frames its own with a Content-Length
+    bool multipart = ranges.size() > 1;
+    std::string headers;
+    if (multipart)
+    {
+        headers = RemoveHeaders(
+            entry.head,
+            {"Transfer-Encoding", "Content-Length", "Content-Range", "Content-Type"});
+    }
+    else
+    {
+        headers =
+            RemoveHeaders(entry.head, {"Transfer-Encoding", "Content-Length", "Content-Range"});
+    }
+    std::string head = version + " 206 Partial Content\r\n" + age +
+                       headers.substr(headers.find("\r\n") + 2);
+    reply.status = 206;
+
+    if (!multipart)
+    {
+        uint64_t size = ranges[0].last - ranges[0].first + 1;
+        reply.slices.AddText(
+            head + "Content-Range: " + ContentRange(ranges[0], entry.length) +
+            "\r\nContent-Length: " + std::to_string(size) + "\r\n\r\n");
+        entry.AddBody(ranges[0].first, ranges[0].last, reply);
+        return true;
+    }
+
+    // Several ranges go out as multipart/byteranges, each part labelled with its own range
+    char boundary[40];
+    snprintf(
+        boundary,
+        sizeof(boundary),
+        "proxy-byteranges-%016llx",
+        static_cast<unsigned long long>(MixHash(
+            HashString(entry.etag) ^
+            static_cast<uint64_t>(entry.storedAt.time_since_epoch().count()))));
+    std::string contentType = GetHeaderValue(entry.head, "Content-Type");
+    std::vector<std::string> partHeaders;
+    uint64_t contentLength = 0;
+    for (const ByteRange& range : ranges)
+    {
+        std::string partHeader = std::string("\r\n--") + boundary + "\r\n";
+        if (!contentType.empty())
+        {
+            partHeader += "Content-Type: " + contentType + "\r\n";
+        }
+        partHeader += "Content-Range: " + ContentRange(range, entry.length) + "\r\n\r\n";
+        contentLength += partHeader.size() + (range.last - range.first + 1);
+        partHeaders.push_back(std::move(partHeader));
+    }
+    std::string closing = std::string("\r\n--") + boundary + "--\r\n";
+    contentLength += closing.size();
+
+    reply.slices.AddText(
+        head + "Content-Type: multipart/byteranges; boundary=" + boundary +
+        "\r\nContent-Length: " + std::to_string(contentLength) + "\r\n\r\n");
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        reply.slices.AddText(std::move(partHeaders[i]));
+        entry.AddBody(ranges[i].first, ranges[i].last, reply);
+    }
+    reply.slices.AddText(std::move(closing));
+    return true;
+}
+
+void ResponseCache::Configure(const CacheSettings& settings)
+{
+    _settings = settings;
+}
+
+std::shared_ptr<const CachedResponse> ResponseCache::Lookup(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    auto entry = _entries.find(key);
+    if (entry == _entries.end())
+    {
+        return nullptr;
+    }
+    _recency.splice(_recency.begin(), _recency, entry->second.recency);
+    return entry->second.response;
+}
+
+std::shared_ptr<const CachedResponse> ResponseCache::Peek(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    auto entry = _entries.find(key);
+    return entry == _entries.end() ? nullptr : entry->second.response;
+}
+
+bool ResponseCache::Admits(const std::string& key) const
+{
+    return _settings.admitAfterRequests <= 0 ||
+           EstimateHitterRequests(HitterScope::Url, key) >=
+               static_cast<uint64_t>(_settings.admitAfterRequests);
+}
+
+void ResponseCache::Store(const std::string& key, const std::string& response)
+{
+    if (GetResponseStatus(response) == 206)
+    {
+        StoreSegment(key, response);
+        return;
+    }
+
+    std::shared_ptr<CachedResponse> cached = MakeCachedResponse(response, _settings);
+    if (cached != nullptr)
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        Insert(key, std::move(cached));
+    }
+}
+
+std::shared_ptr<const CachedResponse> ResponseCache::Freshen(
+    const std::string& key,
+    const std::shared_ptr<const CachedResponse>& cached,
+    const std::string& notModified)
+{
+    auto refreshed = std::make_shared<CachedResponse>(*cached);
+    refreshed->storedAt = std::chrono::steady_clock::now();
+    if (!GetHeaderValue(notModified, "Cache-Control").empty() &&
+        !ApplyFreshness(*refreshed, notModified, _settings))
+    {
+        return cached;
+    }
+    std::string etag = GetHeaderValue(notModified, "ETag");
+    if (!etag.empty())
+    {
+        refreshed->etag = etag;
+    }
+
+    // Leave the entry alone if a full response replaced the copy in the meantime
+    std::lock_guard<std::mutex> lock(_lock);
+    auto entry = _entries.find(key);
+    if (entry != _entries.end() && entry->second.response == cached)
+    {
+        Insert(key, refreshed);
+    }
+    return refreshed;
+}
+
+bool ResponseCache::BeginRefresh(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    return _refreshing.insert(key).second;
+}
+
+void ResponseCache::EndRefresh(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    _refreshing.erase(key);
+}
+
+void ResponseCache::StoreSegment(const std::string& key, const std::string& response)
+{
+    // Only a single range with a known total length can be placed within the object, and only
+    // if its body arrived unframed
+    size_t headerEnd = response.find("\r\n\r\n");
+    if (headerEnd == std::string::npos)
+    {
+        return;
+    }
+    std::string headers = response.substr(0, headerEnd + 4);
+    uint64_t first = 0;
+    uint64_t last = 0;
+    uint64_t length = 0;
+    if (!ParseContentRange(GetHeaderValue(headers, "Content-Range"), first, last, length) ||
+        response.size() - headers.size() != last - first + 1 ||
+        length > _settings.maxEntryBytes || !GetHeaderValue(headers, "Transfer-Encoding").empty() ||
+        !GetHeaderValue(headers, "Vary").empty() || !GetHeaderValue(headers, "Set-Cookie").empty())
+    {
+        return;
+    }
+
+    // Partial objects are never revalidated, so one with no lifetime would never be used
+    auto partial = std::make_shared<CachedResponse>();
+    if (!ApplyFreshness(*partial, headers, _settings) || partial->freshFor.count() == 0)
+    {
+        return;
+    }
+    partial->etag = GetHeaderValue(headers, "ETag");
+    partial->lastModified = GetHeaderValue(headers, "Last-Modified");
+    partial->head = RemoveHeaders(headers, {"Content-Range", "Content-Length", "Age"}) + "\r\n";
+    partial->length = length;
+    partial->storedAt = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(_lock);
+
+    // Ranges of the same representation accumulate; a changed one starts over
+    auto existing = _entries.find(key);
+    if (existing != _entries.end())
+    {
+        const CachedResponse& current = *existing->second.response;
+        bool sameRepresentation = current.length == length && current.etag == partial->etag &&
+                                  current.lastModified == partial->lastModified;
+        if (sameRepresentation && current.IsComplete())
+        {
+            return;
+        }
+        if (sameRepresentation)
+        {
+            partial->segments = current.segments;
+        }
+    }
+    AddSegment(partial->segments, first, response.substr(headers.size()));
+
+    // Once every byte has arrived the object becomes a complete 200 response
+    const auto& whole = *partial->segments.begin();
+    if (partial->segments.size() == 1 && whole.first == 0 && whole.second->size() == length)
+    {
+        const std::string& head = partial->head;
+        size_t statusLineEnd = head.find("\r\n");
+        partial->head = head.substr(0, head.find(' ')) + " 200 OK" +
+                        head.substr(statusLineEnd, head.size() - statusLineEnd - 2) +
+                        "Content-Length: " + std::to_string(length) + "\r\n\r\n";
+        partial->chunks = ChunkBody(
+            whole.second->data(),
+            whole.second->size(),
+            CompressibleBody(partial->head, _settings));
+        partial->segments.clear();
+    }
+    Insert(key, std::move(partial));
+}
+
+void ResponseCache::Insert(const std::string& key, std::shared_ptr<CachedResponse> response)
+{
+    if (!ShareChunks(*response))
+    {
+        return;
+    }
+
+    // The new copy takes its chunks before the old one lets go, so shared ones stay put
+    Retain(*response);
+    auto entry = _entries.find(key);
+    if (entry != _entries.end())
+    {
+        Release(*entry->second.response);
+        _recency.splice(_recency.begin(), _recency, entry->second.recency);
+    }
+    else
+    {
+        _recency.push_front(key);
+        entry = _entries.emplace(key, Entry{nullptr, _recency.begin()}).first;
+    }
+    entry->second.response = std::move(response);
+
+    while (_bytes > _settings.capacityBytes && _recency.size() > 1)
+    {
+        auto victim = _entries.find(_recency.back());
+        Release(*victim->second.response);
+        _entries.erase(victim);
+        _recency.pop_back();
+    }
+}
+
+bool ResponseCache::ShareChunks(CachedResponse& response) const
+{
+    // A chunk repeated within the body shares its first copy, just as one already stored does
+    std::unordered_map<uint64_t, const BodyChunk*> earlier;
+    for (BodyChunk& chunk : response.chunks)
+    {
+        const BodyChunk* shared = nullptr;
+        auto stored = _chunks.find(chunk.hash);
+        auto seen = earlier.find(chunk.hash);
+        if (stored != _chunks.end())
+        {
+            shared = &stored->second.chunk;
+        }
+        else if (seen != earlier.end())
+        {
+            shared = seen->second;
+        }
+
+        if (shared != nullptr && shared->bytes != chunk.bytes)
+        {
+            if (!SameContent(*shared, chunk))
+            {
+                return false;
+            }
+            chunk = *shared;
+        }
+        earlier.emplace(chunk.hash, &chunk);
+    }
+    return true;
+}
+
+void ResponseCache::Retain(const CachedResponse& response)
+{
+    _bytes += response.StoredBytes();
+    for (const BodyChunk& chunk : response.chunks)
+    {
+        StoredChunk& stored = _chunks[chunk.hash];
+        if (stored.references++ == 0)
+        {
+            stored.chunk = chunk;
+            _bytes += chunk.bytes->size();
+            _chunkBytes += chunk.bytes->size();
+            _contentBytes += chunk.size;
+        }
+        _bodyBytes += chunk.size;
+    }
+}
+
+void ResponseCache::Release(const CachedResponse& response)
+{
+    _bytes -= response.StoredBytes();
+    for (const BodyChunk& chunk : response.chunks)
+    {
+        auto stored = _chunks.find(chunk.hash);
+        if (--stored->second.references == 0)
+        {
+            _bytes -= chunk.bytes->size();
+            _chunkBytes -= chunk.bytes->size();
+            _contentBytes -= chunk.size;
+            _chunks.erase(stored);
+        }
+        _bodyBytes -= chunk.size;
+    }
+}
+
+std::vector<std::pair<std::string, std::shared_ptr<const CachedResponse>>> ResponseCache::
+    GetEntries()
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    std::vector<std::pair<std::string, std::shared_ptr<const CachedResponse>>> entries;
+    entries.reserve(_entries.size());
+    for (const std::string& key : _recency)
+    {
+        entries.emplace_back(key, _entries[key].response);
+    }
+    return entries;
+}
+
+bool ResponseCache::Adopt(const std::string& key, std::shared_ptr<CachedResponse> response)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    if (_entries.count(key) != 0 || !ShareChunks(*response))
+    {
+        return false;
+    }
+
+    // Entries arrive in recency order, so once one doesn't fit the rest would be evicted first
+    Retain(*response);
+    if (_bytes > _settings.capacityBytes)
+    {
+        Release(*response);
+        return false;
+    }
+    _recency.push_back(key);
+    _entries.emplace(key, Entry{std::move(response), std::prev(_recency.end())});
+    return true;
+}
+
+CacheStats ResponseCache::GetStats()
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    CacheStats stats;
+    stats.entries = _entries.size();
+    stats.storedBytes = _bytes;
+    stats.bodyBytes = _bodyBytes;
+    stats.contentBytes = _contentBytes;
+    stats.chunkBytes = _chunkBytes;
+    return stats;
+}
@@ -0,0 +1,257 @@
+﻿/*****************************************************************
+ * @file   ResponseCache.h
+ * @brief  In-memory cache of origin responses, with conditional
+ * revalidation, stale serving windows and byte-range replies.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include "SliceList.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+struct CacheSettings
+{
+    size_t capacityBytes = 0; // 0 disables the cache
+    size_t maxEntryBytes = 1024 * 1024;
+
+    // Used when the origin's Cache-Control doesn't give stale-while-revalidate/stale-if-error
+    int staleWhileRevalidateSeconds = 0;
+    int staleIfErrorSeconds = 0;
+
+    // Store a response only once its URL has been requested this many times recently, going
+    // by the heavy-hitter sketch, so one-off URLs don't push out popular ones; 0 admits all
+    int admitAfterRequests = 0;
+
+    // Hold complete bodies compressed, expanded again as replies are sent; bodies the origin
+    // already encoded and compressed media types are held as they are
+    bool compressBodies = false;
+};
+
+using SegmentMap = std::map<uint64_t, std::shared_ptr<const std::string>>;
+
+// A fixed-size piece of a complete body, keyed by a hash of its content. The cache keeps one
+// copy of each distinct chunk, shared by every entry whose body contains it.
+struct BodyChunk
+{
+    uint64_t hash = 0;   // Of the content as sent, whether or not it is held compressed
+    size_t size = 0;     // Content bytes
+    bool packed = false; // bytes holds the content compressed with CompressBlock
+    std::shared_ptr<const std::string> bytes;
+};
+
+struct CachedReply;
+
+// An origin response, with what is needed to judge its age and revalidate it. A complete entry
+// holds the whole 200 response; a partial one holds byte ranges collected from 206 responses.
+struct CachedResponse
+{
+    // Complete: status line and headers as the origin sent them, through the blank line, less
+    // Age. Partial: those of the first 206, without Content-Range, Content-Length and Age.
+    std::string head;
+    uint64_t length = 0; // Length of the whole body
+
+    // Complete only: the body, every chunk but the last exactly bodyChunkBytes long
+    std::vector<BodyChunk> chunks;
+
+    // Partial only: stored ranges keyed by their first byte, never overlapping or adjacent
+    SegmentMap segments;
+
+    std::string etag;
+    std::string lastModified;
+    std::chrono::steady_clock::time_point storedAt;
+    std::chrono::seconds originAge{0}; // The Age it already had when stored
+    std::chrono::seconds freshFor{0};
+    std::chrono::seconds staleWhileRevalidate{0}; // Beyond freshFor
+    std::chrono::seconds staleIfError{0};         // Beyond freshFor
+
+    bool HasValidators() const
+    {
+        return !etag.empty() || !lastModified.empty();
+    }
+
+    bool IsComplete() const
+    {
+        return segments.empty();
+    }
+
+    // Whether every body byte in [first, last] is stored
+    bool HasBody(uint64_t first, uint64_t last) const;
+
+    // Appends body bytes [first, last], which must be stored, as slices of the chunks or range
+    void AddBody(uint64_t first, uint64_t last, CachedReply& reply) const;
+
+    // Bytes held outside the shared chunks, for capacity accounting
+    size_t StoredBytes() const;
+};
+
+const size_t bodyChunkBytes = 16 * 1024;
+
+struct CacheStats
+{
+    size_t entries = 0;
+    size_t storedBytes = 0; // Counted against capacity: heads, ranges and each chunk once
+    size_t bodyBytes = 0;    // Complete bodies as the entries see them, shared chunks repeated
+    size_t contentBytes = 0; // Distinct chunks for those bodies, as sent
+    size_t chunkBytes = 0;   // Distinct chunks as actually held, some of them compressed
+};
+
+// A stretch of a compressed chunk, expanded only when its turn to be sent comes
+struct PackedSlice
+{
+    const BodyChunk* chunk = nullptr;
+    size_t offset = 0;
+    size_t size = 0;
+};
+
+// A reply built from a cache entry: generated header text interleaved with slices of the stored
+// body, sent in order. It holds the entry, so range replies never copy the object.
+struct CachedReply
+{
+    int status = 0;
+    std::shared_ptr<const CachedResponse> source;
+    SliceList slices;
+
+    // Each slice with no data stands for the next of these, in order
+    std::vector<PackedSlice> packed;
+};
+
+// Expands a compressed chunk's content into buffer; false if it is corrupt
+bool ExpandChunk(const BodyChunk& chunk, std::string& buffer);
+
+enum class CacheState
+{
+    Fresh,                // Serve as is
+    StaleWhileRevalidate, // Serve as is and revalidate in the background
+    Stale,                // Revalidate with the origin before serving
+};
+
+CacheState GetCacheState(const CachedResponse& cached, std::chrono::steady_clock::time_point now);
+
+// Whether the copy may still stand in for an origin that failed or answered with a 5xx
+bool WithinStaleIfError(const CachedResponse& cached, std::chrono::steady_clock::time_point now);
+
+// Whether a request's response may come from, or be stored in, the cache; needs the full head
+bool RequestCacheable(const std::string& requestHead);
+
+// The client asked for the origin to confirm any stored copy (no-cache or max-age=0)
+bool RequestForcesRevalidation(const std::string& requestHead);
+
+// Revalidation request for the whole stored object: the client's request head with its own
+// conditionals and Range replaced by the cached copy's validators
+std::string MakeConditionalRequest(const std::string& requestHead, const CachedResponse& cached);
+
+// Answers the request from the entry with the whole response, a 206 for the ranges it asks for
+// (multipart/byteranges for several) or a 416. False when a partial entry lacks requested bytes
+// or the request isn't for a range it could answer.
+bool BuildCachedReply(
+    const std::shared_ptr<const CachedResponse>& cached,
+    const std::string& requestHead,
+    CachedReply& reply);
+
+// Whole responses keyed by host and path, evicted least recently used first once over capacity.
+// Entries are immutable and shared, so a refresh never disturbs a client still sending one.
+// Identical bodies behind different URLs (versioned asset paths, mirrors) share their chunks,
+// and chunks may be held compressed, so capacity counts what is actually held.
+class ResponseCache
+{
+public:
+    void Configure(const CacheSettings& settings);
+
+    bool IsEnabled() const
+    {
+        return _settings.capacityBytes > 0;
+    }
+
+    const CacheSettings& GetSettings() const
+    {
+        return _settings;
+    }
+
+    std::shared_ptr<const CachedResponse> Lookup(const std::string& key);
+
+    // Like Lookup, but leaves the entry's place in the eviction order alone, for lookups made
+    // on behalf of another node rather than a client of this one
+    std::shared_ptr<const CachedResponse> Peek(const std::string& key);
+
+    // Whether a response for key not yet in the cache is popular enough to store
+    bool Admits(const std::string& key) const;
+
+    // Stores a complete origin response if it is cacheable, replacing any older copy. A single
+    // range 206 is merged into the key's partial entry, which becomes complete once every byte
+    // has arrived.
+    void Store(const std::string& key, const std::string& response);
+
+    // A 304 confirmed the copy: it becomes fresh again, with freshness from the 304's headers.
+    // Returns the refreshed copy, or the one given if the 304 may not be applied.
+    std::shared_ptr<const CachedResponse> Freshen(
+        const std::string& key,
+        const std::shared_ptr<const CachedResponse>& cached,
+        const std::string& notModified);
+
+    // Claims the background refresh for key; false while another one is already running
+    bool BeginRefresh(const std::string& key);
+
+    void EndRefresh(const std::string& key);
+
+    // Every entry, most recently used first, for handing the cache to a successor process
+    std::vector<std::pair<std::string, std::shared_ptr<const CachedResponse>>> GetEntries();
+
+    // Takes an entry handed over by the process this one replaced, as less recently used than
+    // any already here. False if the key was stored since or the cache has no room left.
+    bool Adopt(const std::string& key, std::shared_ptr<CachedResponse> response);
+
+    CacheStats GetStats();
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<const CachedResponse> response;
+        std::list<std::string>::iterator recency;
+    };
+
+    struct StoredChunk
+    {
+        BodyChunk chunk;
+        size_t references = 0; // Entries holding the chunk
+    };
+
+    void Insert(const std::string& key, std::shared_ptr<CachedResponse> response);
+    void StoreSegment(const std::string& key, const std::string& response);
+
+    // Points the response's chunks at stored copies of the same content, or at the first copy
+    // within the response. False if a chunk's hash matches one of those with different bytes,
+    // in which case it can't be cached.
+    bool ShareChunks(CachedResponse& response) const;
+
+    void Retain(const CachedResponse& response);
+    void Release(const CachedResponse& response);
+
+    CacheSettings _settings;
+    std::mutex _lock;
+    std::unordered_map<std::string, Entry> _entries;
+    std::list<std::string> _recency; // Most recently used first
+    std::unordered_map<uint64_t, StoredChunk> _chunks;
+    size_t _bytes = 0;
+    size_t _bodyBytes = 0;
+    size_t _contentBytes = 0;
+    size_t _chunkBytes = 0;
+    std::unordered_set<std::string> _refreshing;
+};
+
+// Configured by main before any client thread starts
+extern ResponseCache responseCache;
@@ -0,0 +1,369 @@
+﻿/*****************************************************************
+ * @file   ReverseProxy.cpp
+ * @brief  Route table, backend pools and active health checks used
+ * when the proxy runs in front of a fleet of backend servers.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "ReverseProxy.h"
+#include "AsyncLogger.h"
+#include "Hash.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+// Virtual nodes per unit of weight; enough to keep the key spread even for small pools
+const int ringReplicas = 64;
+
+std::unique_ptr<RouteTable> routeTable;
+
+std::string ToLower(std::string value)
+{
+    std::transform(
+        value.begin(), value.end(), value.begin(), [](unsigned char c) { return std::tolower(c); });
+    return value;
+}
+
+// Connects to the backend and expects a 2xx or 3xx status line for the health check path
+bool ProbeBackend(const Backend& backend, const HealthCheckSettings& settings)
+{
+    SOCKET probeSocket = ConnectHappyEyeballs(backend.addresses.get(), settings.timeoutMs);
+    if (probeSocket == INVALID_SOCKET)
+    {
+        return false;
+    }
+
+    DWORD timeout = settings.timeoutMs;
+    setsockopt(
+        probeSocket, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<char*>(&timeout), sizeof(timeout));
+
+    bool healthy = false;
+    std::string request = "GET " + settings.path + " HTTP/1.0\r\nHost: " + backend.host +
+                          "\r\nConnection: close\r\n\r\n";
+    if (send(probeSocket, request.c_str(), static_cast<int>(request.size()), 0) != SOCKET_ERROR)
+    {
+        char status[16] = {};
+        int received = 0;
+        while (received < 12)
+        {
+            int bytes = recv(probeSocket, status + received, 12 - received, 0);
+            if (bytes <= 0)
+            {
+                break;
+            }
+            received += bytes;
+        }
+        // "HTTP/1.x 2xx" or "HTTP/1.x 3xx"
+        healthy = received == 12 && strncmp(status, "HTTP/1.", 7) == 0 &&
+                  (status[9] == '2' || status[9] == '3');
+    }
+
+    shutdown(probeSocket, SD_BOTH);
+    closesocket(probeSocket);
+    return healthy;
+}
+
+void RecordProbe(BackendPool& pool, Backend& backend, bool success)
+{
+    const HealthCheckSettings& settings = pool.GetHealthCheck();
+    if (success)
+    {
+        backend.consecutiveFailures = 0;
+        if (++backend.consecutiveSuccesses >= settings.rise && !backend.healthy.load())
+        {
+            backend.healthy.store(true);
+            LogInfo(
+                "Backend " + backend.host + ":" + std::to_string(backend.port) + " in pool " +
+                pool.GetName() + " is healthy again");
+        }
+    }
+    else
+    {
+        backend.consecutiveSuccesses = 0;
+        if (++backend.consecutiveFailures >= settings.fall && backend.healthy.load())
+        {
+            backend.healthy.store(false);
+            LogInfo(
+                "Backend " + backend.host + ":" + std::to_string(backend.port) + " in pool " +
+                pool.GetName() + " failed its health check, ejecting");
+        }
+    }
+}
+
+void HealthCheckLoop(RouteTable* table)
+{
+    using Clock = std::chrono::steady_clock;
+    std::vector<Clock::time_point> nextProbe(table->GetPools().size(), Clock::now());
+
+    while (true)
+    {
+        for (size_t i = 0; i < table->GetPools().size(); ++i)
+        {
+            BackendPool& pool = *table->GetPools()[i];
+            if (!pool.GetHealthCheck().enabled || Clock::now() < nextProbe[i])
+            {
+                continue;
+            }
+
+            for (std::unique_ptr<Backend>& backend : pool.GetBackends())
+            {
+                RecordProbe(pool, *backend, ProbeBackend(*backend, pool.GetHealthCheck()));
+            }
+            nextProbe[i] =
+                Clock::now() + std::chrono::milliseconds(pool.GetHealthCheck().intervalMs);
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+} // namespace
+
+void BackendPool::AddBackend(std::unique_ptr<Backend> backend)
+{
+    _backends.push_back(std::move(backend));
+}
+
+void BackendPool::BuildRing()
+{
+    _ring.clear();
+    for (size_t i = 0; i < _backends.size(); ++i)
+    {
+        const Backend& backend = *_backends[i];
+        uint64_t base = HashString(backend.host + ":" + std::to_string(backend.port));
+        for (int replica = 0; replica < ringReplicas * backend.weight; ++replica)
+        {
+            _ring.emplace_back(MixHash(base + replica), i);
+        }
+    }
+    std::sort(_ring.begin(), _ring.end());
+}
+
+Backend* BackendPool::Select(const std::string& key) const
+{
+    if (_backends.empty())
+    {
+        return nullptr;
+    }
+    return _policy == BalancePolicy::ConsistentHash ? SelectByHash(key) : SelectLeastOutstanding();
+}
+
+Backend* BackendPool::SelectByHash(const std::string& key) const
+{
+    // Walk clockwise from the key's point, skipping ejected backends so that only the
+    // keys owned by an unhealthy backend move
+    uint64_t point = MixHash(HashString(key));
+    auto start = std::lower_bound(
+        _ring.begin(), _ring.end(), std::make_pair(point, static_cast<size_t>(0)));
+    size_t offset = static_cast<size_t>(start - _ring.begin());
+    for (size_t i = 0; i < _ring.size(); ++i)
+    {
+        Backend* backend = _backends[_ring[(offset + i) % _ring.size()].second].get();
+        if (backend->healthy.load(std::memory_order_relaxed))
+        {
+            return backend;
+        }
+    }
+    return nullptr;
+}
+
+Backend* BackendPool::SelectLeastOutstanding() const
+{
+    Backend* best = nullptr;
+    double bestLoad = 0.0;
+    for (const std::unique_ptr<Backend>& backend : _backends)
+    {
+        if (!backend->healthy.load(std::memory_order_relaxed))
+        {
+            continue;
+        }
+        double load = static_cast<double>(backend->outstanding.load(std::memory_order_relaxed)) /
+                      backend->weight;
+        if (best == nullptr || load < bestLoad)
+        {
+            best = backend.get();
+            bestLoad = load;
+        }
+    }
+    return best;
+}
+
+BackendPool* RouteTable::GetOrCreatePool(const std::string& name)
+{
+    for (std::unique_ptr<BackendPool>& pool : _pools)
+    {
+        if (pool->GetName() == name)
+        {
+            return pool.get();
+        }
+    }
+    _pools.push_back(std::make_unique<BackendPool>(name));
+    return _pools.back().get();
+}
+
+bool RouteTable::Load(const std::string& fileName)
+{
+    std::ifstream file(fileName);
+    if (!file)
+    {
+        std::cerr << "Unable to open route table " << fileName << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        ++lineNumber;
+        line = line.substr(0, line.find('#'));
+        std::istringstream iss(line);
+        std::string directive;
+        if (!(iss >> directive))
+        {
+            continue;
+        }
+
+        bool valid = true;
+        if (directive == "pool")
+        {
+            std::string name, policy;
+            valid = static_cast<bool>(iss >> name >> policy) &&
+                    (policy == "hash" || policy == "least");
+            if (valid)
+            {
+                GetOrCreatePool(name)->SetPolicy(
+                    policy == "hash" ? BalancePolicy::ConsistentHash
+                                     : BalancePolicy::LeastOutstanding);
+            }
+        }
+        else if (directive == "backend")
+        {
+            std::string poolName, hostPort;
+            auto backend = std::make_unique<Backend>();
+            valid = static_cast<bool>(iss >> poolName >> hostPort) &&
+                    SplitHostPort(hostPort, backend->host, backend->port);
+            if (valid && !(iss >> backend->weight))
+            {
+                backend->weight = 1;
+            }
+            if (valid && backend->weight > 0)
+            {
+                backend->addresses = ResolveHost(backend->host, backend->port);
+            }
+            if (valid && (backend->weight <= 0 || backend->addresses == nullptr))
+            {
+                std::cerr << "Unable to resolve backend " << hostPort << std::endl;
+                valid = false;
+            }
+            if (valid)
+            {
+                GetOrCreatePool(poolName)->AddBackend(std::move(backend));
+            }
+        }
+        else if (directive == "route")
+        {
+            Route route;
+            std::string poolName;
+            valid = static_cast<bool>(iss >> route.host >> route.pathPrefix >> poolName);
+            if (valid)
+            {
+                route.host = ToLower(route.host);
+                route.pool = GetOrCreatePool(poolName);
+                _routes.push_back(route);
+            }
+        }
+        else if (directive == "health")
+        {
+            std::string poolName;
+            HealthCheckSettings settings;
+            valid = static_cast<bool>(iss >> poolName >> settings.path >> settings.intervalMs) &&
+                    settings.intervalMs > 0;
+            if (valid)
+            {
+                iss >> settings.fall >> settings.rise;
+                settings.enabled = true;
+                settings.timeoutMs = std::min(settings.timeoutMs, settings.intervalMs);
+                GetOrCreatePool(poolName)->GetHealthCheck() = settings;
+            }
+        }
+        else
+        {
+            valid = false;
+        }
+
+        if (!valid)
+        {
+            std::cerr << fileName << ":" << lineNumber << ": invalid directive: " << line
+                      << std::endl;
+            return false;
+        }
+    }
+
+    for (std::unique_ptr<BackendPool>& pool : _pools)
+    {
+        if (pool->GetBackends().empty())
+        {
+            std::cerr << "Pool " << pool->GetName() << " has no backends" << std::endl;
+            return false;
+        }
+        pool->BuildRing();
+    }
+
+    return true;
+}
+
+const Route* RouteTable::Match(const std::string& host, const std::string& path) const
+{
+    std::string lowerHost = ToLower(host);
+    const Route* best = nullptr;
+    for (const Route& route : _routes)
+    {
+        bool hostMatches = route.host == lowerHost || route.host == "*";
+        if (!hostMatches || path.compare(0, route.pathPrefix.size(), route.pathPrefix) != 0)
+        {
+            continue;
+        }
+        // An exact host beats the wildcard, then the longer prefix wins
+        if (best == nullptr || (best->host == "*" && route.host != "*") ||
+            (best->host == route.host && route.pathPrefix.size() > best->pathPrefix.size()))
+        {
+            best = &route;
+        }
+    }
+    return best;
+}
+
+bool LoadRouteTable(const std::string& fileName)
+{
+    auto table = std::make_unique<RouteTable>();
+    if (!table->Load(fileName))
+    {
+        return false;
+    }
+    routeTable = std::move(table);
+    return true;
+}
+
+RouteTable* GetRouteTable()
+{
+    return routeTable.get();
+}
+
+void StartHealthChecks()
+{
+    if (routeTable == nullptr)
+    {
+        return;
+    }
+
+    std::thread healthThread(HealthCheckLoop, routeTable.get());
+    healthThread.detach();
+}
@@ -0,0 +1,159 @@
+﻿/*****************************************************************
+ * @file   ReverseProxy.h
+ * @brief  Route table, backend pools and active health checks used
+ * when the proxy runs in front of a fleet of backend servers.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *
+ * Route table file format, one directive per line ('#' starts a comment):
+ *   pool    <name> hash|least
+ *   backend <pool> <host>:<port> [weight]
+ *   route   <host|*> <pathPrefix> <pool>
+ *   health  <pool> <path> <intervalMs> [fall] [rise]
+ *****************************************************************/
+
+#pragma once
+
+#include "HappyEyeballs.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum class BalancePolicy
+{
+    ConsistentHash,   // Same key always lands on the same backend, for cache locality
+    LeastOutstanding, // Backend with the fewest in-flight requests per unit of weight
+};
+
+struct Backend
+{
+    std::string host;
+    int port = 80;
+    int weight = 1;
+    AddressList addresses; // Every resolved address, raced on connect
+
+    std::atomic<bool> healthy{true};
+    std::atomic<int> outstanding{0};
+
+    // Only touched by the health check thread
+    int consecutiveFailures = 0;
+    int consecutiveSuccesses = 0;
+};
+
+struct HealthCheckSettings
+{
+    bool enabled = false;
+    std::string path = "/";
+    int intervalMs = 5000;
+    int timeoutMs = 1000;
+    int fall = 2; // Consecutive failures before a backend is ejected
+    int rise = 2; // Consecutive successes before it is restored
+};
+
+class BackendPool
+{
+public:
+    explicit BackendPool(const std::string& name) : _name(name)
+    {
+    }
+
+    const std::string& GetName() const
+    {
+        return _name;
+    }
+
+    void SetPolicy(BalancePolicy policy)
+    {
+        _policy = policy;
+    }
+
+    HealthCheckSettings& GetHealthCheck()
+    {
+        return _healthCheck;
+    }
+
+    std::vector<std::unique_ptr<Backend>>& GetBackends()
+    {
+        return _backends;
+    }
+
+    void AddBackend(std::unique_ptr<Backend> backend);
+
+    // Rebuilds the consistent hash ring; call once all backends have been added
+    void BuildRing();
+
+    // Picks a healthy backend for the request key, or nullptr when every backend is ejected
+    Backend* Select(const std::string& key) const;
+
+private:
+    Backend* SelectByHash(const std::string& key) const;
+    Backend* SelectLeastOutstanding() const;
+
+    std::string _name;
+    BalancePolicy _policy = BalancePolicy::ConsistentHash;
+    HealthCheckSettings _healthCheck;
+    std::vector<std::unique_ptr<Backend>> _backends;
+    std::vector<std::pair<uint64_t, size_t>> _ring; // (point on the ring, backend index)
+};
+
+struct Route
+{
+    std::string host; // Lower case, without port; "*" matches any host
+    std::string pathPrefix;
+    BackendPool* pool = nullptr;
+};
+
+class RouteTable
+{
+public:
+    bool Load(const std::string& fileName);
+
+    // Longest path prefix among routes for the host, falling back to the "*" routes
+    const Route* Match(const std::string& host, const std::string& path) const;
+
+    std::vector<std::unique_ptr<BackendPool>>& GetPools()
+    {
+        return _pools;
+    }
+
+private:
+    BackendPool* GetOrCreatePool(const std::string& name);
+
+    std::vector<std::unique_ptr<BackendPool>> _pools;
+    std::vector<Route> _routes;
+};
+
+// Keeps a backend's outstanding request count raised for the lifetime of a request
+class BackendLease
+{
+public:
+    explicit BackendLease(Backend* backend) : _backend(backend)
+    {
+        _backend->outstanding.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ~BackendLease()
+    {
+        _backend->outstanding.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    BackendLease(const BackendLease&) = delete;
+    BackendLease& operator=(const BackendLease&) = delete;
+
+private:
+    Backend* _backend;
+};
+
+// Loads the route table used by every client thread; returns false on a malformed file
+bool LoadRouteTable(const std::string& fileName);
+
+// The active route table, or nullptr when running as a plain forward proxy
+RouteTable* GetRouteTable();
+
+// Starts the background thread that probes every pool with health checks enabled
+void StartHealthChecks();
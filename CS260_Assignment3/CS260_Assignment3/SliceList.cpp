@@ -0,0 +1,63 @@
+﻿/*****************************************************************
+ * @file   SliceList.cpp
+ * @brief  A message assembled from slices of existing buffers and
+ * short owned fragments, sent with vectored I/O.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "SliceList.h"
+
+size_t SliceList::Size() const
+{
+    size_t size = 0;
+    for (const auto& piece : _pieces)
+    {
+        size += piece.second;
+    }
+    return size;
+}
+
+bool SliceList::SendTo(SOCKET socket) const
+{
+    std::vector<WSABUF> buffers;
+    buffers.reserve(_pieces.size());
+    for (const auto& piece : _pieces)
+    {
+        WSABUF buffer;
+        buffer.buf = const_cast<CHAR*>(piece.first);
+        buffer.len = static_cast<ULONG>(piece.second);
+        buffers.push_back(buffer);
+    }
+
+    // A blocking send normally takes everything at once; resume after whatever did go out
+    size_t next = 0;
+    while (next < buffers.size())
+    {
+        DWORD bytesSent = 0;
+        if (WSASend(
+                socket,
+                &buffers[next],
+                static_cast<DWORD>(buffers.size() - next),
+                &bytesSent,
+                0,
+                nullptr,
+                nullptr) == SOCKET_ERROR)
+        {
+            return false;
+        }
+        while (next < buffers.size() && bytesSent >= buffers[next].len)
+        {
+            bytesSent -= buffers[next].len;
+            ++next;
+        }
+        if (next < buffers.size())
+        {
+            buffers[next].buf += bytesSent;
+            buffers[next].len -= bytesSent;
+        }
+    }
+    return true;
+}
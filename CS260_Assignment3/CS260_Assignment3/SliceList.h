@@ -0,0 +1,52 @@
+﻿/*****************************************************************
+ * @file   SliceList.h
+ * @brief  A message assembled from slices of existing buffers and
+ * short owned fragments, sent with vectored I/O.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <WinSock2.h>
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Slices point into buffers the list doesn't own, which must outlive it; fragments added as
+// text are owned. Changing part of a message this way copies none of the rest.
+class SliceList
+{
+public:
+    void AddText(std::string value)
+    {
+        _text.push_back(std::move(value));
+        _pieces.emplace_back(_text.back().data(), _text.back().size());
+    }
+
+    void AddBytes(const char* data, size_t size)
+    {
+        if (size > 0)
+        {
+            _pieces.emplace_back(data, size);
+        }
+    }
+
+    const std::vector<std::pair<const char*, size_t>>& Pieces() const
+    {
+        return _pieces;
+    }
+
+    size_t Size() const;
+
+    // Sends every piece in order with as few WSASend calls as the socket allows
+    bool SendTo(SOCKET socket) const;
+
+private:
+    std::deque<std::string> _text; // Deque, so pieces pointing into earlier text stay valid
+    std::vector<std::pair<const char*, size_t>> _pieces;
+};
@@ -0,0 +1,137 @@
+﻿/*****************************************************************
+ * @file   TcpInfo.cpp
+ * @brief  Reads a connection's TCP state from the stack, so slow
+ * transfers can be put down to the network, the peer or the proxy.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "TcpInfo.h"
+#include "Metrics.h"
+#include <mstcpip.h>
+#include <algorithm>
+
+namespace
+{
+// Payload bytes that reached the peer, or arrived from it: the client side sends the
+// response, while the upstream side receives it
+uint64_t Delivered(const TcpSample& sample, TcpSide side)
+{
+    return side == TcpSide::Client ? sample.bytesSent - sample.bytesRetransmitted
+                                   : sample.bytesReceived;
+}
+} // namespace
+
+bool SampleTcpInfo(SOCKET socket, TcpSample& sample)
+{
+    sample = TcpSample();
+
+    // Version 1 adds the send-limit times; older systems only answer version 0, whose fields
+    // are the start of version 1's
+    TCP_INFO_v1 info = {};
+    DWORD version = 1;
+    DWORD bytesReturned = 0;
+    if (WSAIoctl(
+            socket,
+            SIO_TCP_INFO,
+            &version,
+            sizeof(version),
+            &info,
+            sizeof(info),
+            &bytesReturned,
+            nullptr,
+            nullptr) != 0)
+    {
+        version = 0;
+        if (WSAIoctl(
+                socket,
+                SIO_TCP_INFO,
+                &version,
+                sizeof(version),
+                &info,
+                sizeof(TCP_INFO_v0),
+                &bytesReturned,
+                nullptr,
+                nullptr) != 0)
+        {
+            return false;
+        }
+    }
+
+    sample.valid = true;
+    sample.rttUs = info.RttUs;
+    sample.minRttUs = info.MinRttUs;
+    sample.cwndBytes = info.Cwnd;
+    sample.mss = info.Mss;
+    sample.bytesSent = info.BytesOut;
+    sample.bytesReceived = info.BytesIn;
+    sample.bytesRetransmitted = info.BytesRetrans;
+    sample.timeoutEpisodes = info.TimeoutEpisodes;
+    sample.fastRetransmits = info.FastRetrans;
+    sample.connectionMs = info.ConnectionTimeMs;
+    if (version == 1)
+    {
+        sample.hasSendLimits = true;
+        sample.receiverLimitedMs = info.SndLimTimeRwin;
+        sample.congestionLimitedMs = info.SndLimTimeCwnd;
+        sample.senderLimitedMs = info.SndLimTimeSnd;
+    }
+    return true;
+}
+
+TcpWatch::TcpWatch(SOCKET socket, TcpSide side, std::chrono::milliseconds interval)
+    : _socket(socket), _side(side), _interval(interval),
+      _lastPolled(std::chrono::steady_clock::now()), _lastSampled(_lastPolled)
+{
+}
+
+void TcpWatch::Poll()
+{
+    if (_interval.count() <= 0)
+    {
+        return;
+    }
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now - _lastPolled >= _interval)
+    {
+        _lastPolled = now;
+        Sample(now);
+    }
+}
+
+TcpSample TcpWatch::Finish()
+{
+    if (_interval.count() <= 0 || !Sample(std::chrono::steady_clock::now()))
+    {
+        return TcpSample();
+    }
+    CountTcpConnection(_side, _last);
+    return _last;
+}
+
+bool TcpWatch::Sample(std::chrono::steady_clock::time_point now)
+{
+    TcpSample sample;
+    if (!SampleTcpInfo(_socket, sample))
+    {
+        return false;
+    }
+
+    // Delivery rate over the time since the previous sample, or since the connection opened.
+    // Windows doesn't report one itself, unlike Linux's tcpi_delivery_rate.
+    uint64_t delivered = Delivered(sample, _side);
+    uint64_t elapsedMs = sample.connectionMs;
+    if (_last.valid)
+    {
+        delivered -= std::min(delivered, Delivered(_last, _side));
+        elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - _lastSampled)
+                        .count();
+    }
+    RecordTcpSample(_side, sample, elapsedMs == 0 ? 0 : delivered * 1000 / elapsedMs);
+
+    _last = sample;
+    _lastSampled = now;
+    return true;
+}
@@ -0,0 +1,79 @@
+﻿/*****************************************************************
+ * @file   TcpInfo.h
+ * @brief  Reads a connection's TCP state from the stack, so slow
+ * transfers can be put down to the network, the peer or the proxy.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <WinSock2.h>
+#include <chrono>
+#include <cstdint>
+
+enum class TcpSide
+{
+    Client,   // The connection the proxy accepted
+    Upstream, // The connection the proxy made to the origin, backend or sibling
+    Count,
+};
+
+// One reading of SIO_TCP_INFO. Byte and time totals run from when the connection opened.
+struct TcpSample
+{
+    bool valid = false;
+    uint32_t rttUs = 0;    // Smoothed round-trip time
+    uint32_t minRttUs = 0; // Lowest round-trip time seen, the path's floor
+    uint32_t cwndBytes = 0;
+    uint32_t mss = 0;
+    uint64_t bytesSent = 0; // Retransmissions included
+    uint64_t bytesReceived = 0;
+    uint64_t bytesRetransmitted = 0;
+    uint32_t timeoutEpisodes = 0; // Retransmission timeouts, the costly kind of loss
+    uint32_t fastRetransmits = 0;
+    uint64_t connectionMs = 0;
+
+    // Time the sender spent held back by the receiver's window, the congestion window, or
+    // having nothing to send. Only Windows 10 1809 and later report them.
+    bool hasSendLimits = false;
+    uint64_t receiverLimitedMs = 0;
+    uint64_t congestionLimitedMs = 0;
+    uint64_t senderLimitedMs = 0;
+};
+
+// False, leaving sample invalid, if the stack can't report on the socket
+bool SampleTcpInfo(SOCKET socket, TcpSample& sample);
+
+// Samples one of a request's sockets every interval while its response relays, and a last
+// time as the request ends. Every sample feeds the RTT and delivery-rate histograms; the last
+// one also adds the connection's retransmission and send-limit totals to the counters.
+class TcpWatch
+{
+public:
+    // Samples nothing when interval is zero
+    TcpWatch(SOCKET socket, TcpSide side, std::chrono::milliseconds interval);
+
+    TcpWatch(const TcpWatch&) = delete;
+    TcpWatch& operator=(const TcpWatch&) = delete;
+
+    // Cheap enough for every pass of a relay loop: samples only once the interval has passed
+    void Poll();
+
+    // Takes the final sample, before the socket closes; invalid when sampling is off or failed
+    TcpSample Finish();
+
+private:
+    bool Sample(std::chrono::steady_clock::time_point now);
+
+    SOCKET _socket;
+    TcpSide _side;
+    std::chrono::milliseconds _interval;
+
+    // Failed samples count as polls too, so a stack without SIO_TCP_INFO isn't asked every pass
+    std::chrono::steady_clock::time_point _lastPolled;
+    std::chrono::steady_clock::time_point _lastSampled;
+    TcpSample _last;
+};
@@ -0,0 +1,131 @@
+﻿/*****************************************************************
+ * @file   Tracer.cpp
+ * @brief  Sampling request tracer that keeps per-phase spans in a
+ * lock-free ring and dumps them as Chrome trace-event JSON.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "Tracer.h"
+#include <Windows.h>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+
+namespace
+{
+const uint64_t traceCapacity = 16384; // Spans kept; must be a power of two
+
+const char* const phaseNames[static_cast<size_t>(TracePhase::Count)] =
+    {"receive", "parse_host", "resolve", "connect", "upload", "first_byte", "relay", "close"};
+
+// Writers claim slots round-robin and overwrite the oldest span. The sequence number works
+// like a seqlock: odd while the slot is being written, so a concurrent dump skips it.
+struct TraceSlot
+{
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<uint64_t> connectionId{0};
+    std::atomic<uint64_t> startUs{0};
+    std::atomic<uint64_t> durationUs{0};
+    std::atomic<uint64_t> threadAndPhase{0}; // Thread ID << 8 | phase
+};
+
+std::atomic<int> sampleEvery{0};
+std::atomic<uint64_t> nextTicket{0};
+std::unique_ptr<TraceSlot[]> slots;
+const std::chrono::steady_clock::time_point traceEpoch = std::chrono::steady_clock::now();
+
+uint64_t MicrosSinceEpoch(std::chrono::steady_clock::time_point time)
+{
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(time - traceEpoch).count());
+}
+} // namespace
+
+void ConfigureTracing(int every)
+{
+    if (every > 0 && slots == nullptr)
+    {
+        slots = std::make_unique<TraceSlot[]>(traceCapacity);
+    }
+    sampleEvery.store(every > 0 ? every : 0, std::memory_order_release);
+}
+
+bool ShouldTrace(uint64_t connectionId)
+{
+    int every = sampleEvery.load(std::memory_order_relaxed);
+    return every > 0 && connectionId % every == 0;
+}
+
+void RecordSpan(
+    uint64_t connectionId,
+    TracePhase phase,
+    std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::time_point end)
+{
+    uint64_t startUs = MicrosSinceEpoch(start);
+    uint64_t ticket = nextTicket.fetch_add(1, std::memory_order_relaxed);
+    TraceSlot& slot = slots[ticket & (traceCapacity - 1)];
+
+    slot.sequence.store(2 * ticket + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.connectionId.store(connectionId, std::memory_order_relaxed);
+    slot.startUs.store(startUs, std::memory_order_relaxed);
+    slot.durationUs.store(MicrosSinceEpoch(end) - startUs, std::memory_order_relaxed);
+    slot.threadAndPhase.store(
+        static_cast<uint64_t>(GetCurrentThreadId()) << 8 | static_cast<uint64_t>(phase),
+        std::memory_order_relaxed);
+    slot.sequence.store(2 * ticket + 2, std::memory_order_release);
+}
+
+std::string RenderTrace()
+{
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    uint64_t end = nextTicket.load(std::memory_order_acquire);
+    uint64_t begin = end > traceCapacity ? end - traceCapacity : 0;
+
+    for (uint64_t ticket = begin; ticket < end && slots != nullptr; ++ticket)
+    {
+        TraceSlot& slot = slots[ticket & (traceCapacity - 1)];
+        uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        uint64_t connectionId = slot.connectionId.load(std::memory_order_relaxed);
+        uint64_t startUs = slot.startUs.load(std::memory_order_relaxed);
+        uint64_t durationUs = slot.durationUs.load(std::memory_order_relaxed);
+        uint64_t threadAndPhase = slot.threadAndPhase.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // Skip slots still being written or already reused by a newer span
+        if (sequence != 2 * ticket + 2 ||
+            slot.sequence.load(std::memory_order_relaxed) != sequence)
+        {
+            continue;
+        }
+
+        size_t phase = static_cast<size_t>(threadAndPhase & 0xff);
+        if (phase >= static_cast<size_t>(TracePhase::Count))
+        {
+            continue;
+        }
+
+        char buffer[256];
+        snprintf(
+            buffer,
+            sizeof(buffer),
+            "%s\n{\"name\":\"%s\",\"cat\":\"proxy\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,"
+            "\"pid\":1,\"tid\":%llu,\"args\":{\"conn\":%llu}}",
+            first ? "" : ",",
+            phaseNames[phase],
+            static_cast<unsigned long long>(startUs),
+            static_cast<unsigned long long>(durationUs),
+            static_cast<unsigned long long>(threadAndPhase >> 8),
+            static_cast<unsigned long long>(connectionId));
+        out += buffer;
+        first = false;
+    }
+
+    out += "\n]}\n";
+    return out;
+}
@@ -0,0 +1,79 @@
+﻿/*****************************************************************
+ * @file   Tracer.h
+ * @brief  Sampling request tracer that keeps per-phase spans in a
+ * lock-free ring and dumps them as Chrome trace-event JSON.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+enum class TracePhase : uint8_t
+{
+    Receive,   // Reading the request until it can be routed
+    ParseHost, // Parsing the Host header and picking the upstream
+    Resolve,   // Resolving the upstream host
+    Connect,   // Racing connections to the upstream
+    Upload,    // Streaming the rest of the request upstream
+    FirstByte, // Request sent until the first response byte arrives
+    Relay,     // Relaying the response to the client
+    Close,     // Shutting down and closing both sockets
+    Count,
+};
+
+// Trace one in every sampleEvery connections; 0 turns tracing off
+void ConfigureTracing(int sampleEvery);
+
+bool ShouldTrace(uint64_t connectionId);
+
+void RecordSpan(
+    uint64_t connectionId,
+    TracePhase phase,
+    std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::time_point end);
+
+// Every span still in the ring, as a Chrome trace-event / Perfetto JSON document
+std::string RenderTrace();
+
+// Records one phase from construction until Stop (or destruction) when the connection is sampled
+class TraceSpan
+{
+public:
+    TraceSpan(bool traced, uint64_t connectionId, TracePhase phase)
+        : _traced(traced), _connectionId(connectionId), _phase(phase)
+    {
+        if (_traced)
+        {
+            _start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~TraceSpan()
+    {
+        Stop();
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    void Stop()
+    {
+        if (_traced)
+        {
+            _traced = false;
+            RecordSpan(_connectionId, _phase, _start, std::chrono::steady_clock::now());
+        }
+    }
+
+private:
+    bool _traced;
+    uint64_t _connectionId;
+    TracePhase _phase;
+    std::chrono::steady_clock::time_point _start;
+};
@@ -8,214 +8,37 @@
  * @copyright � 2024 DigiPen (USA) Corporation.
  *****************************************************************/
 
-#include <WS2tcpip.h>
-#include <WinSock2.h>
-#include <array>
+#include "AdminServer.h"
+#include "AsyncLogger.h"
+#include "Blocklist.h"
+#include "Capture.h"
+#include "ConcurrencyLimiter.h"
+#include "Handover.h"
+#include "HeavyHitters.h"
+#include "HttpProxy.h"
+#include "MemoryBudget.h"
+#include "Metrics.h"
+#include "NetworkUtils.h"
+#include "OriginScheduler.h"
+#include "Peering.h"
+#include "Placement.h"
+#include "ProxyConfig.h"
+#include "RateLimiter.h"
+#include "RelayScheduler.h"
+#include "ResponseCache.h"
+#include "ReverseProxy.h"
+#include "Tracer.h"
+#include <atomic>
 #include <chrono>
 #include <iostream>
-#include <memory>
-#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <thread>
-#include <vector>
 
 #pragma comment(lib, "Ws2_32.lib") // Can be added in the project settings instead
 
-unsigned long nonBlocking = 1;
-unsigned long blocking = 0;
-
-// Helper function to handle errors and print the error message and the error code
-void HandleError(const std::string& errorMessage)
-{
-    std::cerr << errorMessage << ": " << WSAGetLastError() << std::endl;
-}
-
-SOCKET CreateSocket(int protocol)
-{
-    return socket(AF_INET, protocol == IPPROTO_TCP ? SOCK_STREAM : SOCK_DGRAM, protocol);
-}
-
-int SetAddress(const char* address, int port, sockaddr_in& addr, bool useAny = false)
-{
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    if (useAny)
-    {
-        addr.sin_addr.s_addr = INADDR_ANY;
-        return 1;
-    }
-    return inet_pton(AF_INET, address, &addr.sin_addr);
-}
-
-std::string ReceiveData(SOCKET socket)
-{
-    std::vector<char> buffer(4096);
-    std::ostringstream oss;
-    int bytesReceived = 0;
-
-    // Receive the entire HTTP request from the client
-    while (true)
-    {
-        bytesReceived = recv(socket, buffer.data(), static_cast<int>(buffer.size()) - 1, 0);
-        if (bytesReceived == SOCKET_ERROR)
-        {
-            // If the socket is non-blocking and there is no data to receive, sleep for a bit
-            int error = WSAGetLastError();
-            if (error == WSAEWOULDBLOCK)
-            {
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                continue;
-            }
-            else
-            {
-                HandleError("recv failed");
-                return "";
-            }
-        }
-        else if (bytesReceived == 0)
-        {
-            break;
-        }
-        else
-        {
-            buffer[bytesReceived] = '\0'; // Null-terminate the received data
-            oss << buffer.data();
-        }
-    }
-
-    return oss.str();
-}
-
-std::string GetHostFromRequest(const std::string& request)
-{
-    std::istringstream iss(request);
-    std::string line;
-    std::string host;
-
-    while (std::getline(iss, line))
-    {
-        if (line.find("Host: ") == 0)
-        {
-            host = line.substr(6);
-            // Remove the carriage return at the end of the host
-            if (!host.empty() && host[host.size() - 1] == '\r')
-            {
-                host.pop_back();
-            }
-            break;
-        }
-    }
-
-    return host;
-}
-
-void HandleClient(SOCKET clientSocket)
-{
-    // Receive the HTTP request from the client
-    std::string request = ReceiveData(clientSocket);
-
-    // Shutdown the client socket for receiving
-    shutdown(clientSocket, SD_RECEIVE);
-
-    // Parse the HTTP request to get the host
-    std::string host = GetHostFromRequest(request);
-    if (host.empty())
-    {
-        HandleError("Host header not found in the request");
-        return;
-    }
-
-    // Resolve the host name to an IP address using inet_pton first, then fallback to getaddrinfo
-    sockaddr_in webServerAddr;
-    memset(&webServerAddr, 0, sizeof(sockaddr_in));
-    int result = SetAddress(host.c_str(), 80, webServerAddr);
-    if (result == 0) // SetAddress failed, try getaddrinfo
-    {
-        addrinfo* result = nullptr;
-        addrinfo hints = {};
-        hints.ai_family = AF_INET;
-        hints.ai_socktype = SOCK_STREAM;
-        hints.ai_protocol = IPPROTO_TCP;
-        if (getaddrinfo(host.c_str(), "80", &hints, &result) != 0)
-        {
-            HandleError("getaddrinfo failed");
-            return;
-        }
-        memcpy(&webServerAddr, result->ai_addr, result->ai_addrlen);
-        freeaddrinfo(result);
-    }
-    else if (result == -1)
-    {
-        HandleError("inet_pton failed");
-        return;
-    }
-
-    // Create a socket to connect to the web server
-    SOCKET webServerSocket = CreateSocket(IPPROTO_TCP);
-    if (webServerSocket == INVALID_SOCKET)
-    {
-        HandleError("Web server socket creation failed");
-        return;
-    }
-
-    // Connect to the web server
-    if (connect(
-            webServerSocket,
-            reinterpret_cast<sockaddr*>(&webServerAddr), // reinterpret_cast is needed because
-                                                         // sockaddr_in is not the same as sockaddr
-            sizeof(sockaddr_in)) == SOCKET_ERROR)
-    {
-        HandleError("Connect to web server failed");
-        return;
-    }
-
-    // Send the entire HTTP request to the web server
-    if (send(webServerSocket, request.c_str(), static_cast<int>(request.size()), 0) ==
-        SOCKET_ERROR)
-    {
-        HandleError("Send to web server failed");
-        return;
-    }
-
-    // Forward the response from the web server to the client
-    std::vector<char> buffer(4096);
-    int bytesReceived = 0;
-
-    while (true)
-    {
-        bytesReceived =
-            recv(webServerSocket, buffer.data(), static_cast<int>(buffer.size()) - 1, 0);
-        if (bytesReceived == SOCKET_ERROR)
-        {
-            // If the socket is non-blocking and there is no data to receive, sleep for a bit
-            int error = WSAGetLastError();
-            if (error == WSAEWOULDBLOCK)
-            {
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                continue;
-            }
-            else
-            {
-                HandleError("recv from web server failed");
-                break;
-            }
-        }
-        else if (bytesReceived == 0)
-        {
-            break;
-        }
-        else
-        {
-            send(clientSocket, buffer.data(), bytesReceived, 0);
-        }
-    }
-
-    // Close sockets
-    shutdown(webServerSocket, SD_BOTH);
-    closesocket(webServerSocket);
-    shutdown(clientSocket, SD_SEND);
-    closesocket(clientSocket);
-}
+// Client threads still running, which a process replaced by a successor waits for
+std::atomic<int> clientThreads{0};
 
 // Class to handle the socket creation and cleanup
 class Socket
@@ -272,18 +95,20 @@ private:
 
 int main(int argc, char* argv[])
 {
-    if (argc != 2)
-    {
-        std::cerr << "Usage: " << argv[0] << " <port>" << std::endl;
-        return 1;
-    }
-
-    int port = std::stoi(argv[1]);
-    if (port <= 0 || port > 65535)
+    if (!ParseCommandLine(argc, argv, proxyConfig))
     {
-        std::cerr << "Invalid port number. Port must be between 1 and 65535." << std::endl;
         return 1;
     }
+    int port = proxyConfig.port;
+    rateLimiter.Configure(proxyConfig.rateLimits);
+    memoryBudget.Configure(proxyConfig.memory);
+    concurrencyLimiter.Configure(proxyConfig.concurrency);
+    originScheduler.Configure(proxyConfig.origins);
+    relayScheduler.Configure(proxyConfig.relay);
+    responseCache.Configure(proxyConfig.cache);
+    ConfigureTracing(proxyConfig.traceSampleEvery);
+    ConfigurePlacement(proxyConfig.placement);
+    StartHeavyHitters(proxyConfig.heavyHitters);
 
     try
     {
@@ -294,40 +119,119 @@ int main(int argc, char* argv[])
             HandleError("Listen socket creation failed");
             return 1;
         }
-        
-        // Construct the listening address
-        sockaddr_in listeningAddr;
-        if (SetAddress("0.0.0.0", port, listeningAddr, true) == SOCKET_ERROR)
+
+        // A running proxy hands over its listening sockets, so no connection is refused
+        // during the restart; otherwise listen afresh
+        if (proxyConfig.handover.takeOver && TakeOver(proxyConfig.handover))
         {
-            HandleError("SetAddress failed");
-            return 1;
+            closesocket(listenSocket.get());
+            listenSocket.set(InheritedSocket(HandoverRole::Client));
+            listenSocket.setNonBlocking();
         }
+        else
+        {
+            // Construct the listening address
+            sockaddr_in listeningAddr;
+            if (SetAddress("0.0.0.0", port, listeningAddr, true) == SOCKET_ERROR)
+            {
+                HandleError("SetAddress failed");
+                return 1;
+            }
+
+            // Set the listening socket to non-blocking
+            listenSocket.setNonBlocking();
 
-        // Set the listening socket to non-blocking
-        listenSocket.setNonBlocking();
+            // Bind the listening socket to the listening address
+            if (bind(
+                    listenSocket.get(),
+                    reinterpret_cast<sockaddr*>(&listeningAddr),
+                    sizeof(listeningAddr)) == SOCKET_ERROR)
+            {
+                HandleError("bind failed");
+                return 1;
+            }
+
+            // Start listening for incoming connections on the TCP socket
+            if (listen(listenSocket.get(), SOMAXCONN) == SOCKET_ERROR)
+            {
+                HandleError("listen failed");
+                return 1;
+            }
+        }
 
-        // Bind the listening socket to the listening address
-        if (bind(
-                listenSocket.get(),
-                reinterpret_cast<sockaddr*>(&listeningAddr),
-                sizeof(listeningAddr)) == SOCKET_ERROR)
+        // Load the route table once Winsock is up, since backends are resolved while loading
+        if (!proxyConfig.routesFile.empty())
         {
-            HandleError("bind failed");
-            return 1;
+            if (!LoadRouteTable(proxyConfig.routesFile))
+            {
+                return 1;
+            }
+            StartHealthChecks();
         }
 
-        // Start listening for incoming connections on the TCP socket
-        if (listen(listenSocket.get(), SOMAXCONN) == SOCKET_ERROR)
+        if (!proxyConfig.blocklist.fileName.empty())
         {
-            HandleError("listen failed");
-            return 1;
+            if (!LoadBlocklist(proxyConfig.blocklist))
+            {
+                return 1;
+            }
+            StartBlocklistReloads();
+        }
+
+        if (proxyConfig.peers.queryPort != 0)
+        {
+            if (!ConfigurePeers(proxyConfig.peers) || !StartPeerResponder())
+            {
+                return 1;
+            }
+        }
+
+        if (proxyConfig.adminPort != 0)
+        {
+            RegisterAdminHandler("/metrics", RenderMetrics);
+            RegisterAdminHandler("/trace", RenderTrace, "application/json");
+            RegisterAdminHandler("/topk", RenderHeavyHitters);
+            RegisterAdminHandler("/limits", [] { return concurrencyLimiter.Render(); });
+            RegisterAdminHandler("/origins", [] { return originScheduler.Render(); });
+            RegisterAdminHandler("/peers", RenderPeers);
+            if (!StartAdminServer(proxyConfig.adminPort))
+            {
+                return 1;
+            }
+            std::cout << "Admin endpoints on 127.0.0.1:" << proxyConfig.adminPort << std::endl;
+        }
+
+        if (proxyConfig.handover.port != 0)
+        {
+            OfferForHandover(HandoverRole::Client, listenSocket.get());
+            if (!StartHandoverListener(proxyConfig.handover))
+            {
+                return 1;
+            }
         }
 
-        std::cout << "Listening on port " << port << std::endl;
+        std::cout << "Listening on port " << port
+                  << (GetRouteTable() != nullptr ? " (reverse proxy)" : "") << std::endl;
+
+        // From here on client threads log through the background writer
+        StartLogging(proxyConfig.logFile, proxyConfig.accessLogFile);
+        if (!proxyConfig.captureFile.empty() && !StartCapture(proxyConfig.captureFile))
+        {
+            StopLogging();
+            return 1;
+        }
+        uint64_t nextConnectionId = 1;
 
-        // Infinite loop to accept incoming connections
-        while (true)
+        // Accept incoming connections until a successor takes the listening socket over
+        while (!HandedOver())
         {
+            // Under memory pressure leave new connections waiting in the listen backlog
+            if (memoryBudget.GetLevel() >= ShedLevel::StopAccepting)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+
             sockaddr_in clientAddr;
             int clientAddrSize = sizeof(clientAddr);
             SOCKET clientSocket = accept(
@@ -338,16 +242,44 @@ int main(int argc, char* argv[])
                 continue;
             }
 
+            // Turn away clients over their limits while the socket is still non-blocking, so
+            // they cost neither a thread nor a stalled accept loop
+            ClientConnection client;
+            client.id = nextConnectionId++;
+            client.socket = clientSocket;
+            client.address = clientAddr;
+            client.acceptedAt = std::chrono::steady_clock::now();
+            client.placement = PlaceConnection(clientSocket);
+            int retryAfterSeconds = 0;
+            Admission admission = rateLimiter.Admit(
+                ntohl(clientAddr.sin_addr.s_addr), client.rateLimit, retryAfterSeconds);
+            if (admission != Admission::Allowed)
+            {
+                CountError(ErrorKind::RateLimited);
+                RefuseClient(clientSocket, 429, "Too Many Requests", retryAfterSeconds);
+                continue;
+            }
+
             // Accepted socket can become "blocking" again
             ioctlsocket(clientSocket, FIONBIO, &blocking);
 
             // Create a new thread to handle the client
-            std::thread clientThread = std::thread(HandleClient, clientSocket);
+            ++clientThreads;
+            std::thread clientThread = std::thread([client] {
+                HandleClient(client);
+                --clientThreads;
+            });
             clientThread.detach();
         }
+
+        DrainAfterHandover(clientThreads);
+        StopCapture();
+        StopLogging();
     }
     catch (const std::exception& e)
     {
+        StopCapture();
+        StopLogging();
         std::cerr << "Exception: " << e.what() << std::endl;
         return 1;
     }
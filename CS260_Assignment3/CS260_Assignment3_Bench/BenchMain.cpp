@@ -0,0 +1,312 @@
+﻿/*****************************************************************
+ * @file   BenchMain.cpp
+ * @brief  Benchmark driver for the HTTP proxy: a local origin and a
+ * load generator, runnable together on one machine over loopback.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "BenchOptions.h"
+#include "BenchOrigin.h"
+#include "LoadGenerator.h"
+#include "MicroBench.h"
+#include "RelaySchedule.h"
+#include "Replay.h"
+#include <WinSock2.h>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#pragma comment(lib, "Ws2_32.lib")
+
+namespace
+{
+void PrintUsage(const char* program)
+{
+    std::cerr << "Usage:\n"
+              << "  " << program << " origin [--port n] [--threads n] [--size bytes] "
+              << "[--delay-ms n]\n"
+              << "  " << program << " load <proxyPort> [options]\n"
+              << "  " << program << " micro [--filter text] [--min-time seconds]\n"
+              << "  " << program << " replay <proxyPort> <captureFile> [options]\n"
+              << "  " << program << " schedule [options]\n"
+              << "\n"
+              << "load options:\n"
+              << "  --origin <host:port>    Target behind the proxy (default: a local origin)\n"
+              << "  --connections <n>       Concurrent connections (default 16)\n"
+              << "  --duration <seconds>    Length of the run (default 10)\n"
+              << "  --rate <n>              Open loop at n requests/sec; closed loop when omitted\n"
+              << "  --path <path>           Request path, e.g. /?size=65536&delay=5\n"
+              << "  --timeout-ms <n>        Per-request receive timeout (default 10000)\n"
+              << "  --size, --delay-ms, --threads  Settings for the local origin\n"
+              << "\n"
+              << "replay options:\n"
+              << "  --speed <x>             Arrival rate multiplier (default 1)\n"
+              << "  --connections <n>       Requests in flight at most (default 64)\n"
+              << "  --timeout-ms <n>        Per-request receive timeout (default 10000)\n"
+              << "  --origin-port <n>       Port for the stand-in origin (default any)\n"
+              << "  --origin-threads <n>    Stand-in origin worker threads (default 64)\n"
+              << "  --keep-host <0|1>       Keep recorded Host headers, e.g. for --routes\n"
+              << "\n"
+              << "schedule options (relay scheduler alone, no sockets):\n"
+              << "  --bandwidth-mbps <n>    Outbound link shared by the relays (default 400)\n"
+              << "  --load <x>              Offered load as a share of the link (default 0.9)\n"
+              << "  --duration <seconds>    Length of each run (default 5)\n"
+              << "  --policy <fifo|srpt>    Run one policy; both are compared when omitted"
+              << std::endl;
+}
+
+OriginSettings ReadOriginSettings(const BenchOptions& options)
+{
+    OriginSettings settings;
+    settings.port = options.GetInt("port", 0);
+    settings.threads = options.GetInt("threads", settings.threads);
+    settings.responseBytes = static_cast<size_t>(options.GetInt("size", 1024));
+    settings.delayMs = options.GetInt("delay-ms", 0);
+    return settings;
+}
+
+int RunOriginCommand(int argc, char* argv[])
+{
+    BenchOptions options;
+    if (!options.Parse(argc, argv, 2, {"port", "threads", "size", "delay-ms"}))
+    {
+        return 1;
+    }
+
+    BenchOrigin origin(ReadOriginSettings(options));
+    if (!origin.Start())
+    {
+        return 1;
+    }
+    std::cout << "Origin listening on 127.0.0.1:" << origin.Port() << ", press Enter to stop"
+              << std::endl;
+    std::cin.get();
+    return 0;
+}
+
+int RunLoadCommand(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    BenchOptions options;
+    if (!options.Parse(
+            argc,
+            argv,
+            3,
+            {"origin",
+             "connections",
+             "duration",
+             "rate",
+             "path",
+             "timeout-ms",
+             "size",
+             "delay-ms",
+             "threads"}))
+    {
+        return 1;
+    }
+
+    LoadSettings settings;
+    settings.proxyPort = std::stoi(argv[2]);
+    settings.connections = options.GetInt("connections", settings.connections);
+    settings.durationSeconds = options.GetDouble("duration", settings.durationSeconds);
+    settings.requestsPerSecond = options.GetDouble("rate", 0.0);
+    settings.path = options.GetString("path", settings.path);
+    settings.timeoutMs = options.GetInt("timeout-ms", settings.timeoutMs);
+
+    // Without an explicit target, put a local origin behind the proxy for the run
+    std::unique_ptr<BenchOrigin> origin;
+    if (options.Has("origin"))
+    {
+        settings.target = options.GetString("origin", "");
+    }
+    else
+    {
+        OriginSettings originSettings = ReadOriginSettings(options);
+        originSettings.port = 0;
+        originSettings.threads = options.GetInt("threads", settings.connections);
+        origin = std::make_unique<BenchOrigin>(originSettings);
+        if (!origin->Start())
+        {
+            return 1;
+        }
+        settings.target = "127.0.0.1:" + std::to_string(origin->Port());
+    }
+
+    std::cout << "Driving 127.0.0.1:" << settings.proxyPort << " -> " << settings.target
+              << settings.path << " with " << settings.connections << " connections for "
+              << settings.durationSeconds << "s" << std::endl;
+    LoadReport report = RunLoad(settings);
+    PrintReport(report, std::cout);
+    return 0;
+}
+
+int RunMicroCommand(int argc, char* argv[])
+{
+    BenchOptions options;
+    if (!options.Parse(argc, argv, 2, {"filter", "min-time"}))
+    {
+        return 1;
+    }
+
+    RunMicroBenchmarks(
+        ProxyMicroCases(),
+        options.GetString("filter", ""),
+        options.GetDouble("min-time", 0.2),
+        std::cout);
+    return 0;
+}
+
+int RunReplayCommand(int argc, char* argv[])
+{
+    if (argc < 4)
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    BenchOptions options;
+    if (!options.Parse(
+            argc,
+            argv,
+            4,
+            {"speed", "connections", "timeout-ms", "origin-port", "origin-threads", "keep-host"}))
+    {
+        return 1;
+    }
+
+    std::vector<CapturedConnection> connections;
+    if (!ReadCapture(argv[3], connections))
+    {
+        return 1;
+    }
+
+    ReplaySettings settings;
+    settings.proxyPort = std::stoi(argv[2]);
+    settings.speed = options.GetDouble("speed", settings.speed);
+    settings.connections = options.GetInt("connections", settings.connections);
+    settings.timeoutMs = options.GetInt("timeout-ms", settings.timeoutMs);
+    settings.keepHost = options.GetInt("keep-host", 0) != 0;
+
+    // The stand-in origin answers every replayed request with the recorded response
+    ReplayResponder responder(connections);
+    OriginSettings originSettings;
+    originSettings.port = options.GetInt("origin-port", 0);
+    originSettings.threads = options.GetInt("origin-threads", 64);
+    originSettings.responder = [&responder](const std::string& request) {
+        return responder(request);
+    };
+    BenchOrigin origin(originSettings);
+    if (!origin.Start())
+    {
+        return 1;
+    }
+
+    double recordedSeconds = connections.empty() ? 0.0 : connections.back().arrivalUs / 1e6;
+    std::cout << "Replaying " << connections.size() << " connections recorded over "
+              << recordedSeconds << "s at " << settings.speed << "x through 127.0.0.1:"
+              << settings.proxyPort << ", stand-in origin on 127.0.0.1:" << origin.Port()
+              << std::endl;
+    LoadReport report =
+        RunReplay(settings, connections, "127.0.0.1:" + std::to_string(origin.Port()));
+    PrintReport(report, std::cout);
+    std::cout << "  (errors are responses whose status differs from the recording)" << std::endl;
+    return 0;
+}
+
+int RunScheduleCommand(int argc, char* argv[])
+{
+    BenchOptions options;
+    if (!options.Parse(argc, argv, 2, {"bandwidth-mbps", "load", "duration", "policy"}))
+    {
+        return 1;
+    }
+
+    ScheduleSettings settings;
+    settings.bytesPerSecond = options.GetDouble("bandwidth-mbps", 400) * 1e6 / 8;
+    settings.load = options.GetDouble("load", settings.load);
+    settings.durationSeconds = options.GetDouble("duration", settings.durationSeconds);
+
+    std::vector<std::string> policies = {"fifo", "srpt"};
+    if (options.Has("policy"))
+    {
+        policies = {options.GetString("policy", "")};
+    }
+    std::cout << "Relaying " << settings.largeShare * 100 << "% " << settings.largeBytes
+              << "-byte and the rest " << settings.smallBytes << "-byte responses at "
+              << settings.load * 100 << "% of " << settings.bytesPerSecond * 8 / 1e6
+              << " Mbit/s for " << settings.durationSeconds << "s per policy" << std::endl;
+    for (const std::string& name : policies)
+    {
+        RelayPolicy policy;
+        if (!ParseRelayPolicy(name, policy))
+        {
+            throw std::invalid_argument(name);
+        }
+        PrintScheduleReport(name.c_str(), RunRelaySchedule(settings, policy), std::cout);
+    }
+    return 0;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        std::cerr << "WSAStartup failed" << std::endl;
+        return 1;
+    }
+
+    int result = 1;
+    std::string command = argv[1];
+    try
+    {
+        if (command == "origin")
+        {
+            result = RunOriginCommand(argc, argv);
+        }
+        else if (command == "load")
+        {
+            result = RunLoadCommand(argc, argv);
+        }
+        else if (command == "micro")
+        {
+            result = RunMicroCommand(argc, argv);
+        }
+        else if (command == "replay")
+        {
+            result = RunReplayCommand(argc, argv);
+        }
+        else if (command == "schedule")
+        {
+            result = RunScheduleCommand(argc, argv);
+        }
+        else
+        {
+            PrintUsage(argv[0]);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Invalid arguments: " << e.what() << std::endl;
+    }
+
+    WSACleanup();
+    return result;
+}
@@ -0,0 +1,55 @@
+﻿/*****************************************************************
+ * @file   BenchOptions.cpp
+ * @brief  "--name value" option parsing shared by the benchmark
+ * subcommands.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "BenchOptions.h"
+#include <iostream>
+
+bool BenchOptions::Parse(int argc, char* argv[], int first, const std::set<std::string>& known)
+{
+    for (int i = first; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (option.compare(0, 2, "--") != 0 || known.count(option.substr(2)) == 0)
+        {
+            std::cerr << "Unknown option " << option << std::endl;
+            return false;
+        }
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Missing value for " << option << std::endl;
+            return false;
+        }
+        _values[option.substr(2)] = argv[++i];
+    }
+    return true;
+}
+
+bool BenchOptions::Has(const std::string& name) const
+{
+    return _values.count(name) != 0;
+}
+
+std::string BenchOptions::GetString(const std::string& name, const std::string& fallback) const
+{
+    auto value = _values.find(name);
+    return value == _values.end() ? fallback : value->second;
+}
+
+int BenchOptions::GetInt(const std::string& name, int fallback) const
+{
+    auto value = _values.find(name);
+    return value == _values.end() ? fallback : std::stoi(value->second);
+}
+
+double BenchOptions::GetDouble(const std::string& name, double fallback) const
+{
+    auto value = _values.find(name);
+    return value == _values.end() ? fallback : std::stod(value->second);
+}
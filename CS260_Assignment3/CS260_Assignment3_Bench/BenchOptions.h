@@ -0,0 +1,32 @@
+﻿/*****************************************************************
+ * @file   BenchOptions.h
+ * @brief  "--name value" option parsing shared by the benchmark
+ * subcommands.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+
+class BenchOptions
+{
+public:
+    // Reads "--name value" pairs from argv[first..], rejecting names not in known
+    bool Parse(int argc, char* argv[], int first, const std::set<std::string>& known);
+
+    bool Has(const std::string& name) const;
+
+    // Typed lookups return fallback when the option is absent; a malformed value throws
+    std::string GetString(const std::string& name, const std::string& fallback) const;
+    int GetInt(const std::string& name, int fallback) const;
+    double GetDouble(const std::string& name, double fallback) const;
+
+private:
+    std::map<std::string, std::string> _values;
+};
@@ -0,0 +1,186 @@
+﻿/*****************************************************************
+ * @file   BenchOrigin.cpp
+ * @brief  Local multi-threaded HTTP origin that the benchmark puts
+ * behind the proxy, with configurable response size and delay.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "BenchOrigin.h"
+#include <WS2tcpip.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+const size_t maxRequestHeader = 16384;
+
+// Value of "name=" in the request target's query string, or fallback
+long long QueryValue(const std::string& target, const char* name, long long fallback)
+{
+    size_t query = target.find('?');
+    if (query == std::string::npos)
+    {
+        return fallback;
+    }
+    std::string key = std::string(name) + "=";
+    size_t at = target.find(key, query);
+    if (at == std::string::npos || (target[at - 1] != '?' && target[at - 1] != '&'))
+    {
+        return fallback;
+    }
+    return atoll(target.c_str() + at + key.size());
+}
+
+bool SendAll(SOCKET socket, const char* data, size_t length)
+{
+    while (length > 0)
+    {
+        int chunk = static_cast<int>(std::min<size_t>(length, 1 << 20));
+        int sent = send(socket, data, chunk, 0);
+        if (sent == SOCKET_ERROR)
+        {
+            return false;
+        }
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+} // namespace
+
+BenchOrigin::BenchOrigin(const OriginSettings& settings) : _settings(settings)
+{
+}
+
+BenchOrigin::~BenchOrigin()
+{
+    Stop();
+}
+
+bool BenchOrigin::Start()
+{
+    _listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (_listenSocket == INVALID_SOCKET)
+    {
+        std::cerr << "Origin socket creation failed: " << WSAGetLastError() << std::endl;
+        return false;
+    }
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<u_short>(_settings.port));
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    int addressSize = sizeof(address);
+    if (bind(_listenSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) ==
+            SOCKET_ERROR ||
+        listen(_listenSocket, SOMAXCONN) == SOCKET_ERROR ||
+        getsockname(_listenSocket, reinterpret_cast<sockaddr*>(&address), &addressSize) ==
+            SOCKET_ERROR)
+    {
+        std::cerr << "Origin listen failed: " << WSAGetLastError() << std::endl;
+        closesocket(_listenSocket);
+        _listenSocket = INVALID_SOCKET;
+        return false;
+    }
+    _port = ntohs(address.sin_port);
+
+    // Workers wait in select rather than accept so Stop can wake them on every platform
+    unsigned long nonBlocking = 1;
+    ioctlsocket(_listenSocket, FIONBIO, &nonBlocking);
+
+    _running.store(true);
+    for (int i = 0; i < _settings.threads; ++i)
+    {
+        _workers.emplace_back(&BenchOrigin::WorkerLoop, this);
+    }
+    return true;
+}
+
+void BenchOrigin::Stop()
+{
+    if (!_running.exchange(false))
+    {
+        return;
+    }
+    for (std::thread& worker : _workers)
+    {
+        worker.join();
+    }
+    _workers.clear();
+    closesocket(_listenSocket);
+    _listenSocket = INVALID_SOCKET;
+}
+
+void BenchOrigin::WorkerLoop()
+{
+    while (_running.load())
+    {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(_listenSocket, &readable);
+        timeval timeout = {0, 100000};
+        if (select(static_cast<int>(_listenSocket) + 1, &readable, nullptr, nullptr, &timeout) <=
+            0)
+        {
+            continue;
+        }
+
+        // Another worker may win the race for the connection; that's fine
+        SOCKET socket = accept(_listenSocket, nullptr, nullptr);
+        if (socket == INVALID_SOCKET)
+        {
+            continue;
+        }
+
+        unsigned long blocking = 0;
+        ioctlsocket(socket, FIONBIO, &blocking);
+        Serve(socket);
+        shutdown(socket, SD_SEND);
+        closesocket(socket);
+    }
+}
+
+void BenchOrigin::Serve(SOCKET socket)
+{
+    // The proxy keeps its side open until the response ends, so read up to the blank line
+    std::string request;
+    std::vector<char> buffer(4096);
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < maxRequestHeader)
+    {
+        int bytesReceived = recv(socket, buffer.data(), static_cast<int>(buffer.size()), 0);
+        if (bytesReceived <= 0)
+        {
+            return;
+        }
+        request.append(buffer.data(), bytesReceived);
+    }
+
+    if (_settings.responder)
+    {
+        std::string response = _settings.responder(request);
+        SendAll(socket, response.data(), response.size());
+        return;
+    }
+
+    size_t targetStart = request.find(' ') + 1;
+    std::string target = request.substr(targetStart, request.find(' ', targetStart) - targetStart);
+    long long size = std::max(
+        QueryValue(target, "size", static_cast<long long>(_settings.responseBytes)), 0LL);
+    long long delayMs = QueryValue(target, "delay", _settings.delayMs);
+
+    if (delayMs > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+    }
+
+    std::string response = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n"
+                           "Content-Length: " +
+                           std::to_string(size) + "\r\nConnection: close\r\n\r\n";
+    response.append(static_cast<size_t>(size), 'x');
+    SendAll(socket, response.data(), response.size());
+}
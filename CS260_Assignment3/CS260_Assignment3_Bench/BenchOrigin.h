@@ -0,0 +1,59 @@
+﻿/*****************************************************************
+ * @file   BenchOrigin.h
+ * @brief  Local multi-threaded HTTP origin that the benchmark puts
+ * behind the proxy, with configurable response size and delay.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <WinSock2.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct OriginSettings
+{
+    int port = 0;                // 0 picks a free port
+    int threads = 4;             // Connections served at once
+    size_t responseBytes = 1024; // Body size unless the request asks for "?size=n"
+    int delayMs = 0;             // Think time per request unless it asks for "?delay=n"
+
+    // When set, builds the complete response for each request in place of the generated one
+    std::function<std::string(const std::string& request)> responder;
+};
+
+class BenchOrigin
+{
+public:
+    explicit BenchOrigin(const OriginSettings& settings);
+    ~BenchOrigin();
+
+    BenchOrigin(const BenchOrigin&) = delete;
+    BenchOrigin& operator=(const BenchOrigin&) = delete;
+
+    // Listens on 127.0.0.1 and starts the worker threads
+    bool Start();
+
+    void Stop();
+
+    int Port() const
+    {
+        return _port;
+    }
+
+private:
+    void WorkerLoop();
+    void Serve(SOCKET socket);
+
+    OriginSettings _settings;
+    SOCKET _listenSocket = INVALID_SOCKET;
+    int _port = 0;
+    std::atomic<bool> _running{false};
+    std::vector<std::thread> _workers;
+};
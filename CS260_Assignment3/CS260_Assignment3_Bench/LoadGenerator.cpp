@@ -0,0 +1,234 @@
+﻿/*****************************************************************
+ * @file   LoadGenerator.cpp
+ * @brief  Closed- and open-loop HTTP load generator that drives the
+ * proxy over loopback and reports throughput and latency.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "LoadGenerator.h"
+#include <WS2tcpip.h>
+#include <WinSock2.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+struct WorkerResult
+{
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+    HistogramSnapshot latency;
+    HistogramSnapshot serviceTime;
+};
+
+uint64_t MicrosBetween(Clock::time_point start, Clock::time_point end)
+{
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+}
+
+void LoadWorker(
+    const LoadSettings& settings,
+    int index,
+    const sockaddr_in& proxyAddress,
+    Clock::time_point start,
+    Clock::time_point end,
+    WorkerResult& result)
+{
+    std::string request = "GET " + settings.path + " HTTP/1.1\r\nHost: " + settings.target +
+                          "\r\nConnection: close\r\n\r\n";
+    std::vector<char> buffer(65536);
+    bool openLoop = settings.requestsPerSecond > 0;
+
+    for (uint64_t k = 0;; ++k)
+    {
+        // Open loop: connection index owns every connections-th slot of one global schedule
+        Clock::time_point due = Clock::now();
+        if (openLoop)
+        {
+            double offset = (k * settings.connections + index) / settings.requestsPerSecond;
+            due = start + std::chrono::duration_cast<Clock::duration>(
+                              std::chrono::duration<double>(offset));
+            if (due >= end)
+            {
+                break;
+            }
+            std::this_thread::sleep_until(due);
+        }
+        else if (due >= end)
+        {
+            break;
+        }
+
+        Clock::time_point sent = Clock::now();
+        int status =
+            SendProxyRequest(proxyAddress, request, settings.timeoutMs, buffer, result.bytes);
+        Clock::time_point done = Clock::now();
+
+        ++result.requests;
+        if (status < 200 || status >= 300)
+        {
+            ++result.errors;
+        }
+        result.serviceTime.Record(MicrosBetween(sent, done));
+        result.latency.Record(MicrosBetween(due, done));
+    }
+}
+
+void PrintLatencyRow(std::ostream& out, const char* label, const HistogramSnapshot& histogram)
+{
+    char line[200];
+    snprintf(
+        line,
+        sizeof(line),
+        "  %-14s p50 %9.3f  p90 %9.3f  p99 %9.3f  p99.9 %9.3f  max %9.3f  (ms)\n",
+        label,
+        histogram.ValueAtQuantile(0.5) / 1000.0,
+        histogram.ValueAtQuantile(0.9) / 1000.0,
+        histogram.ValueAtQuantile(0.99) / 1000.0,
+        histogram.ValueAtQuantile(0.999) / 1000.0,
+        histogram.max / 1000.0);
+    out << line;
+}
+} // namespace
+
+sockaddr_in LoopbackAddress(const std::string& host, int port)
+{
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<u_short>(port));
+    inet_pton(AF_INET, host.c_str(), &address.sin_addr);
+    return address;
+}
+
+int SendProxyRequest(
+    const sockaddr_in& proxyAddress,
+    const std::string& request,
+    int timeoutMs,
+    std::vector<char>& buffer,
+    uint64_t& bytes)
+{
+    SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == INVALID_SOCKET)
+    {
+        return 0;
+    }
+
+    // Reset instead of lingering in TIME_WAIT, or a long run exhausts the ephemeral ports
+    linger abortive = {1, 0};
+    setsockopt(
+        sock, SOL_SOCKET, SO_LINGER, reinterpret_cast<const char*>(&abortive), sizeof(abortive));
+    DWORD timeout = static_cast<DWORD>(timeoutMs);
+    setsockopt(
+        sock, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+
+    int status = 0;
+    if (connect(sock, reinterpret_cast<const sockaddr*>(&proxyAddress), sizeof(proxyAddress)) !=
+            SOCKET_ERROR &&
+        send(sock, request.data(), static_cast<int>(request.size()), 0) != SOCKET_ERROR)
+    {
+        shutdown(sock, SD_SEND);
+
+        bool complete = false;
+        uint64_t received = 0;
+        while (true)
+        {
+            int bytesReceived = recv(sock, buffer.data(), static_cast<int>(buffer.size()), 0);
+            if (bytesReceived <= 0)
+            {
+                complete = bytesReceived == 0;
+                break;
+            }
+            if (received == 0 && bytesReceived >= 12 && strncmp(buffer.data(), "HTTP/", 5) == 0)
+            {
+                status = atoi(buffer.data() + 9);
+            }
+            received += bytesReceived;
+        }
+        bytes += received;
+        if (!complete)
+        {
+            status = 0;
+        }
+    }
+
+    closesocket(sock);
+    return status;
+}
+
+LoadReport RunLoad(const LoadSettings& settings)
+{
+    sockaddr_in proxyAddress = LoopbackAddress(settings.proxyHost, settings.proxyPort);
+
+    std::vector<WorkerResult> results(settings.connections);
+    std::vector<std::thread> workers;
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(
+                                        std::chrono::duration<double>(settings.durationSeconds));
+    for (int i = 0; i < settings.connections; ++i)
+    {
+        workers.emplace_back(
+            LoadWorker,
+            std::cref(settings),
+            i,
+            std::cref(proxyAddress),
+            start,
+            end,
+            std::ref(results[i]));
+    }
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    LoadReport report;
+    report.openLoop = settings.requestsPerSecond > 0;
+    report.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    for (const WorkerResult& result : results)
+    {
+        report.requests += result.requests;
+        report.errors += result.errors;
+        report.bytes += result.bytes;
+        report.latency.Merge(result.latency);
+        report.serviceTime.Merge(result.serviceTime);
+    }
+    return report;
+}
+
+void PrintReport(const LoadReport& report, std::ostream& out)
+{
+    char line[200];
+    snprintf(
+        line,
+        sizeof(line),
+        "%s loop: %llu requests in %.2fs, %llu errors\n"
+        "  Requests/sec   %.1f\n"
+        "  Transfer/sec   %.2f MB\n",
+        report.openLoop ? "Open" : "Closed",
+        static_cast<unsigned long long>(report.requests),
+        report.seconds,
+        static_cast<unsigned long long>(report.errors),
+        report.requests / report.seconds,
+        report.bytes / report.seconds / (1024.0 * 1024.0));
+    out << line;
+
+    if (report.openLoop)
+    {
+        PrintLatencyRow(out, "Latency", report.latency);
+        PrintLatencyRow(out, "Service time", report.serviceTime);
+    }
+    else
+    {
+        PrintLatencyRow(out, "Latency", report.serviceTime);
+        out << "  (closed loop hides queueing; pass --rate for corrected latency)\n";
+    }
+}
@@ -0,0 +1,64 @@
+﻿/*****************************************************************
+ * @file   LoadGenerator.h
+ * @brief  Closed- and open-loop HTTP load generator that drives the
+ * proxy over loopback and reports throughput and latency.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include "Histogram.h"
+#include <WinSock2.h>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct LoadSettings
+{
+    std::string proxyHost = "127.0.0.1";
+    int proxyPort = 0;
+    std::string target; // Host header sent through the proxy, e.g. "127.0.0.1:9000"
+    std::string path = "/";
+    int connections = 16;
+    double durationSeconds = 10.0;
+    int timeoutMs = 10000;
+
+    // 0 runs closed loop (each connection sends as soon as its last response ends); otherwise
+    // requests are scheduled at this total rate whether or not earlier ones have finished
+    double requestsPerSecond = 0.0;
+};
+
+struct LoadReport
+{
+    bool openLoop = false;
+    double seconds = 0.0;
+    uint64_t requests = 0;
+    uint64_t errors = 0; // Failed connections, timeouts and non-2xx responses
+    uint64_t bytes = 0;  // Response bytes, headers included
+
+    // Open loop measures from when each request was due, so time spent queued behind a slow
+    // response counts (coordinated-omission correction). Closed loop measures from the send.
+    HistogramSnapshot latency;
+
+    // From the send to the last response byte, whatever the mode
+    HistogramSnapshot serviceTime;
+};
+
+LoadReport RunLoad(const LoadSettings& settings);
+
+sockaddr_in LoopbackAddress(const std::string& host, int port);
+
+// One request on a fresh connection, the way the proxy expects it: send, half-close, read to
+// EOF. Adds the response size to bytes and returns its status, or 0 if the exchange failed.
+int SendProxyRequest(
+    const sockaddr_in& proxyAddress,
+    const std::string& request,
+    int timeoutMs,
+    std::vector<char>& buffer,
+    uint64_t& bytes);
+
+void PrintReport(const LoadReport& report, std::ostream& out);
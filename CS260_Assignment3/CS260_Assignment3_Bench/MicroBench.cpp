@@ -0,0 +1,155 @@
+﻿/*****************************************************************
+ * @file   MicroBench.cpp
+ * @brief  Minimal microbenchmark harness reporting time and heap
+ * allocations per operation.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "MicroBench.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+// Counted by the replacement operator new below, for the whole bench executable
+std::atomic<uint64_t> allocationCount{0};
+std::atomic<uint64_t> allocatedBytes{0};
+
+volatile size_t resultSink = 0;
+
+using Clock = std::chrono::steady_clock;
+
+struct Measurement
+{
+    uint64_t iterations = 0;
+    double nanoseconds = 0.0;
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+};
+
+Measurement Measure(const MicroCase& microCase, uint64_t iterations)
+{
+    Measurement measurement;
+    measurement.iterations = iterations;
+    size_t sink = 0;
+
+    if (!microCase.setup)
+    {
+        uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+        uint64_t bytesBefore = allocatedBytes.load(std::memory_order_relaxed);
+        Clock::time_point start = Clock::now();
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            sink += microCase.run();
+        }
+        measurement.nanoseconds =
+            std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        measurement.allocations =
+            allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+        measurement.bytes = allocatedBytes.load(std::memory_order_relaxed) - bytesBefore;
+    }
+    else
+    {
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            microCase.setup();
+            uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+            uint64_t bytesBefore = allocatedBytes.load(std::memory_order_relaxed);
+            Clock::time_point start = Clock::now();
+            sink += microCase.run();
+            measurement.nanoseconds +=
+                std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+            measurement.allocations +=
+                allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+            measurement.bytes += allocatedBytes.load(std::memory_order_relaxed) - bytesBefore;
+            if (microCase.teardown)
+            {
+                microCase.teardown();
+            }
+        }
+    }
+
+    resultSink = resultSink + sink;
+    return measurement;
+}
+} // namespace
+
+void* operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    void* memory = malloc(size == 0 ? 1 : size);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void RunMicroBenchmarks(
+    const std::vector<MicroCase>& cases,
+    const std::string& filter,
+    double minSeconds,
+    std::ostream& out)
+{
+    char line[200];
+    snprintf(
+        line,
+        sizeof(line),
+        "%-40s %14s %12s %12s %12s\n",
+        "Benchmark",
+        "ns/op",
+        "allocs/op",
+        "bytes/op",
+        "iterations");
+    out << line << std::string(94, '-') << "\n";
+
+    double targetNanoseconds = minSeconds * 1e9;
+    for (const MicroCase& microCase : cases)
+    {
+        if (microCase.name.find(filter) == std::string::npos)
+        {
+            continue;
+        }
+
+        // Grow the iteration count until one run lasts minSeconds; the last run is reported
+        Measurement measurement = Measure(microCase, 1);
+        while (measurement.nanoseconds < targetNanoseconds)
+        {
+            double perIteration = std::max(measurement.nanoseconds / measurement.iterations, 1.0);
+            uint64_t next = static_cast<uint64_t>(targetNanoseconds * 1.2 / perIteration);
+            next = std::min(next, measurement.iterations * 100);
+            measurement = Measure(microCase, std::max(next, measurement.iterations + 1));
+        }
+
+        double iterations = static_cast<double>(measurement.iterations);
+        snprintf(
+            line,
+            sizeof(line),
+            "%-40s %14.1f %12.2f %12.1f %12llu\n",
+            microCase.name.c_str(),
+            measurement.nanoseconds / iterations,
+            measurement.allocations / iterations,
+            measurement.bytes / iterations,
+            static_cast<unsigned long long>(measurement.iterations));
+        out << line << std::flush;
+    }
+}
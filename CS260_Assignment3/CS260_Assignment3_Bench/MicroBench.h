@@ -0,0 +1,42 @@
+﻿/*****************************************************************
+ * @file   MicroBench.h
+ * @brief  Minimal microbenchmark harness reporting time and heap
+ * allocations per operation.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct MicroCase
+{
+    std::string name; // "Function/input", matched by --filter
+
+    // The operation being timed; return something derived from its result so the work can't
+    // be optimized away
+    std::function<size_t()> run;
+
+    // Optional untimed work around every iteration, for operations that consume their input.
+    // Cases with a setup are timed one iteration at a time, so keep them above a microsecond.
+    std::function<void()> setup;
+    std::function<void()> teardown;
+};
+
+// Cases for the proxy's request parsing, socket helpers, thread placement, blocklist and cache
+// compression
+std::vector<MicroCase> ProxyMicroCases();
+
+// Runs every case whose name contains filter for at least minSeconds each
+void RunMicroBenchmarks(
+    const std::vector<MicroCase>& cases,
+    const std::string& filter,
+    double minSeconds,
+    std::ostream& out);
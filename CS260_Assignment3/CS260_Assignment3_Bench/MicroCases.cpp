@@ -0,0 +1,307 @@
+﻿/*****************************************************************
+ * @file   MicroCases.cpp
+ * @brief  Microbenchmark cases for the proxy's request parsing and
+ * socket helpers, run over the request corpus.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "Blocklist.h"
+#include "Compression.h"
+#include "HttpParser.h"
+#include "MicroBench.h"
+#include "NetworkUtils.h"
+#include "Placement.h"
+#include "RequestCorpus.h"
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+namespace
+{
+// A connected loopback pair with one request queued and half-closed, so ReceiveData reads
+// exactly what HandleClient would
+class LoopbackRequest
+{
+public:
+    LoopbackRequest()
+    {
+        _listenSocket = CreateSocket(IPPROTO_TCP);
+        sockaddr_in address = {};
+        SetAddress("127.0.0.1", 0, address);
+        int addressSize = sizeof(address);
+        bind(_listenSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        listen(_listenSocket, 1);
+        getsockname(_listenSocket, reinterpret_cast<sockaddr*>(&address), &addressSize);
+        _address = address;
+    }
+
+    ~LoopbackRequest()
+    {
+        Close();
+        closesocket(_listenSocket);
+    }
+
+    void Open(const std::string& request)
+    {
+        _client = CreateSocket(IPPROTO_TCP);
+        connect(_client, reinterpret_cast<sockaddr*>(&_address), sizeof(_address));
+        _server = accept(_listenSocket, nullptr, nullptr);
+        send(_client, request.data(), static_cast<int>(request.size()), 0);
+        shutdown(_client, SD_SEND);
+    }
+
+    void Close()
+    {
+        if (_server != INVALID_SOCKET)
+        {
+            closesocket(_server);
+            closesocket(_client);
+            _server = _client = INVALID_SOCKET;
+        }
+    }
+
+    SOCKET Server() const
+    {
+        return _server;
+    }
+
+private:
+    SOCKET _listenSocket = INVALID_SOCKET;
+    SOCKET _client = INVALID_SOCKET;
+    SOCKET _server = INVALID_SOCKET;
+    sockaddr_in _address = {};
+};
+
+// What a client thread does with a placed connection: pin itself, take a relay buffer and read
+// the socket to the end, touching every byte
+size_t RelayOnPlacedThread(SOCKET socket)
+{
+    SocketPlacement placement = PlaceConnection(socket);
+    size_t checksum = 0;
+    std::thread relay([&]() {
+        ApplyPlacement(placement);
+        RelayBuffer buffer(placement.node);
+        while (true)
+        {
+            int bytesReceived =
+                recv(socket, buffer.data(), static_cast<int>(buffer.size()), 0);
+            if (bytesReceived <= 0)
+            {
+                break;
+            }
+            for (int i = 0; i < bytesReceived; ++i)
+            {
+                checksum += static_cast<unsigned char>(buffer.data()[i]);
+            }
+        }
+    });
+    relay.join();
+    return checksum;
+}
+
+// A blocklist of patternCount patterns, split evenly between hosts, domains and URLs, none of
+// which the corpus requests match
+std::shared_ptr<Blocklist> MakeBlocklist(size_t patternCount)
+{
+    auto blocklist = std::make_shared<Blocklist>();
+    char pattern[64];
+    for (size_t i = 0; i < patternCount / 3; ++i)
+    {
+        snprintf(pattern, sizeof(pattern), "host%zu.blocked-example.com", i);
+        blocklist->AddHost(pattern);
+        snprintf(pattern, sizeof(pattern), "tracker%zu.net", i);
+        blocklist->AddDomain(pattern);
+        snprintf(pattern, sizeof(pattern), "/ads/%zu/banner", i);
+        blocklist->AddUrl(pattern);
+    }
+    blocklist->Compile();
+    return blocklist;
+}
+
+// A cache chunk's worth of generated markup, repetitive the way listing pages are
+std::string MakeMarkupChunk(size_t size)
+{
+    std::string markup;
+    char row[160];
+    for (unsigned i = 0; markup.size() < size; ++i)
+    {
+        snprintf(
+            row,
+            sizeof(row),
+            "<tr><td class=\"name\">Item %u</td><td><a href=\"/catalog/%u\">View</a></td></tr>\n",
+            i * 7919 % 100000,
+            i * 104729 % 10000);
+        markup += row;
+    }
+    markup.resize(size);
+    return markup;
+}
+} // namespace
+
+std::vector<MicroCase> ProxyMicroCases()
+{
+    std::vector<MicroCase> cases;
+    const std::vector<CorpusRequest>& corpus = RequestCorpus();
+
+    for (const CorpusRequest& request : corpus)
+    {
+        const std::string* text = &request.text;
+        cases.push_back(
+            {"GetHostFromRequest/" + request.name,
+             [text]() { return GetHostFromRequest(*text).size(); },
+             {},
+             {}});
+    }
+
+    for (const CorpusRequest& request : corpus)
+    {
+        const std::string* text = &request.text;
+        cases.push_back(
+            {"GetPathFromRequest/" + request.name,
+             [text]() { return GetPathFromRequest(*text).size(); },
+             {},
+             {}});
+    }
+    for (const CorpusRequest& request : corpus)
+    {
+        const std::string* text = &request.text;
+        cases.push_back(
+            {"RequestRoutable/" + request.name,
+             [text]() { return static_cast<size_t>(RequestRoutable(*text)); },
+             {},
+             {}});
+    }
+
+    // Via and X-Forwarded-For added and the target made origin-form, without copying the head
+    for (const CorpusRequest& request : corpus)
+    {
+        const std::string* text = &request.text;
+        cases.push_back(
+            {"RewriteRequestHead/" + request.name,
+             [text]() {
+                 RequestRewrite rewrite;
+                 rewrite.via = "1.1 bench";
+                 rewrite.forwardedFor = "192.168.100.200";
+                 SliceList slices;
+                 RewriteRequestHead(*text, rewrite, slices);
+                 return slices.Size();
+             },
+             {},
+             {}});
+    }
+
+    // The socket round trip is part of the number; compare these against each other, not
+    // against the pure parsing cases
+    std::shared_ptr<LoopbackRequest> loopback = std::make_shared<LoopbackRequest>();
+    for (const CorpusRequest& request : corpus)
+    {
+        const std::string* text = &request.text;
+        cases.push_back(
+            {"ReceiveData/" + request.name,
+             [loopback]() { return ReceiveData(loopback->Server()).size(); },
+             [loopback, text]() { loopback->Open(*text); },
+             [loopback]() { loopback->Close(); }});
+    }
+
+    // A thread per connection, as the proxy runs it, under each placement policy. The payload
+    // fits in the loopback buffers, so the relay never waits on the sender.
+    std::shared_ptr<std::string> payload = std::make_shared<std::string>(32768, 'x');
+    const std::pair<const char*, PlacementPolicy> policies[] = {
+        {"none", PlacementPolicy::None},
+        {"core", PlacementPolicy::Core},
+        {"node", PlacementPolicy::Node}};
+    for (const auto& policy : policies)
+    {
+        PlacementPolicy placementPolicy = policy.second;
+        cases.push_back(
+            {std::string("RelayThread/") + policy.first,
+             [loopback]() { return RelayOnPlacedThread(loopback->Server()); },
+             [loopback, payload, placementPolicy]() {
+                 ConfigurePlacement(placementPolicy);
+                 loopback->Open(*payload);
+             },
+             [loopback]() {
+                 loopback->Close();
+                 ConfigurePlacement(PlacementPolicy::None);
+             }});
+    }
+
+    // The request's host and path against 100k patterns, then the URL patterns alone scanned
+    // one by one for comparison
+    std::shared_ptr<Blocklist> blocklist = MakeBlocklist(100000);
+    auto urls = std::make_shared<std::vector<std::string>>();
+    for (size_t i = 0; i < 100000 / 3; ++i)
+    {
+        urls->push_back("/ads/" + std::to_string(i) + "/banner");
+    }
+    for (const CorpusRequest& request : corpus)
+    {
+        auto host = std::make_shared<std::string>(GetHostFromRequest(request.text));
+        auto path = std::make_shared<std::string>(GetPathFromRequest(request.text));
+        cases.push_back(
+            {"BlocklistMatch/" + request.name,
+             [blocklist, host, path]() {
+                 return static_cast<size_t>(blocklist->Match(*host, *path) != nullptr);
+             },
+             {},
+             {}});
+        cases.push_back(
+            {"BlocklistScan/" + request.name,
+             [urls, host, path]() {
+                 std::string url = *host + *path;
+                 size_t found = 0;
+                 for (const std::string& pattern : *urls)
+                 {
+                     found += url.find(pattern) != std::string::npos;
+                 }
+                 return found;
+             },
+             {},
+             {}});
+    }
+    cases.push_back(
+        {"BlocklistMatch/blocked",
+         [blocklist]() {
+             return static_cast<size_t>(
+                 blocklist->Match("www.example.com", "/static/ads/4242/banner.png") != nullptr);
+         },
+         {},
+         {}});
+
+    // One 16 KB cache chunk of markup each way
+    auto markup = std::make_shared<std::string>(MakeMarkupChunk(16 * 1024));
+    auto packed = std::make_shared<std::string>();
+    CompressBlock(markup->data(), markup->size(), *packed);
+    cases.push_back(
+        {"CompressBlock/markup",
+         [markup]() {
+             std::string block;
+             CompressBlock(markup->data(), markup->size(), block);
+             return block.size();
+         },
+         {},
+         {}});
+    cases.push_back(
+        {"DecompressBlock/markup",
+         [markup, packed]() {
+             std::string expanded(markup->size(), '\0');
+             return static_cast<size_t>(DecompressBlock(*packed, &expanded[0], expanded.size()));
+         },
+         {},
+         {}});
+
+    cases.push_back(
+        {"SetAddress/ipv4",
+         []() {
+             sockaddr_in address;
+             SetAddress("192.168.100.200", 8080, address);
+             return static_cast<size_t>(address.sin_addr.s_addr);
+         },
+         {},
+         {}});
+
+    return cases;
+}
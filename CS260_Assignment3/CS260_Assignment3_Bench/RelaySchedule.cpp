@@ -0,0 +1,104 @@
+﻿/*****************************************************************
+ * @file   RelaySchedule.cpp
+ * @brief  Mixed small and large responses pushed through the relay
+ * scheduler at a set bandwidth, comparing response times by policy.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "RelaySchedule.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+void PrintRow(std::ostream& out, const char* label, const HistogramSnapshot& histogram)
+{
+    char line[200];
+    snprintf(
+        line,
+        sizeof(line),
+        "  %-6s %6llu done  mean %9.3f  p50 %9.3f  p99 %9.3f  max %9.3f  (ms)\n",
+        label,
+        static_cast<unsigned long long>(histogram.totalCount),
+        histogram.Mean() / 1000.0,
+        histogram.ValueAtQuantile(0.5) / 1000.0,
+        histogram.ValueAtQuantile(0.99) / 1000.0,
+        histogram.max / 1000.0);
+    out << line;
+}
+} // namespace
+
+ScheduleReport RunRelaySchedule(const ScheduleSettings& settings, RelayPolicy policy)
+{
+    RelaySettings relay;
+    relay.bytesPerSecond = settings.bytesPerSecond;
+    relay.policy = policy;
+    relayScheduler.Configure(relay);
+
+    double meanBytes = settings.largeShare * settings.largeBytes +
+                       (1 - settings.largeShare) * settings.smallBytes;
+    std::mt19937 random(settings.seed);
+    std::exponential_distribution<double> gap(
+        settings.load * settings.bytesPerSecond / meanBytes);
+    std::bernoulli_distribution large(settings.largeShare);
+
+    ScheduleReport report;
+    std::mutex reportLock;
+    std::vector<std::thread> relays;
+    Clock::time_point start = Clock::now();
+    Clock::time_point arrival = start;
+    while (true)
+    {
+        arrival += std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(gap(random)));
+        if (arrival - start >= std::chrono::duration<double>(settings.durationSeconds))
+        {
+            break;
+        }
+        std::this_thread::sleep_until(arrival);
+
+        bool isLarge = large(random);
+        size_t bytes = isLarge ? settings.largeBytes : settings.smallBytes;
+        relays.emplace_back([&settings, &report, &reportLock, arrival, bytes, isLarge]() {
+            RelayFlow flow;
+            flow.started = arrival;
+            flow.totalBytes = bytes;
+            while (flow.sentBytes < bytes)
+            {
+                relayScheduler.Wait(flow, std::min(settings.chunkBytes, bytes - flow.sentBytes));
+            }
+            uint64_t micros = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - arrival)
+                    .count());
+            std::lock_guard<std::mutex> guard(reportLock);
+            (isLarge ? report.large : report.small).Record(micros);
+        });
+    }
+
+    for (std::thread& relay : relays)
+    {
+        relay.join();
+    }
+    relayScheduler.Configure(RelaySettings());
+    return report;
+}
+
+void PrintScheduleReport(const char* policyName, const ScheduleReport& report, std::ostream& out)
+{
+    HistogramSnapshot all = report.small;
+    all.Merge(report.large);
+    out << policyName << ":\n";
+    PrintRow(out, "small", report.small);
+    PrintRow(out, "large", report.large);
+    PrintRow(out, "all", all);
+}
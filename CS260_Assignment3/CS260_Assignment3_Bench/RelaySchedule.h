@@ -0,0 +1,42 @@
+﻿/*****************************************************************
+ * @file   RelaySchedule.h
+ * @brief  Mixed small and large responses pushed through the relay
+ * scheduler at a set bandwidth, comparing response times by policy.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include "Histogram.h"
+#include "RelayScheduler.h"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+struct ScheduleSettings
+{
+    double bytesPerSecond = 50e6;
+    double load = 0.9; // Offered bytes as a share of the bandwidth
+    double durationSeconds = 5.0;
+    size_t smallBytes = 16 * 1024;
+    size_t largeBytes = 4 * 1024 * 1024;
+    double largeShare = 0.05; // Share of responses that are large
+    size_t chunkBytes = 4095; // What one relay recv hands to the scheduler
+    uint32_t seed = 1;
+};
+
+struct ScheduleReport
+{
+    // From each response's arrival until its last chunk is let through, in microseconds
+    HistogramSnapshot small;
+    HistogramSnapshot large;
+};
+
+// Responses arrive at random (Poisson) times, each relayed by its own thread as the proxy would,
+// with no sockets involved; the scheduler's pacing stands in for the saturated link
+ScheduleReport RunRelaySchedule(const ScheduleSettings& settings, RelayPolicy policy);
+
+void PrintScheduleReport(const char* policyName, const ScheduleReport& report, std::ostream& out);
@@ -0,0 +1,162 @@
+﻿/*****************************************************************
+ * @file   Replay.cpp
+ * @brief  Re-drives the proxy with a captured connection stream at
+ * its recorded arrival times, against a stand-in origin.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "Replay.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+struct ReplayWorkerResult
+{
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+    HistogramSnapshot latency;
+    HistogramSnapshot serviceTime;
+};
+
+int RecordedStatus(const std::string& response)
+{
+    return response.size() >= 12 && response.compare(0, 5, "HTTP/") == 0
+               ? atoi(response.c_str() + 9)
+               : 0;
+}
+
+// Tags the request with its connection ID and, unless keepHost, points Host at the stand-in
+std::string PrepareRequest(
+    const CapturedConnection& connection,
+    const std::string& originTarget,
+    bool keepHost)
+{
+    std::string request = connection.request;
+    if (!keepHost)
+    {
+        size_t host = request.find("\r\nHost: ");
+        if (host != std::string::npos)
+        {
+            size_t valueStart = host + 8;
+            size_t valueEnd = request.find("\r\n", valueStart);
+            request.replace(valueStart, valueEnd - valueStart, originTarget);
+        }
+    }
+
+    size_t firstLineEnd = request.find("\r\n");
+    if (firstLineEnd != std::string::npos)
+    {
+        request.insert(
+            firstLineEnd + 2,
+            std::string(replayConnectionHeader) + ": " + std::to_string(connection.id) + "\r\n");
+    }
+    return request;
+}
+
+uint64_t MicrosBetween(Clock::time_point start, Clock::time_point end)
+{
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+}
+} // namespace
+
+ReplayResponder::ReplayResponder(const std::vector<CapturedConnection>& connections)
+{
+    for (const CapturedConnection& connection : connections)
+    {
+        _responses[connection.id] = &connection.response;
+    }
+}
+
+std::string ReplayResponder::operator()(const std::string& request) const
+{
+    std::string marker = std::string("\r\n") + replayConnectionHeader + ": ";
+    size_t at = request.find(marker);
+    if (at != std::string::npos)
+    {
+        uint64_t id = strtoull(request.c_str() + at + marker.size(), nullptr, 10);
+        auto response = _responses.find(id);
+        if (response != _responses.end() && !response->second->empty())
+        {
+            return *response->second;
+        }
+    }
+    return "HTTP/1.1 404 Not Recorded\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+}
+
+LoadReport RunReplay(
+    const ReplaySettings& settings,
+    const std::vector<CapturedConnection>& connections,
+    const std::string& originTarget)
+{
+    sockaddr_in proxyAddress = LoopbackAddress(settings.proxyHost, settings.proxyPort);
+    std::vector<ReplayWorkerResult> results(settings.connections);
+    std::vector<std::thread> workers;
+    std::atomic<size_t> nextConnection{0};
+    Clock::time_point start = Clock::now();
+
+    // Connections are handed out in arrival order, so a worker only waits on its own schedule
+    auto worker = [&](ReplayWorkerResult& result) {
+        std::vector<char> buffer(65536);
+        while (true)
+        {
+            size_t index = nextConnection.fetch_add(1);
+            if (index >= connections.size())
+            {
+                break;
+            }
+            const CapturedConnection& connection = connections[index];
+            std::string request = PrepareRequest(connection, originTarget, settings.keepHost);
+
+            Clock::time_point due =
+                start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(
+                            connection.arrivalUs / 1e6 / settings.speed));
+            std::this_thread::sleep_until(due);
+
+            Clock::time_point sent = Clock::now();
+            int status =
+                SendProxyRequest(proxyAddress, request, settings.timeoutMs, buffer, result.bytes);
+            Clock::time_point done = Clock::now();
+
+            // A replay is faithful when each response matches what the origin sent originally
+            ++result.requests;
+            if (status == 0 || status != RecordedStatus(connection.response))
+            {
+                ++result.errors;
+            }
+            result.serviceTime.Record(MicrosBetween(sent, done));
+            result.latency.Record(MicrosBetween(due, done));
+        }
+    };
+
+    for (ReplayWorkerResult& result : results)
+    {
+        workers.emplace_back(worker, std::ref(result));
+    }
+    for (std::thread& thread : workers)
+    {
+        thread.join();
+    }
+
+    LoadReport report;
+    report.openLoop = true;
+    report.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    for (const ReplayWorkerResult& result : results)
+    {
+        report.requests += result.requests;
+        report.errors += result.errors;
+        report.bytes += result.bytes;
+        report.latency.Merge(result.latency);
+        report.serviceTime.Merge(result.serviceTime);
+    }
+    return report;
+}
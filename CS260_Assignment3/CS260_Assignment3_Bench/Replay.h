@@ -0,0 +1,50 @@
+﻿/*****************************************************************
+ * @file   Replay.h
+ * @brief  Re-drives the proxy with a captured connection stream at
+ * its recorded arrival times, against a stand-in origin.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include "Capture.h"
+#include "LoadGenerator.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Request header the replayer adds so the stand-in origin knows which recording to answer with
+const char* const replayConnectionHeader = "X-Replay-Conn";
+
+struct ReplaySettings
+{
+    std::string proxyHost = "127.0.0.1";
+    int proxyPort = 0;
+    double speed = 1.0;    // 2 replays twice as fast as recorded
+    int connections = 64;  // Requests in flight at most; arrivals wait beyond this
+    int timeoutMs = 10000;
+    bool keepHost = false; // Send the recorded Host header instead of the stand-in origin's
+};
+
+// Stand-in origin logic: answers each replayed request with the response recorded for it
+class ReplayResponder
+{
+public:
+    explicit ReplayResponder(const std::vector<CapturedConnection>& connections);
+
+    // The recorded response, or a 404 for requests that carry no known connection ID
+    std::string operator()(const std::string& request) const;
+
+private:
+    std::unordered_map<uint64_t, const std::string*> _responses;
+};
+
+// Replays every connection in arrival order; originTarget is the Host to send unless keepHost.
+// Latency is measured from each request's scheduled arrival, as in an open-loop load run.
+LoadReport RunReplay(
+    const ReplaySettings& settings,
+    const std::vector<CapturedConnection>& connections,
+    const std::string& originTarget);
@@ -0,0 +1,96 @@
+﻿/*****************************************************************
+ * @file   RequestCorpus.cpp
+ * @brief  Request headers the microbenchmarks parse, from a bare
+ * curl request to deliberately pathological ones.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#include "RequestCorpus.h"
+
+namespace
+{
+std::vector<CorpusRequest> BuildCorpus()
+{
+    std::vector<CorpusRequest> corpus;
+
+    corpus.push_back(
+        {"curl",
+         "GET /index.html HTTP/1.1\r\n"
+         "Host: example.com\r\n"
+         "User-Agent: curl/8.4.0\r\n"
+         "Accept: */*\r\n"
+         "\r\n"});
+
+    corpus.push_back(
+        {"browser",
+         "GET http://www.example.com/articles/2024/07/proxy-performance?ref=home HTTP/1.1\r\n"
+         "Host: www.example.com\r\n"
+         "Connection: keep-alive\r\n"
+         "Upgrade-Insecure-Requests: 1\r\n"
+         "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, "
+         "like Gecko) Chrome/126.0.0.0 Safari/537.36\r\n"
+         "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,"
+         "image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+         "Referer: http://www.example.com/\r\n"
+         "Accept-Encoding: gzip, deflate\r\n"
+         "Accept-Language: en-US,en;q=0.9\r\n"
+         "\r\n"});
+
+    // Session, analytics and consent cookies the way a large site sends them, about 6 KB
+    std::string cookies;
+    for (int i = 0; i < 48; ++i)
+    {
+        cookies += (i == 0 ? "" : "; ") + std::string("_ga_") + std::to_string(i * 7919) + "=" +
+                   "GS1.1.1720000000.42.1.1720000999.0.0." + std::string(64, 'a' + i % 26);
+    }
+    corpus.push_back(
+        {"cookie_heavy",
+         "GET /account/settings HTTP/1.1\r\n"
+         "Host: shop.example.com:8080\r\n"
+         "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 14_5) AppleWebKit/605.1.15\r\n"
+         "Accept: text/html\r\n"
+         "Cookie: " +
+             cookies +
+             "\r\n"
+             "\r\n"});
+
+    // Host comes last, after a hundred custom headers
+    std::string manyHeaders = "POST /api/v2/batch HTTP/1.1\r\n";
+    for (int i = 0; i < 100; ++i)
+    {
+        manyHeaders += "X-Trace-Attribute-" + std::to_string(i) + ": " + std::string(40, 'v') +
+                       "\r\n";
+    }
+    manyHeaders += "Host: api.example.com\r\n\r\n";
+    corpus.push_back({"host_last", manyHeaders});
+
+    // No Host at all, so every line gets scanned, plus a 32 KB header line
+    corpus.push_back(
+        {"no_host_long_line",
+         "GET / HTTP/1.1\r\n"
+         "X-Padding: " +
+             std::string(32768, 'p') +
+             "\r\n"
+             "\r\n"});
+
+    // Thousands of tiny lines
+    std::string tinyLines = "GET / HTTP/1.1\r\n";
+    for (int i = 0; i < 4000; ++i)
+    {
+        tinyLines += "a:b\r\n";
+    }
+    tinyLines += "Host: tiny.example.com\r\n\r\n";
+    corpus.push_back({"tiny_lines", tinyLines});
+
+    return corpus;
+}
+} // namespace
+
+const std::vector<CorpusRequest>& RequestCorpus()
+{
+    static const std::vector<CorpusRequest> corpus = BuildCorpus();
+    return corpus;
+}
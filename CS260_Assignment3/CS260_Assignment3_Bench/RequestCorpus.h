@@ -0,0 +1,23 @@
+﻿/*****************************************************************
+ * @file   RequestCorpus.h
+ * @brief  Request headers the microbenchmarks parse, from a bare
+ * curl request to deliberately pathological ones.
+ * @author david.hedner@digipen.edu
+ * @date   July 2024
+ *
+ * @copyright � 2024 DigiPen (USA) Corporation.
+ *****************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct CorpusRequest
+{
+    std::string name;
+    std::string text;
+};
+
+// Built once on first use
+const std::vector<CorpusRequest>& RequestCorpus();